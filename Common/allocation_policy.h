@@ -0,0 +1,121 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace sim {
+
+  /*! Host memory allocation policy used by Array and ManagedAllocation
+   * Ignored when CUDA managed memory is used
+   */
+  struct AllocationPolicy {
+    std::size_t alignment; /**< Minimum byte alignment of allocations **/
+    bool first_touch;      /**< Initialize Array elements in parallel so pages are placed near the threads using them **/
+    bool huge_pages;       /**< Advise the kernel to back large allocations with transparent huge pages **/
+  };
+
+  /*! Process wide allocation policy
+   * Should be set from Parameters before Particles are constructed, allocations made earlier keep the default
+   * @return Reference to the allocation policy
+   */
+  inline AllocationPolicy &allocation_policy() {
+    static AllocationPolicy policy{64, true, false};
+    return policy;
+  }
+
+  /*! Allocate uninitialized storage according to the allocation policy
+   * @param bytes Number of bytes to allocate
+   * @return Pointer to storage which must be released with aligned_free
+   */
+  inline void *aligned_allocate(std::size_t bytes) {
+    const auto &policy = allocation_policy();
+    const std::size_t huge_page_bytes = 2 * 1024 * 1024;
+    const bool use_huge_pages = policy.huge_pages && bytes >= huge_page_bytes;
+
+    std::size_t alignment = (policy.alignment < sizeof(void *) ? sizeof(void *) : policy.alignment);
+    if (use_huge_pages && alignment < huge_page_bytes)
+      alignment = huge_page_bytes;
+
+    void *block = nullptr;
+    if (posix_memalign(&block, alignment, bytes == 0 ? alignment : bytes) != 0)
+      throw std::bad_alloc();
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    // Advisory only, failure leaves regular pages
+    if (use_huge_pages)
+      madvise(block, bytes, MADV_HUGEPAGE);
+#endif
+
+    return block;
+  }
+
+  /*! Release storage from aligned_allocate
+   * @param block Pointer returned by aligned_allocate, may be nullptr
+   */
+  inline void aligned_free(void *block) {
+    std::free(block);
+  }
+
+  /*! Construct count elements in uninitialized storage
+   * With first touch enabled elements are value initialized by a static OpenMP schedule, matching the
+   * partitioning for_each_index uses, so each page is first written by the thread that will process it
+   * @param data  Pointer to uninitialized storage
+   * @param count Number of elements to construct
+   */
+  template<typename T>
+  void construct_elements(T *data, std::size_t count) {
+    if (allocation_policy().first_touch) {
+#if defined(OPENMP)
+#pragma omp parallel for schedule(static)
+#endif
+      for (std::size_t i = 0; i < count; ++i)
+        new(data + i) T();
+    } else if (!std::is_trivially_default_constructible<T>::value) {
+      for (std::size_t i = 0; i < count; ++i)
+        new(data + i) T;
+    }
+  }
+
+  /*! Destroy count elements constructed with construct_elements
+   * @param data  Pointer to constructed elements
+   * @param count Number of elements to destroy
+   */
+  template<typename T>
+  void destroy_elements(T *data, std::size_t count) {
+    if (!std::is_trivially_destructible<T>::value) {
+      for (std::size_t i = 0; i < count; ++i)
+        data[i].~T();
+    }
+  }
+
+}
@@ -0,0 +1,199 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#if defined(CUDA)
+#include "cuda_runtime.h"
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <iomanip>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#if !defined(CUDA)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "managed_allocation.h"
+#include "allocation_policy.h"
+
+namespace sim {
+
+  /*! Single region from which fixed capacity arrays are carved
+   * The region is reserved up front but, on the host, pages are only committed when first written so the
+   * reservation may be generous. Carved arrays are never freed individually, the region is released when
+   * the arena is destroyed
+   */
+  class Arena : public ManagedAllocation {
+  public:
+    /*! Sizing arena without storage
+     * Carves only advance the used size, with the same alignment padding a reserved arena applies, and return
+     * nullptr, so a carve sequence can be measured before reserving an arena for it
+     */
+    Arena() : reserved_bytes_{std::numeric_limits<std::size_t>::max()},
+              used_bytes_{0},
+              base_{nullptr} {}
+
+    /*! Reserve the arena region
+     * @param reserve_bytes Number of bytes to reserve
+     */
+    Arena(std::size_t reserve_bytes) : reserved_bytes_{reserve_bytes},
+                                       used_bytes_{0},
+                                       base_{nullptr} {
+#if defined(CUDA)
+      auto err = cudaMallocManaged(&base_, reserved_bytes_);
+      if (err != cudaSuccess)
+        throw std::runtime_error("error allocating managed arena");
+#else
+      void *region = mmap(nullptr, reserved_bytes_, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (region == MAP_FAILED)
+        throw std::runtime_error("error reserving arena");
+      base_ = static_cast<char *>(region);
+#if defined(MADV_HUGEPAGE)
+      // Advisory only, failure leaves regular pages
+      if (allocation_policy().huge_pages)
+        madvise(base_, reserved_bytes_, MADV_HUGEPAGE);
+#endif
+#endif
+    }
+
+    /*! Release the arena region
+     */
+    ~Arena() {
+      if (!base_)
+        return;
+#if defined(CUDA)
+      cudaFree(base_);
+#else
+      munmap(base_, reserved_bytes_);
+#endif
+    }
+
+    /*! Carve uninitialized storage for count elements
+     * Elements are not constructed, pages are committed by the first write to them
+     * @param count Number of elements
+     * @param name  Name reported in the memory map
+     * @return Pointer to storage aligned to the allocation policy alignment
+     */
+    template<typename T>
+    T *allocate(std::size_t count, const std::string &name) {
+      static_assert(std::is_trivially_destructible<T>::value, "arena storage is never destructed");
+
+      std::size_t alignment = allocation_policy().alignment;
+      if (alignment < alignof(T))
+        alignment = alignof(T);
+
+      const std::size_t offset = (used_bytes_ + alignment - 1) / alignment * alignment;
+      const std::size_t bytes = count * sizeof(T);
+      if (offset > reserved_bytes_ || bytes > reserved_bytes_ - offset)
+        throw std::runtime_error("arena exhausted allocating " + name);
+
+      used_bytes_ = offset + bytes;
+      regions_.push_back(Region{name, offset, bytes});
+      return base_ ? reinterpret_cast<T *>(base_ + offset) : nullptr;
+    }
+
+    /*! Reserved size getter
+     * @return Number of bytes reserved for the arena
+     */
+    std::size_t reserved_bytes() const {
+      return reserved_bytes_;
+    }
+
+    /*! Used size getter
+     * @return Number of bytes carved from the arena, including alignment padding
+     */
+    std::size_t used_bytes() const {
+      return used_bytes_;
+    }
+
+    /*! Number of bytes of a carved region currently backed by physical pages
+     * @param offset Region offset from the arena base
+     * @param bytes  Region size
+     * @return Resident bytes rounded to whole pages, the region size if it can't be determined
+     */
+    std::size_t resident_bytes(std::size_t offset, std::size_t bytes) const {
+#if defined(CUDA)
+      return bytes;
+#else
+      if (bytes == 0)
+        return 0;
+      const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+      const std::size_t first_page = offset / page;
+      const std::size_t last_page = (offset + bytes - 1) / page;
+      std::vector<unsigned char> residency(last_page - first_page + 1);
+      if (mincore(base_ + first_page * page, residency.size() * page, residency.data()) != 0)
+        return bytes;
+
+      std::size_t resident = 0;
+      for (const auto in_core : residency)
+        resident += (in_core & 1) ? page : 0;
+      return resident;
+#endif
+    }
+
+    /*! Write the carved regions with their reserved and resident sizes
+     * @param stream Stream to write to
+     */
+    void print_memory_map(std::ostream &stream) const {
+      std::size_t total_resident = 0;
+      stream << std::left << std::setw(28) << "region" << std::right << std::setw(16) << "offset"
+             << std::setw(16) << "bytes" << std::setw(16) << "resident" << std::endl;
+      for (const auto &region : regions_) {
+        const std::size_t resident = this->resident_bytes(region.offset, region.bytes);
+        total_resident += resident;
+        stream << std::left << std::setw(28) << region.name << std::right << std::setw(16) << region.offset
+               << std::setw(16) << region.bytes << std::setw(16) << resident << std::endl;
+      }
+      stream << "arena used " << used_bytes_ << " of " << reserved_bytes_ << " reserved bytes, "
+             << total_resident << " resident" << std::endl;
+    }
+
+    Arena(const Arena &) = delete;
+
+    Arena &operator=(const Arena &) = delete;
+
+  private:
+    struct Region {
+      std::string name;
+      std::size_t offset;
+      std::size_t bytes;
+    };
+
+    std::size_t reserved_bytes_;
+    std::size_t used_bytes_;
+    char *base_;
+    std::vector<Region> regions_;
+  };
+
+}
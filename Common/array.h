@@ -29,9 +29,14 @@ THE SOFTWARE.
 #endif
 
 #include "managed_allocation.h"
+#include "allocation_policy.h"
+#include "arena.h"
 #include <memory>
 #include "device.h"
 #include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
 #include <stdexcept>
 
 
@@ -40,8 +45,8 @@ namespace sim {
 
 /*! Array like managed memory structure
  * Fixed capacity but variable size array structure allocated using cudaMallocManaged if CUDA is defined,
- * else system allocator If CUDA is defined both the data structure and underlying pointed to memory
- * are allocated using cudaMallocManaged
+ * else aligned host memory following sim::allocation_policy(). If CUDA is defined both the data structure
+ * and underlying pointed to memory are allocated using cudaMallocManaged
  */
   template<typename T>
   class Array : public ManagedAllocation {
@@ -56,7 +61,9 @@ namespace sim {
       }
       return data;
 #else
-      return new T[capacity_];
+      T *data = static_cast<T *>(sim::aligned_allocate(sizeof(T) * capacity_));
+      sim::construct_elements(data, capacity_);
+      return data;
 #endif
     }
 
@@ -65,19 +72,32 @@ namespace sim {
 #if defined(CUDA)
       cudaFree((void*)data_);
 #else
-      delete[] data_;
+      sim::destroy_elements(data_, capacity_);
+      sim::aligned_free(data_);
 #endif
     }
 
   public:
     /*! Construct an array of fixed capacity
      */
-    Array(const std::size_t capacity) : capacity_{capacity}, size_{0}, data_{alloc_data()} {}
+    Array(const std::size_t capacity) : capacity_{capacity}, size_{0}, data_{alloc_data()}, owns_data_{true} {}
+
+    /*! Construct an array of fixed capacity with storage carved from an arena
+     * Elements are uninitialized and the storage is released with the arena
+     * @param capacity Maximum number of elements
+     * @param arena    Arena to carve storage from, must outlive the array
+     * @param name     Name of the array in the arena memory map
+     */
+    Array(const std::size_t capacity, Arena &arena, const std::string &name) : capacity_{capacity},
+                                                                              size_{0},
+                                                                              data_{arena.allocate<T>(capacity, name)},
+                                                                              owns_data_{false} {}
 
     /*! Destruct array memory
      */
     ~Array() {
-      free_data();
+      if (owns_data_)
+        free_data();
     }
 
     /*! Copy constructor
@@ -86,6 +106,7 @@ namespace sim {
       capacity_ = source.capacity_;
       size_ = source.size_;
       data_ = alloc_data();
+      owns_data_ = true;
 
       if (data_) {
         for (std::size_t i = 0; i < size_; i++) {
@@ -132,29 +153,52 @@ namespace sim {
     }
 
     /*! Add multiple elements of a single value to end of the array
-     * Copies argument value push_count times and increased the size by push_count
+     * Copies argument value push_count times and increased the size by push_count, a single capacity check is made
      */
     void push_back(const T &value, const size_t push_count) {
-      if (size_ + 1 > capacity_)
-        throw std::runtime_error("Not enough capacity to push_back");
-      else {
-        for (std::size_t i = 0; i < push_count; i++) {
-          this->push_back(value);
-        }
-      }
+      T *destination = this->resize_uninitialized(size_ + push_count) - push_count;
+      // Large fills are the first touch of arena storage so are spread over the threads
+#if defined(OPENMP)
+#pragma omp parallel for schedule(static) if(push_count > 4096)
+#endif
+      for (std::size_t i = 0; i < push_count; ++i)
+        destination[i] = value;
     }
 
     /*! Add multiple elements to end of the array
-     * Copies elements starting at argument values_ptr to the back of array and increased the size by push_count
+     * Copies elements starting at argument values_ptr to the back of array and increased the size by push_count,
+     * a single capacity check is made and trivially copyable elements are copied with memcpy
      */
     void push_back(const T *values_ptr, const size_t push_count) {
-      if (size_ + 1 > capacity_)
-        throw std::runtime_error("Not enough capacity to push_back");
-      else {
-        for (std::size_t i = 0; i < push_count; i++) {
-          this->push_back(values_ptr[i]);
-        }
-      }
+      T *destination = this->resize_uninitialized(size_ + push_count) - push_count;
+      if (push_count == 0)
+        return;
+      if (std::is_trivially_copyable<T>::value)
+        std::memcpy(static_cast<void *>(destination), static_cast<const void *>(values_ptr), push_count * sizeof(T));
+      else
+        std::copy(values_ptr, values_ptr + push_count, destination);
+    }
+
+    /*! Set the array size without initializing new elements
+     * Elements beyond the previous size have unspecified values until written, such as by a for_each_index
+     * over the new range
+     * @param new_size Size of the array, must not exceed the capacity
+     * @return Pointer to one past the last element
+     */
+    T *resize_uninitialized(const std::size_t new_size) {
+      if (new_size > capacity_)
+        throw std::runtime_error("Not enough capacity to resize");
+      size_ = new_size;
+      return data_ + size_;
+    }
+
+    /*! Remove count elements from the end of the array, elements are not destructed
+     * @param count Number of elements to remove
+     */
+    void erase_tail(const std::size_t count) {
+      if (count > size_)
+        throw std::runtime_error("Array erased more elements than its size");
+      size_ -= count;
     }
 
     /*! Remove element from end of the array
@@ -168,13 +212,10 @@ namespace sim {
     }
 
     /*! Remove multiple elements from end of the array
-     * Remove element from end of array by reducing size by 1, element is not destructed
+     * Remove element from end of array by reducing size by pop_count, elements are not destructed
      */
     void pop_back(std::size_t pop_count) {
-      if (size_ == 0 && pop_count != 0)
-        throw std::runtime_error("Array popped_back with 0 size");
-      else
-        size_ -= pop_count;
+      this->erase_tail(pop_count);
     }
 
     /*! Getter for pointer to underlying data
@@ -213,6 +254,7 @@ namespace sim {
     std::size_t capacity_;
     std::size_t size_;
     T *data_;
+    bool owns_data_;  /**< false if data_ is carved from an Arena **/
   };
 
   /*! begin iterator for range based for loops
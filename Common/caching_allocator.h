@@ -0,0 +1,200 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#if defined(CUDA)
+#include "cuda_runtime.h"
+#endif
+
+#include <cstddef>
+#include <iostream>
+#include <map>
+#include <new>
+#include <stdexcept>
+#include "allocation_policy.h"
+
+namespace sim {
+
+  /*! Caching allocator for algorithm temporary storage
+   * Thrust algorithms such as sort_by_key and partition request temporary buffers on every call. Released
+   * blocks are kept and handed back to later requests that fit, so once the cache has grown to the high
+   * water mark of a time step no further system allocations are made. Requests that grow with the particle
+   * count would otherwise strand every smaller block, so a miss frees the cached blocks smaller than it
+   */
+  class CachingAllocator {
+  public:
+    typedef char value_type;
+
+    CachingAllocator() : bytes_in_use_{0},
+                         high_water_bytes_{0},
+                         cached_bytes_{0},
+                         request_count_{0},
+                         system_allocation_count_{0} {}
+
+    /*! Release all blocks
+     */
+    ~CachingAllocator() {
+      this->release();
+      for (auto &block : allocated_blocks_)
+        free_block(block.first);
+    }
+
+    CachingAllocator(const CachingAllocator &) = delete;
+
+    CachingAllocator &operator=(const CachingAllocator &) = delete;
+
+    CachingAllocator(CachingAllocator &&) noexcept = delete;
+
+    CachingAllocator &operator=(CachingAllocator &&)      = delete;
+
+    /*! Allocate temporary storage, reusing the smallest cached block that fits
+     * If none fits the free blocks, which are all smaller than the request, are freed before allocating
+     * @param bytes Number of bytes requested
+     * @return Pointer to storage
+     */
+    char *allocate(std::ptrdiff_t bytes) {
+      const std::size_t request = static_cast<std::size_t>(bytes);
+      ++request_count_;
+
+      char *block = nullptr;
+      std::size_t block_bytes = request;
+      auto cached = free_blocks_.lower_bound(request);
+      if (cached != free_blocks_.end()) {
+        block_bytes = cached->first;
+        block = cached->second;
+        free_blocks_.erase(cached);
+      } else {
+        this->release();
+        block = allocate_block(request);
+        cached_bytes_ += request;
+        ++system_allocation_count_;
+      }
+
+      allocated_blocks_.insert(std::make_pair(block, block_bytes));
+      bytes_in_use_ += block_bytes;
+      if (bytes_in_use_ > high_water_bytes_)
+        high_water_bytes_ = bytes_in_use_;
+
+      return block;
+    }
+
+    /*! Return storage to the cache
+     * @param block Pointer returned by allocate
+     */
+    void deallocate(char *block, std::size_t) {
+      auto allocated = allocated_blocks_.find(block);
+      if (allocated == allocated_blocks_.end())
+        throw std::runtime_error("CachingAllocator deallocating unknown block");
+
+      bytes_in_use_ -= allocated->second;
+      free_blocks_.insert(std::make_pair(allocated->second, block));
+      allocated_blocks_.erase(allocated);
+    }
+
+    /*! Free all cached blocks which are not in use
+     */
+    void release() {
+      for (auto &block : free_blocks_) {
+        cached_bytes_ -= block.first;
+        free_block(block.second);
+      }
+      free_blocks_.clear();
+    }
+
+    /*! High water mark getter
+     * @return Largest number of bytes in use at once
+     */
+    std::size_t high_water_bytes() const {
+      return high_water_bytes_;
+    }
+
+    /*! Cached bytes getter
+     * @return Number of bytes currently held, in use or free
+     */
+    std::size_t cached_bytes() const {
+      return cached_bytes_;
+    }
+
+    /*! Request count getter
+     * @return Number of allocate calls
+     */
+    std::size_t request_count() const {
+      return request_count_;
+    }
+
+    /*! System allocation count getter
+     * @return Number of allocate calls which weren't satisfied by the cache
+     */
+    std::size_t system_allocation_count() const {
+      return system_allocation_count_;
+    }
+
+    /*! Write allocation statistics
+     * @param stream Stream to write to
+     */
+    void print_statistics(std::ostream &stream) const {
+      stream << "Algorithm temporary storage: high water " << high_water_bytes_ << " bytes, cached "
+             << cached_bytes_ << " bytes, " << system_allocation_count_ << " of " << request_count_
+             << " requests allocated" << std::endl;
+    }
+
+  private:
+    static char *allocate_block(std::size_t bytes) {
+#if defined(CUDA)
+      void *block = nullptr;
+      if (cudaMalloc(&block, bytes) != cudaSuccess)
+        throw std::bad_alloc();
+      return static_cast<char *>(block);
+#else
+      return static_cast<char *>(sim::aligned_allocate(bytes));
+#endif
+    }
+
+    static void free_block(char *block) {
+#if defined(CUDA)
+      cudaFree(block);
+#else
+      sim::aligned_free(block);
+#endif
+    }
+
+    std::multimap<std::size_t, char *> free_blocks_; /**< Cached blocks not in use, keyed by size **/
+    std::map<char *, std::size_t> allocated_blocks_; /**< Blocks in use and their size **/
+    std::size_t bytes_in_use_;                       /**< Bytes currently handed out **/
+    std::size_t high_water_bytes_;                   /**< Largest bytes_in_use_ seen **/
+    std::size_t cached_bytes_;                       /**< Bytes held in free and allocated blocks **/
+    std::size_t request_count_;                      /**< Number of allocate calls **/
+    std::size_t system_allocation_count_;            /**< Number of allocate calls that missed the cache **/
+  };
+
+  /*! Process wide cache for algorithm temporary storage
+   * @return Reference to the caching allocator
+   */
+  inline CachingAllocator &temporary_allocator() {
+    static CachingAllocator allocator;
+    return allocator;
+  }
+}
@@ -0,0 +1,52 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "dimension.h"
+#include "vec.h"
+
+#define MAX_COLLIDERS 32
+
+/*! Collider shapes
+ */
+enum ColliderType {
+  SPHERE  = 0, /**< Sphere centered at a with radius **/
+  CAPSULE = 1, /**< Segment from a to b swept by radius **/
+  BOX     = 2, /**< Axis aligned box centered at a with half extents b **/
+  SDF     = 3, /**< Static boundary signed distance field translated by a **/
+};
+
+/*! POD collider description
+ * Stored in a fixed size array in Parameters so the set is broadcast from the renderer with the rest of
+ * the parameters
+ */
+template<typename Real, Dimension Dim>
+struct Collider {
+  int type;          /**< ColliderType **/
+  Vec<Real,Dim> a;   /**< Center, first segment point, or translation **/
+  Vec<Real,Dim> b;   /**< Second segment point or half extents **/
+  Real radius;       /**< Sphere and capsule radius **/
+};
@@ -30,8 +30,10 @@ THE SOFTWARE.
 
 #include <iostream>
 #include <new>
+#include "allocation_policy.h"
 
 /*! Inheritable class which overload new/delete operators to use cuda managed memory if CUDA is defined
+ * else aligned host memory following sim::allocation_policy()
  */
 class ManagedAllocation {
 public:
@@ -53,7 +55,7 @@ public:
       }
       return data;
     #else
-      return ::operator new(size);
+      return sim::aligned_allocate(size);
     #endif
   }
 
@@ -69,7 +71,7 @@ public:
     #if defined(CUDA)
       cudaFree((void*)block);
     #else
-      ::operator delete(block);
+      sim::aligned_free(block);
     #endif
   }
 
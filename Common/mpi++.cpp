@@ -59,6 +59,20 @@ namespace sim {
       check_return(err);
     }
 
+    void start_all(MPI_Request *requests, int count) {
+      int err = MPI_Startall(count, requests);
+      check_return(err);
+    }
+
+    void free_all(MPI_Request *requests, int count) {
+      for (int i = 0; i < count; ++i) {
+        if (requests[i] != MPI_REQUEST_NULL) {
+          int err = MPI_Request_free(&requests[i]);
+          check_return(err);
+        }
+      }
+    }
+
     ///
     /// Environment implimentation
     ///
@@ -141,6 +155,38 @@ namespace sim {
       return request;
     }
 
+    MPI_Request Communicator::send_init(int dest, int tag, const void *buf, int count, MPI_Datatype data_type) const {
+      MPI_Request request;
+      int err = MPI_Send_init(buf, count, data_type, dest, tag, comm_, &request);
+      check_return(err);
+
+      return request;
+    }
+
+    MPI_Request Communicator::recv_init(int source, int tag, void *buf, int count, MPI_Datatype data_type) const {
+      MPI_Request request;
+      int err = MPI_Recv_init(buf, count, data_type, source, tag, comm_, &request);
+      check_return(err);
+
+      return request;
+    }
+
+    MPI_Message Communicator::m_probe(int source, int tag, MPI_Datatype data_type, int &count) const {
+      MPI_Message message;
+      MPI_Status status;
+      int err = MPI_Mprobe(source, tag, comm_, &message, &status);
+      check_return(err);
+      err = MPI_Get_count(&status, data_type, &count);
+      check_return(err);
+
+      return message;
+    }
+
+    void Communicator::m_recv(void *buf, int count, MPI_Datatype data_type, MPI_Message &message) const {
+      int err = MPI_Mrecv(buf, count, data_type, &message, MPI_STATUS_IGNORE);
+      check_return(err);
+    }
+
     void Communicator::all_reduce(const void *send_buf, void *recv_buf, MPI_Datatype data_type, MPI_Op op) const {
       const int count = 1;
       int err = MPI_Allreduce(send_buf, recv_buf, count, data_type, op, comm_);
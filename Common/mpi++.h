@@ -65,6 +65,18 @@ namespace sim {
      */
     void wait_all(MPI_Request *requests, int count, MPI_Status *statuses);
 
+    /*! Start all provided persistent MPI Requests
+     * @param requests pointer to persistent MPI_Request array
+     * @param count    number of MPI_Requests to start
+     */
+    void start_all(MPI_Request *requests, int count);
+
+    /*! Free all provided inactive MPI Requests, null requests are skipped
+     * @param requests pointer to MPI_Request array, set to MPI_REQUEST_NULL
+     * @param count    number of MPI_Requests to free
+     */
+    void free_all(MPI_Request *requests, int count);
+
     /*! Generic template function, specilizations provided below
      * @return static assert should always fail at comepile time
      */
@@ -169,7 +181,7 @@ namespace sim {
                                 const MPI_Datatype MPI_AABB,
                                 MPI_Datatype &MPI_PARAMETERS) {
       typedef Parameters<Real, Dim> Parameters_type;
-      const int member_count = 24;
+      const int member_count = 48;
       MPI_Datatype types[member_count];
       MPI_Aint disps[member_count];
       int block_lengths[member_count];
@@ -274,6 +286,103 @@ namespace sim {
       block_lengths[23] = 1;
       disps[23] = offsetof(Parameters_type, mover_center_);
 
+      types[24] = get_mpi_type<Real>();
+      block_lengths[24] = 1;
+      disps[24] = offsetof(Parameters_type, sor_omega_);
+
+      types[25] = get_mpi_type<Real>();
+      block_lengths[25] = 1;
+      disps[25] = offsetof(Parameters_type, chebyshev_rho_);
+
+      types[26] = get_mpi_type<Real>();
+      block_lengths[26] = 1;
+      disps[26] = offsetof(Parameters_type, compliance_);
+
+      types[27] = MPI_INT;
+      block_lengths[27] = 1;
+      disps[27] = offsetof(Parameters_type, pressure_solver_);
+
+      types[28] = MPI_SIZE_T;
+      block_lengths[28] = 1;
+      disps[28] = offsetof(Parameters_type, divergence_solve_step_count_);
+
+      types[29] = MPI_INT;
+      block_lengths[29] = 1;
+      disps[29] = offsetof(Parameters_type, max_resolution_level_);
+
+      types[30] = MPI_INT;
+      block_lengths[30] = 1;
+      disps[30] = offsetof(Parameters_type, surface_neighbor_threshold_);
+
+      types[31] = get_mpi_type<Real>();
+      block_lengths[31] = 1;
+      disps[31] = offsetof(Parameters_type, flip_ratio_);
+
+      types[32] = MPI_SIZE_T;
+      block_lengths[32] = 1;
+      disps[32] = offsetof(Parameters_type, flip_band_depth_);
+
+      types[33] = MPI_SIZE_T;
+      block_lengths[33] = 1;
+      disps[33] = offsetof(Parameters_type, flip_pressure_iterations_);
+
+      types[34] = MPI_CHAR;
+      block_lengths[34] = MAX_PARAMETER_PATH;
+      disps[34] = offsetof(Parameters_type, boundary_obj_file_);
+
+      types[35] = MPI_CHAR;
+      block_lengths[35] = MAX_PARAMETER_PATH;
+      disps[35] = offsetof(Parameters_type, boundary_sdf_file_);
+
+      types[36] = get_mpi_type<Real>();
+      block_lengths[36] = 1;
+      disps[36] = offsetof(Parameters_type, boundary_sdf_spacing_);
+
+      // Colliders are POD and only exchanged between like processes
+      types[37] = MPI_BYTE;
+      block_lengths[37] = sizeof(Parameters_type::colliders_);
+      disps[37] = offsetof(Parameters_type, colliders_);
+
+      types[38] = MPI_INT;
+      block_lengths[38] = 1;
+      disps[38] = offsetof(Parameters_type, collider_count_);
+
+      types[39] = MPI_SIZE_T;
+      block_lengths[39] = 1;
+      disps[39] = offsetof(Parameters_type, allocation_alignment_);
+
+      types[40] = MPI_CXX_BOOL;
+      block_lengths[40] = 1;
+      disps[40] = offsetof(Parameters_type, first_touch_);
+
+      types[41] = MPI_CXX_BOOL;
+      block_lengths[41] = 1;
+      disps[41] = offsetof(Parameters_type, huge_pages_);
+
+      types[42] = get_mpi_type<Real>();
+      block_lengths[42] = 1;
+      disps[42] = offsetof(Parameters_type, load_imbalance_threshold_);
+
+      types[43] = get_mpi_type<Real>();
+      block_lengths[43] = 1;
+      disps[43] = offsetof(Parameters_type, load_cost_smoothing_);
+
+      types[44] = MPI_INT;
+      block_lengths[44] = 1;
+      disps[44] = offsetof(Parameters_type, halo_layers_);
+
+      types[45] = MPI_INT;
+      block_lengths[45] = 1;
+      disps[45] = offsetof(Parameters_type, halo_exchange_);
+
+      types[46] = get_mpi_type<Real>();
+      block_lengths[46] = 1;
+      disps[46] = offsetof(Parameters_type, halo_position_precision_);
+
+      types[47] = get_mpi_type<Real>();
+      block_lengths[47] = 1;
+      disps[47] = offsetof(Parameters_type, halo_velocity_precision_);
+
       int err;
       err = MPI_Type_create_struct(member_count, block_lengths, disps, types, &MPI_PARAMETERS);
       check_return(err);
@@ -389,6 +498,44 @@ namespace sim {
        */
       MPI_Request i_recv(int source, int tag, void *buf, int count, MPI_Datatype data_type) const;
 
+      /*! MPI_Send_init wrapper
+       * @param dest      destination message rank
+       * @param tag       message tag
+       * @param buf       pointer to send buffer, read each time the request is started
+       * @param count     number of elements to send
+       * @param data_type MPI datatype to send
+       * @return Persistent MPI_Request object
+       */
+      MPI_Request send_init(int dest, int tag, const void *buf, int count, MPI_Datatype data_type) const;
+
+      /*! MPI_Recv_init wrapper
+       * @param source    source message rank
+       * @param tag       message tag
+       * @param buf       pointer to receive buffer, written each time the request is started
+       * @param count     maximum number of elements to receieve
+       * @param data_type MPI datatype to receieve
+       * @return Persistent MPI_Request object
+       */
+      MPI_Request recv_init(int source, int tag, void *buf, int count, MPI_Datatype data_type) const;
+
+      /*! MPI_Mprobe wrapper
+       * Blocks until a message is available and removes it from matching by other receives
+       * @param source    source message rank, MPI_PROC_NULL matches an empty message
+       * @param tag       message tag
+       * @param data_type MPI datatype of the message elements
+       * @param count     set to the number of elements in the message
+       * @return MPI_Message handle to receive the message with
+       */
+      MPI_Message m_probe(int source, int tag, MPI_Datatype data_type, int &count) const;
+
+      /*! MPI_Mrecv wrapper
+       * @param buf       pointer to receive buffer
+       * @param count     number of elements to receive, as returned by m_probe
+       * @param data_type MPI datatype to receive
+       * @param message   MPI_Message returned by m_probe
+       */
+      void m_recv(void *buf, int count, MPI_Datatype data_type, MPI_Message &message) const;
+
       /*! MPI_Allreduce wrapper
        * @param send_buf pointer to send buffer
        * @param recv_buf pointer to receive buffer
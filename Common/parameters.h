@@ -29,15 +29,21 @@ THE SOFTWARE.
 #include "dimension.h"
 #include "vec.h"
 #include "aabb.h"
+#include "collider.h"
+#include "allocation_policy.h"
 #include "device.h"
 
 #include <cmath>
+#include <cstring>
 #include <string>
+#include <stdexcept>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/ini_parser.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string/trim.hpp>
 
+#define MAX_PARAMETER_PATH 256
+
 namespace sim {
 // Forward declaration
 template<typename Real, Dimension Dim>
@@ -58,6 +64,18 @@ public:
     EXIT           = (1 << 5), /**< Simulation will exit cleanly **/
   }; /**< enum Mode to describe the state of the application, mostly used for interactive rendering **/
 
+  enum PressureSolver {
+    PBF  = 0, /**< Position based fluids, lambda_epsilon relaxed constraints **/
+    XPBD = 1, /**< Extended position based dynamics, compliant constraints with accumulated lambdas **/
+    DFSPH = 2, /**< Divergence free SPH, velocity based density and divergence solves **/
+    HYBRID = 3, /**< FLIP/PIC grid solve for the bulk fluid, PBF for a band near the free surface **/
+  }; /**< enum PressureSolver to select the incompressibility solver used by the compute processes **/
+
+  enum HaloExchange {
+    MESSAGE = 0, /**< Two sided messages, neighbors on a shared node read from a shared memory window **/
+    RMA = 1,     /**< One sided puts into each neighbors receive window **/
+  }; /**< enum HaloExchange to select how halo particles are exchanged between compute processes **/
+
   /*! Construct initial parameters from file_name .INI file
    * @param file_name the .ini parameters file
    */
@@ -94,6 +112,24 @@ public:
     boost::property_tree::ini_parser::read_ini(file_name, property_tree);
 
     solve_step_count_ = property_tree.get<std::size_t>("SimParameters.number_solve_steps", -1);
+    divergence_solve_step_count_ = property_tree.get<std::size_t>("SimParameters.number_divergence_solve_steps", 1);
+    sor_omega_ = property_tree.get<Real>("SimParameters.sor_omega", 1.0);
+    chebyshev_rho_ = property_tree.get<Real>("SimParameters.chebyshev_rho", 0.0);
+    max_resolution_level_ = property_tree.get<int>("SimParameters.max_resolution_level", 0);
+    surface_neighbor_threshold_ = property_tree.get<int>("SimParameters.surface_neighbor_threshold", 30);
+    allocation_alignment_ = property_tree.get<std::size_t>("SimParameters.allocation_alignment", 64);
+    first_touch_ = property_tree.get<bool>("SimParameters.first_touch", true);
+    huge_pages_ = property_tree.get<bool>("SimParameters.huge_pages", false);
+    load_imbalance_threshold_ = property_tree.get<Real>("SimParameters.load_imbalance_threshold", 0.1);
+    load_cost_smoothing_ = property_tree.get<Real>("SimParameters.load_cost_smoothing", 0.25);
+    halo_layers_ = property_tree.get<int>("SimParameters.halo_layers", 0);
+    halo_exchange_ = to_halo_exchange(property_tree.get<std::string>("SimParameters.halo_exchange", "message"));
+    halo_position_precision_ = property_tree.get<Real>("SimParameters.halo_position_precision", 0.0);
+    halo_velocity_precision_ = property_tree.get<Real>("SimParameters.halo_velocity_precision", 0.0);
+    flip_ratio_ = property_tree.get<Real>("SimParameters.flip_ratio", 0.95);
+    flip_band_depth_ = property_tree.get<std::size_t>("SimParameters.flip_band_depth", 3);
+    flip_pressure_iterations_ = property_tree.get<std::size_t>("SimParameters.flip_pressure_iterations", 40);
+    pressure_solver_ = to_pressure_solver(property_tree.get<std::string>("SimParameters.pressure_solver", "pbf"));
     time_step_ = property_tree.get<Real>("SimParameters.time_step", -1.0);
     initial_global_particle_count_ = property_tree.get<std::size_t>("SimParameters.global_particle_count", -1);
     max_particles_local_ = property_tree.get<std::size_t>("SimParameters.max_particles_local", -1);
@@ -103,6 +139,7 @@ public:
     gamma_ = property_tree.get<Real>("PhysicalParameters.gamma", -1.0);
     visc_c_ = property_tree.get<Real>("PhysicalParameters.visc_c", -1.0);
     lambda_epsilon_ = property_tree.get<Real>("PhysicalParameters.lambda_epsilon", -1.0);
+    compliance_ = property_tree.get<Real>("PhysicalParameters.compliance", 0.0);
     k_stiff_ = property_tree.get<Real>("PhysicalParameters.k_stiff", -1.0);
     rest_density_ = property_tree.get<Real>("PhysicalParameters.density", -1.0);
     vorticity_coef_ = property_tree.get<Real>("PhysicalParameters.vorticity_coef", -1.0);
@@ -115,7 +152,83 @@ public:
     initial_fluid_.min = to_real_vec<Real,Dim>(property_tree.get<std::string>("InitialFluid.min", "0.0, 0.0, 0.0"));
     initial_fluid_.max = to_real_vec<Real,Dim>(property_tree.get<std::string>("InitialFluid.max", "0.0, 0.0, 0.0"));
 
+    copy_path(property_tree.get<std::string>("Boundary.obj_file", ""), boundary_obj_file_);
+    copy_path(property_tree.get<std::string>("Boundary.sdf_file", ""), boundary_sdf_file_);
+    boundary_sdf_spacing_ = property_tree.get<Real>("Boundary.sdf_spacing", 0.05);
+
     mover_center_ = to_real_vec<Real,Dim>(property_tree.get<std::string>("Mover.center", "0.0, 0.0, 0.0"));
+
+    // Colliders are read from consecutive [Collider0], [Collider1], ... sections
+    collider_count_ = 0;
+    while(collider_count_ < MAX_COLLIDERS) {
+      const std::string section = "Collider" + std::to_string(collider_count_);
+      if(!property_tree.get_child_optional(section))
+        break;
+      auto& collider = colliders_[collider_count_];
+      collider.type = to_collider_type(property_tree.get<std::string>(section + ".type"));
+      collider.a = to_real_vec<Real,Dim>(property_tree.get<std::string>(section + ".a", "0.0, 0.0, 0.0"));
+      collider.b = to_real_vec<Real,Dim>(property_tree.get<std::string>(section + ".b", "0.0, 0.0, 0.0"));
+      collider.radius = property_tree.get<Real>(section + ".radius", 0.0);
+      ++collider_count_;
+    }
+  }
+
+  /*! Convert .INI collider type name to ColliderType
+   * @param name collider type name, "sphere", "capsule", "box", or "sdf"
+   * @return the matching ColliderType
+   */
+  static ColliderType to_collider_type(const std::string& name) {
+    if(name == "sphere")
+      return ColliderType::SPHERE;
+    else if(name == "capsule")
+      return ColliderType::CAPSULE;
+    else if(name == "box")
+      return ColliderType::BOX;
+    else if(name == "sdf")
+      return ColliderType::SDF;
+    else
+      throw std::runtime_error("unknown collider type: " + name);
+  }
+
+  /*! Copy a path into a fixed length, null terminated, parameter field
+   * Fixed length storage keeps Parameters POD so it can be broadcast
+   * @param path        path to copy
+   * @param destination MAX_PARAMETER_PATH length character array
+   */
+  static void copy_path(const std::string& path, char* destination) {
+    if(path.size() >= MAX_PARAMETER_PATH)
+      throw std::runtime_error("parameter path too long: " + path);
+    std::strncpy(destination, path.c_str(), MAX_PARAMETER_PATH);
+  }
+
+  /*! Convert .INI pressure solver name to PressureSolver
+   * @param name pressure solver name, "pbf", "xpbd", "dfsph", or "hybrid"
+   * @return the matching PressureSolver
+   */
+  static PressureSolver to_pressure_solver(const std::string& name) {
+    if(name == "pbf")
+      return PressureSolver::PBF;
+    else if(name == "xpbd")
+      return PressureSolver::XPBD;
+    else if(name == "dfsph")
+      return PressureSolver::DFSPH;
+    else if(name == "hybrid")
+      return PressureSolver::HYBRID;
+    else
+      throw std::runtime_error("Unknown pressure_solver: " + name);
+  }
+
+  /*! Convert .INI halo exchange name to HaloExchange
+   * @param name halo exchange name, "message" or "rma"
+   * @return the matching HaloExchange
+   */
+  static HaloExchange to_halo_exchange(const std::string& name) {
+    if(name == "message")
+      return HaloExchange::MESSAGE;
+    else if(name == "rma")
+      return HaloExchange::RMA;
+    else
+      throw std::runtime_error("Unknown halo_exchange: " + name);
   }
 
   /*! Derive additional parameters from .INI parameters required for simulation
@@ -195,6 +308,32 @@ public:
     return smoothing_radius_;
   }
 
+  /*! Maximum adaptive resolution level getter
+    @return maximum number of times a particle may be merged, 0 disables adaptive resolution
+   */
+  DEVICE_CALLABLE
+  int max_resolution_level() const {
+    return max_resolution_level_;
+  }
+
+  /*! Adaptive resolution length scale
+    Each resolution level doubles the particle mass and so scales lengths by 2^(1/Dim)
+    @param level resolution level
+    @return length scale of level relative to level 0
+   */
+  DEVICE_CALLABLE
+  Real resolution_scale(const int level) const {
+    return exp2(static_cast<Real>(level) / static_cast<Real>(Dim));
+  }
+
+  /*! Surface neighbor threshold getter
+    @return particles with fewer neighbors than this are considered on the free surface
+   */
+  DEVICE_CALLABLE
+  int surface_neighbor_threshold() const {
+    return surface_neighbor_threshold_;
+  }
+
   /*! Neighbor grid bin spacing getter
     @return neighbor bin grid spacing(bin heigth/width)
    */
@@ -263,6 +402,103 @@ public:
     return solve_step_count_;
   }
 
+  /*! DFSPH divergence solver step count getter
+     @return DFSPH divergence solver step count
+   **/
+  DEVICE_CALLABLE
+  std::size_t divergence_solve_step_count() const {
+    return divergence_solve_step_count_;
+  }
+
+  /*! Host allocation policy getter
+   * @return Policy to install with sim::allocation_policy() before particle storage is allocated
+   */
+  AllocationPolicy allocation_policy() const {
+    return AllocationPolicy{allocation_alignment_, first_touch_, huge_pages_};
+  }
+
+  /*! Load imbalance threshold getter
+   * @return fraction the most loaded rank may exceed the mean load by before domains are repartitioned
+   */
+  Real load_imbalance_threshold() const {
+    return load_imbalance_threshold_;
+  }
+
+  /*! Load cost smoothing getter
+   * @return weight of the newest compute time sample in the exponentially smoothed per rank cost
+   */
+  Real load_cost_smoothing() const {
+    return load_cost_smoothing_;
+  }
+
+  /*! Halo depth getter
+   * @return halo depth in edge widths, 0 to choose between a deep halo and per substep syncs by cost
+   */
+  int halo_layers() const {
+    return halo_layers_;
+  }
+
+  /*! Halo exchange getter
+   * @return how halo particles are exchanged between compute processes
+   */
+  HaloExchange halo_exchange() const {
+    return halo_exchange_;
+  }
+
+  /*! Halo position precision getter
+   * @return quantization step of halo particle positions sent off node, 0 to send halo particles uncompressed
+   */
+  Real halo_position_precision() const {
+    return halo_position_precision_;
+  }
+
+  /*! Halo velocity precision getter
+   * @return quantization step of compressed halo particle velocities, 0 to send them exactly
+   */
+  Real halo_velocity_precision() const {
+    return halo_velocity_precision_;
+  }
+
+  /*! FLIP/PIC blend getter
+   * @return fraction of the FLIP velocity update used by the hybrid solver, the rest is PIC
+   */
+  DEVICE_CALLABLE
+  Real flip_ratio() const {
+    return flip_ratio_;
+  }
+
+  /*! Hybrid solver band depth getter
+   * @return particles within this many neighbor hops of the free surface are solved with PBF
+   */
+  DEVICE_CALLABLE
+  std::size_t flip_band_depth() const {
+    return flip_band_depth_;
+  }
+
+  /*! Hybrid solver grid pressure iteration count getter
+   * @return number of Jacobi iterations used in the grid pressure projection
+   */
+  DEVICE_CALLABLE
+  std::size_t flip_pressure_iterations() const {
+    return flip_pressure_iterations_;
+  }
+
+  /*! Successive over-relaxation weight getter
+   * @return weight applied to PBD solver delta positions
+   */
+  DEVICE_CALLABLE
+  Real sor_omega() const {
+    return sor_omega_;
+  }
+
+  /*! Chebyshev spectral radius estimate getter
+   * @return estimated spectral radius of the PBD Jacobi iteration, 0 disables Chebyshev acceleration
+   */
+  DEVICE_CALLABLE
+  Real chebyshev_rho() const {
+    return chebyshev_rho_;
+  }
+
   /*! Particle target rest mass getter
      @return Particle target rest mass
    */
@@ -301,6 +537,22 @@ public:
     return lambda_epsilon_;
   }
 
+  /*! XPBD density constraint compliance getter
+   * @return inverse stiffness of the XPBD density constraint
+   */
+  DEVICE_CALLABLE
+  Real compliance() const {
+    return compliance_;
+  }
+
+  /*! Pressure solver getter
+   * @return the incompressibility solver used by the compute processes
+   */
+  DEVICE_CALLABLE
+  PressureSolver pressure_solver() const {
+    return pressure_solver_;
+  }
+
   /*! K stiffness getter
    * @return K stiffness value
    */
@@ -524,6 +776,28 @@ public:
     return emitter_velocity_;
   }
 
+  /*! Static boundary mesh getter
+   * @return path to the OBJ mesh used as a static boundary, empty if there is none
+   */
+  const char* boundary_obj_file() const {
+    return boundary_obj_file_;
+  }
+
+  /*! Static boundary distance field cache getter
+   * @return path of the cached boundary signed distance field, empty to disable caching
+   */
+  const char* boundary_sdf_file() const {
+    return boundary_sdf_file_;
+  }
+
+  /*! Static boundary distance field spacing getter
+   * @return grid spacing of the boundary signed distance field
+   */
+  DEVICE_CALLABLE
+  Real boundary_sdf_spacing() const {
+    return boundary_sdf_spacing_;
+  }
+
   /*! Particle mover center
    * @return a point describing the center of the mover object
    */
@@ -532,6 +806,28 @@ public:
     return mover_center_;
   }
 
+  /*! Mover radius getter
+   * @return radius of the mover sphere
+   */
+  DEVICE_CALLABLE
+  Real mover_radius() const {
+    return static_cast<Real>(0.2);
+  }
+
+  /*! Colliders getter
+   * @return pointer to the first of collider_count() colliders
+   */
+  const Collider<Real,Dim>* colliders() const {
+    return colliders_;
+  }
+
+  /*! Collider count getter
+   * @return number of colliders, not including the mover
+   */
+  int collider_count() const {
+    return collider_count_;
+  }
+
   /*! Toggle the mover object being editable
    */
   DEVICE_CALLABLE
@@ -550,6 +846,23 @@ public:
   std::size_t max_particles_local_;           /**< Maximum particle count per process **/
   std::size_t initial_global_particle_count_; /**< Initially requested global particle count**/
   std::size_t solve_step_count_;              /**<  PBD solver steps per time step **/
+  std::size_t divergence_solve_step_count_;   /**<  DFSPH divergence solver steps per time step **/
+  Real sor_omega_;                            /**<  PBD solver over-relaxation weight **/
+  std::size_t allocation_alignment_;          /**<  Host allocation alignment in bytes **/
+  bool first_touch_;                          /**<  Parallel first touch initialization of arrays **/
+  bool huge_pages_;                           /**<  Transparent huge pages for large arrays **/
+  Real load_imbalance_threshold_;             /**<  Load imbalance which triggers domain repartitioning **/
+  Real load_cost_smoothing_;                  /**<  Weight of the newest sample in the smoothed compute cost **/
+  int halo_layers_;                           /**<  Halo depth in edge widths, 0 for automatic **/
+  HaloExchange halo_exchange_;                /**<  Halo particle exchange method **/
+  Real halo_position_precision_;              /**<  Halo position quantization step, 0 for uncompressed halos **/
+  Real halo_velocity_precision_;              /**<  Compressed halo velocity quantization step, 0 for exact velocities **/
+  Real flip_ratio_;                           /**<  Hybrid solver FLIP/PIC blend **/
+  std::size_t flip_band_depth_;               /**<  Hybrid solver PBF band depth in neighbor hops **/
+  std::size_t flip_pressure_iterations_;      /**<  Hybrid solver grid pressure iterations **/
+  Real chebyshev_rho_;                        /**<  PBD solver Chebyshev spectral radius estimate **/
+  int max_resolution_level_;                  /**<  Maximum adaptive resolution level **/
+  int surface_neighbor_threshold_;            /**<  Neighbor count below which a particle is on the surface **/
   Real particle_rest_spacing_;                /**<  Particle rest spacing **/
   Real particle_radius_;                      /**<  Particle rest radius **/
   Real smoothing_radius_;                     /**<  SPH particle smoothing radius **/
@@ -559,6 +872,7 @@ public:
   Real gravity_;                              /**<  Gravity magnitude **/
   Real gamma_;                                /**<  Surface tension gamma coefficient **/
   Real lambda_epsilon_;                       /**<  Constraint force mixing epsillion for PDB lambdas **/
+  Real compliance_;                           /**<  XPBD density constraint compliance **/
   Real k_stiff_;                              /**<  K_stiff **/
   Real visc_c_;                               /**<  Viscoscity coefficient **/
   Real time_step_;                            /**<  Simulation time step **/
@@ -568,9 +882,15 @@ public:
   AABB<Real,Dim> initial_fluid_;              /**<  Initial fluid AABB **/
   Mode simulation_mode_;                      /**<  Application mode **/
   ExecutionMode execution_mode_;              /**<  Simulation compute mode **/
+  PressureSolver pressure_solver_;            /**<  Incompressibility solver **/
   Vec<Real,Dim> emitter_center_;              /**<  Fluid emitter center **/
   Vec<Real,Dim> emitter_velocity_;            /**<  Fluid emitter particle velocity **/
   Vec<Real,Dim> mover_center_;                /**<  Mover ball center **/
+  char boundary_obj_file_[MAX_PARAMETER_PATH];  /**<  Static boundary OBJ mesh path **/
+  char boundary_sdf_file_[MAX_PARAMETER_PATH];  /**<  Static boundary SDF cache path **/
+  Real boundary_sdf_spacing_;                 /**<  Static boundary SDF grid spacing **/
+  Collider<Real,Dim> colliders_[MAX_COLLIDERS];  /**<  Interactive colliders in addition to the mover **/
+  int collider_count_;                        /**<  Number of valid colliders_ **/
 };
 
 /*!  fill a Vec<> from comma seperated input string
@@ -26,12 +26,22 @@ THE SOFTWARE.
 
 #include "device.h"
 #include "vec.h"
+#include "caching_allocator.h"
 #include "thrust/iterator/counting_iterator.h"
 #include "thrust/sort.h"
 #include "thrust/binary_search.h"
 #include "thrust/execution_policy.h"
 #include "thrust/for_each.h"
 #include <thrust/partition.h>
+#include <thrust/scan.h>
+#include <thrust/copy.h>
+
+/*! Compacted list of particle indices, typically produced by copy_index_if
+ */
+struct IndexList {
+  const std::size_t *indices; /**< Pointer to first index **/
+  std::size_t count;          /**< Number of indices **/
+};
 
 namespace sim {
   namespace algorithms {
@@ -56,7 +66,7 @@ namespace sim {
      */
     template<typename KeyIterator, typename ValueIterator>
     void sort_by_key(KeyIterator key_begin, KeyIterator key_end, ValueIterator value_begin) {
-      thrust::sort_by_key(thrust::system::cuda::par, key_begin, key_end, value_begin);
+      thrust::sort_by_key(thrust::system::cuda::par(sim::temporary_allocator()), key_begin, key_end, value_begin);
       cudaDeviceSynchronize();
     }
 
@@ -73,7 +83,7 @@ namespace sim {
       thrust::counting_iterator<std::size_t> search_begin(search_span.begin);
       thrust::counting_iterator<std::size_t> search_end(search_span.end);
 
-      thrust::lower_bound(thrust::system::cuda::par, begin, end,
+      thrust::lower_bound(thrust::system::cuda::par(sim::temporary_allocator()), begin, end,
                           search_begin, search_end,
                           result);
       cudaDeviceSynchronize();
@@ -92,7 +102,7 @@ namespace sim {
       thrust::counting_iterator<std::size_t> search_begin(search_span.begin);
       thrust::counting_iterator<std::size_t> search_end(search_span.end);
 
-      thrust::upper_bound(thrust::system::cuda::par, begin, end,
+      thrust::upper_bound(thrust::system::cuda::par(sim::temporary_allocator()), begin, end,
                           search_begin, search_end,
                           result);
       cudaDeviceSynchronize();
@@ -106,11 +116,39 @@ namespace sim {
      */
     template<typename ForwardIterator, typename Predicate>
     ForwardIterator partition(ForwardIterator begin, ForwardIterator end, Predicate predicate) {
-      auto result = thrust::partition(thrust::system::cuda::par, begin, end, predicate);
+      auto result = thrust::partition(thrust::system::cuda::par(sim::temporary_allocator()), begin, end, predicate);
       cudaDeviceSynchronize();
       return result;
     }
 
+    /*! Wrapper around thrust::exclusive_scan using cuda device
+     * @param begin  Iterator to beginning of range to be scanned
+     * @param end    Iterator to end of range to be scanned
+     * @param result Iterator to beginning of the output sequence, may equal begin
+     */
+    template<typename InputIterator, typename OutputIterator>
+    void exclusive_scan(InputIterator begin, InputIterator end, OutputIterator result) {
+      thrust::exclusive_scan(thrust::system::cuda::par(sim::temporary_allocator()), begin, end, result);
+      cudaDeviceSynchronize();
+    }
+
+    /*! Wrapper around thrust::copy_if applied to counting_iterator using cuda device
+     * Compacts the indices in span which satisfy predicate
+     * @param span      The span (] of indices to test
+     * @param result    Iterator to beginning of the output index sequence
+     * @param predicate Predicate taking a std::size_t index argument
+     * @return          Number of indices copied to result
+     */
+    template<typename OutputIterator, typename Predicate>
+    std::size_t copy_index_if(IndexSpan span, OutputIterator result, Predicate predicate) {
+      thrust::counting_iterator<std::size_t> begin(span.begin);
+      thrust::counting_iterator<std::size_t> end(span.end);
+
+      auto result_end = thrust::copy_if(thrust::system::cuda::par(sim::temporary_allocator()), begin, end, result, predicate);
+      cudaDeviceSynchronize();
+      return result_end - result;
+    }
+
 #endif
 
 #ifdef OPENMP
@@ -133,7 +171,7 @@ namespace sim {
      */
     template<typename key_iterator, typename value_iterator>
     void sort_by_key(key_iterator key_begin, key_iterator key_end, value_iterator value_begin) {
-      thrust::sort_by_key(thrust::system::omp::par, key_begin, key_end, value_begin);
+      thrust::sort_by_key(thrust::system::omp::par(sim::temporary_allocator()), key_begin, key_end, value_begin);
     }
 
     /*! Wrapper around thrust::lower_bound applied to span using OpenMP device
@@ -149,7 +187,7 @@ namespace sim {
       thrust::counting_iterator<std::size_t> search_begin(search_span.begin);
       thrust::counting_iterator<std::size_t> search_end(search_span.end);
 
-      thrust::lower_bound(thrust::system::omp::par, begin, end,
+      thrust::lower_bound(thrust::system::omp::par(sim::temporary_allocator()), begin, end,
                           search_begin, search_end,
                           result);
     }
@@ -167,7 +205,7 @@ namespace sim {
       thrust::counting_iterator<std::size_t> search_begin(search_span.begin);
       thrust::counting_iterator<std::size_t> search_end(search_span.end);
 
-      thrust::upper_bound(thrust::system::omp::par, begin, end,
+      thrust::upper_bound(thrust::system::omp::par(sim::temporary_allocator()), begin, end,
                           search_begin, search_end,
                           result);
     }
@@ -180,10 +218,36 @@ namespace sim {
      */
     template<typename ForwardIterator, typename Predicate>
     ForwardIterator partition(ForwardIterator begin, ForwardIterator end, Predicate predicate) {
-      auto result = thrust::partition(thrust::system::omp::par, begin, end, predicate);
+      auto result = thrust::partition(thrust::system::omp::par(sim::temporary_allocator()), begin, end, predicate);
       return result;
     }
 
+    /*! Wrapper around thrust::exclusive_scan using OpenMP device
+     * @param begin  Iterator to beginning of range to be scanned
+     * @param end    Iterator to end of range to be scanned
+     * @param result Iterator to beginning of the output sequence, may equal begin
+     */
+    template<typename InputIterator, typename OutputIterator>
+    void exclusive_scan(InputIterator begin, InputIterator end, OutputIterator result) {
+      thrust::exclusive_scan(thrust::system::omp::par(sim::temporary_allocator()), begin, end, result);
+    }
+
+    /*! Wrapper around thrust::copy_if applied to counting_iterator using OpenMP device
+     * Compacts the indices in span which satisfy predicate
+     * @param span      The span (] of indices to test
+     * @param result    Iterator to beginning of the output index sequence
+     * @param predicate Predicate taking a std::size_t index argument
+     * @return          Number of indices copied to result
+     */
+    template<typename OutputIterator, typename Predicate>
+    std::size_t copy_index_if(IndexSpan span, OutputIterator result, Predicate predicate) {
+      thrust::counting_iterator<std::size_t> begin(span.begin);
+      thrust::counting_iterator<std::size_t> end(span.end);
+
+      auto result_end = thrust::copy_if(thrust::system::omp::par(sim::temporary_allocator()), begin, end, result, predicate);
+      return result_end - result;
+    }
+
 #endif
 
 #ifdef CPP_PAR
@@ -206,7 +270,7 @@ namespace sim {
      */
     template<typename key_iterator, typename value_iterator>
     void sort_by_key(key_iterator key_begin, key_iterator key_end, value_iterator value_begin) {
-      thrust::sort_by_key(thrust::system::cpp::par, key_begin, key_end, value_begin);
+      thrust::sort_by_key(thrust::system::cpp::par(sim::temporary_allocator()), key_begin, key_end, value_begin);
     }
 
     /*! Wrapper around thrust::lower_bound applied to span using cpp device
@@ -222,7 +286,7 @@ namespace sim {
       thrust::counting_iterator<std::size_t> search_begin(search_span.begin);
       thrust::counting_iterator<std::size_t> search_end(search_span.end);
 
-      thrust::lower_bound(thrust::system::cpp::par, begin, end,
+      thrust::lower_bound(thrust::system::cpp::par(sim::temporary_allocator()), begin, end,
                           search_begin, search_end,
                           result);
     }
@@ -240,7 +304,7 @@ namespace sim {
       thrust::counting_iterator<std::size_t> search_begin(search_span.begin);
       thrust::counting_iterator<std::size_t> search_end(search_span.end);
 
-      thrust::upper_bound(thrust::system::cpp::par, begin, end,
+      thrust::upper_bound(thrust::system::cpp::par(sim::temporary_allocator()), begin, end,
                           search_begin, search_end,
                           result);
     }
@@ -253,10 +317,48 @@ namespace sim {
      */
     template<typename ForwardIterator, typename Predicate>
     ForwardIterator partition(ForwardIterator begin, ForwardIterator end, Predicate predicate) {
-      auto result = thrust::partition(thrust::system::cpp::par, begin, end, predicate);
+      auto result = thrust::partition(thrust::system::cpp::par(sim::temporary_allocator()), begin, end, predicate);
       return result;
     }
 
+    /*! Wrapper around thrust::exclusive_scan using cpp device
+     * @param begin  Iterator to beginning of range to be scanned
+     * @param end    Iterator to end of range to be scanned
+     * @param result Iterator to beginning of the output sequence, may equal begin
+     */
+    template<typename InputIterator, typename OutputIterator>
+    void exclusive_scan(InputIterator begin, InputIterator end, OutputIterator result) {
+      thrust::exclusive_scan(thrust::system::cpp::par(sim::temporary_allocator()), begin, end, result);
+    }
+
+    /*! Wrapper around thrust::copy_if applied to counting_iterator using cpp device
+     * Compacts the indices in span which satisfy predicate
+     * @param span      The span (] of indices to test
+     * @param result    Iterator to beginning of the output index sequence
+     * @param predicate Predicate taking a std::size_t index argument
+     * @return          Number of indices copied to result
+     */
+    template<typename OutputIterator, typename Predicate>
+    std::size_t copy_index_if(IndexSpan span, OutputIterator result, Predicate predicate) {
+      thrust::counting_iterator<std::size_t> begin(span.begin);
+      thrust::counting_iterator<std::size_t> end(span.end);
+
+      auto result_end = thrust::copy_if(thrust::system::cpp::par(sim::temporary_allocator()), begin, end, result, predicate);
+      return result_end - result;
+    }
+
 #endif
+
+    /*! Apply body to each index in a compacted index list
+     * @param list The list of indices the body will be applied to
+     * @param body a Lambda function taking a std::size_t index argument
+     */
+    template<typename T>
+    void for_each_index(IndexList list, T body) {
+      const std::size_t *indices = list.indices;
+      for_each_index(IndexSpan{0, list.count}, [=] DEVICE_CALLABLE(std::size_t i) {
+        body(indices[i]);
+      });
+    }
   } // end namespace algorithm
 } // end namespace sim
@@ -0,0 +1,319 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <cmath>
+#include "managed_allocation.h"
+#include "dimension.h"
+#include "array.h"
+#include "vec.h"
+#include "aabb.h"
+#include "collider.h"
+#include "parameters.h"
+#include "device.h"
+#include "signed_distance_field.h"
+
+namespace sim {
+
+  /*! Set of interactive colliders with a uniform grid broad phase
+   * The set contains the mover sphere followed by the Parameters colliders. Each broad phase cell lists
+   * the colliders whose bounds overlap it, so a particle only tests colliders near it
+   */
+  template<typename Real, Dimension Dim>
+  class Colliders : public ManagedAllocation {
+  public:
+    /*! Constructor
+     * @param parameters   Populated simulation parameters
+     * @param boundary_sdf Static boundary field, used for the boundary itself and by SDF colliders
+     */
+    Colliders(const Parameters<Real, Dim> &parameters,
+              const SignedDistanceField<Real, Dim> &boundary_sdf) : parameters_{parameters},
+                                                                    boundary_sdf_{boundary_sdf},
+                                                                    colliders_{MAX_COLLIDERS + 1},
+                                                                    collider_count_{0},
+                                                                    cell_count_{1},
+                                                                    built_{false},
+                                                                    begin_indices_{cells_per_axis_ * cells_per_axis_ *
+                                                                                   cells_per_axis_},
+                                                                    end_indices_{cells_per_axis_ * cells_per_axis_ *
+                                                                                 cells_per_axis_},
+                                                                    collider_ids_{cells_per_axis_ * cells_per_axis_ *
+                                                                                  cells_per_axis_ *
+                                                                                  (MAX_COLLIDERS + 1)} {
+      for (std::size_t d = 0; d < Dim; ++d)
+        cell_count_ *= cells_per_axis_;
+      this->update();
+    }
+
+    /*! Rebuild the collider set and broad phase from the current parameters
+     * Should be called whenever the parameters may have been changed by the renderer, the broad phase
+     * is only rebuilt if a collider or the boundary has changed
+     */
+    void update() {
+      bool changed = !built_;
+
+      // The mover is always the first collider
+      Collider<Real, Dim> mover;
+      mover.type = ColliderType::SPHERE;
+      mover.a = parameters_.mover_center();
+      mover.b = parameters_.mover_center();
+      mover.radius = parameters_.mover_radius();
+      changed = changed || !same_collider(colliders_[0], mover);
+      colliders_[0] = mover;
+
+      const std::size_t collider_count = 1 + parameters_.collider_count();
+      changed = changed || collider_count != collider_count_;
+      for (std::size_t c = 1; c < collider_count; ++c) {
+        const auto &collider = parameters_.colliders()[c - 1];
+        changed = changed || !same_collider(colliders_[c], collider);
+        colliders_[c] = collider;
+      }
+      collider_count_ = collider_count;
+
+      const auto boundary = parameters_.boundary();
+      for (std::size_t d = 0; d < Dim; ++d) {
+        const Real spacing = (boundary.max[d] - boundary.min[d]) / static_cast<Real>(cells_per_axis_);
+        changed = changed || spacing != cell_spacing_[d] || boundary.min[d] != origin_[d];
+        cell_spacing_[d] = spacing;
+      }
+      origin_ = boundary.min;
+
+      if (!changed)
+        return;
+
+      // Cells are filled on the host, there are at most a few dozen colliders
+      // Count the colliders overlapping each cell into end_indices_
+      for (std::size_t cell = 0; cell < cell_count_; ++cell)
+        end_indices_[cell] = 0;
+      for (std::size_t c = 0; c < collider_count_; ++c) {
+        this->for_each_overlapped_cell(colliders_[c], [&](std::size_t cell) {
+          ++end_indices_[cell];
+        });
+      }
+
+      // Scan the counts into begin indices, end_indices_ is then used as the per cell fill cursor
+      std::size_t index = 0;
+      for (std::size_t cell = 0; cell < cell_count_; ++cell) {
+        begin_indices_[cell] = index;
+        index += end_indices_[cell];
+        end_indices_[cell] = begin_indices_[cell];
+      }
+
+      for (std::size_t c = 0; c < collider_count_; ++c) {
+        this->for_each_overlapped_cell(colliders_[c], [&](std::size_t cell) {
+          collider_ids_[end_indices_[cell]++] = c;
+        });
+      }
+
+      built_ = true;
+    }
+
+    /*! Push a position out of the static boundary and any nearby colliders
+     * @param position Reference to position to push out
+     */
+    DEVICE_CALLABLE
+    void push_out(Vec<Real, Dim> &position) const {
+      boundary_sdf_.push_out(position);
+
+      const std::size_t cell = this->cell_index(this->cell_coordinate(position));
+      for (std::size_t i = begin_indices_[cell]; i < end_indices_[cell]; ++i)
+        this->push_out(colliders_[collider_ids_[i]], position);
+    }
+
+    /*! Collider count getter
+     * @return number of colliders, including the mover
+     */
+    std::size_t count() const {
+      return collider_count_;
+    }
+
+    /*! Broad phase candidate count
+     * @param position Location to query
+     * @return number of colliders tested for a particle at position
+     */
+    std::size_t candidate_count(const Vec<Real, Dim> &position) const {
+      const std::size_t cell = this->cell_index(this->cell_coordinate(position));
+      return end_indices_[cell] - begin_indices_[cell];
+    }
+
+  private:
+    static const std::size_t cells_per_axis_ = 16;  /**< Broad phase resolution **/
+
+    const Parameters<Real, Dim> &parameters_;
+    const SignedDistanceField<Real, Dim> &boundary_sdf_;
+    sim::Array<Collider<Real, Dim>> colliders_;     /**< Mover followed by the parameter colliders **/
+    std::size_t collider_count_;
+    std::size_t cell_count_;
+    bool built_;                                    /**< Broad phase has been built at least once **/
+    Vec<Real, Dim> origin_;                         /**< Broad phase lower corner, the boundary minimum **/
+    Vec<Real, Dim> cell_spacing_;
+    sim::Array<std::size_t> begin_indices_;         /**< Per cell begin index into collider_ids_ **/
+    sim::Array<std::size_t> end_indices_;           /**< Per cell end index into collider_ids_ **/
+    sim::Array<std::size_t> collider_ids_;          /**< Colliders overlapping each cell **/
+
+    /*! Broad phase cell coordinate, positions outside of the boundary map to the nearest cell
+     */
+    DEVICE_CALLABLE
+    Vec<std::size_t, Dim> cell_coordinate(const Vec<Real, Dim> &position) const {
+      Vec<std::size_t, Dim> coordinate;
+      for (std::size_t d = 0; d < Dim; ++d) {
+        const Real g = (position[d] - origin_[d]) / cell_spacing_[d];
+        if (!(g > static_cast<Real>(0.0)))
+          coordinate[d] = 0;
+        else if (g >= static_cast<Real>(cells_per_axis_ - 1))
+          coordinate[d] = cells_per_axis_ - 1;
+        else
+          coordinate[d] = static_cast<std::size_t>(g);
+      }
+      return coordinate;
+    }
+
+    /*! Linear broad phase cell index, the first axis varies fastest
+     */
+    DEVICE_CALLABLE
+    std::size_t cell_index(const Vec<std::size_t, Dim> &coordinate) const {
+      std::size_t cell = 0;
+      for (std::size_t d = Dim; d-- > 0;)
+        cell = cell * cells_per_axis_ + coordinate[d];
+      return cell;
+    }
+
+    /*! Call function with the index of each broad phase cell overlapped by the collider bounds
+     */
+    template<typename Function>
+    void for_each_overlapped_cell(const Collider<Real, Dim> &collider, Function function) const {
+      const auto bounds = this->collider_bounds(collider);
+      const auto lower = this->cell_coordinate(bounds.min);
+      const auto upper = this->cell_coordinate(bounds.max);
+
+      auto coordinate = lower;
+      std::size_t d = 0;
+      while (d < Dim) {
+        function(this->cell_index(coordinate));
+        // Advance the coordinate odometer style, wrapping exhausted axes back to their lower bound
+        for (d = 0; d < Dim; ++d) {
+          if (coordinate[d] < upper[d]) {
+            ++coordinate[d];
+            break;
+          }
+          coordinate[d] = lower[d];
+        }
+      }
+    }
+
+    /*! Compare two colliders by value
+     */
+    static bool same_collider(const Collider<Real, Dim> &lhs, const Collider<Real, Dim> &rhs) {
+      bool same = lhs.type == rhs.type && lhs.radius == rhs.radius;
+      for (std::size_t d = 0; d < Dim; ++d)
+        same = same && lhs.a[d] == rhs.a[d] && lhs.b[d] == rhs.b[d];
+      return same;
+    }
+
+    /*! Collider bounding box
+     */
+    AABB<Real, Dim> collider_bounds(const Collider<Real, Dim> &collider) const {
+      AABB<Real, Dim> bounds;
+      const Vec<Real, Dim> radius{collider.radius};
+      switch (collider.type) {
+        case ColliderType::CAPSULE:
+          for (std::size_t d = 0; d < Dim; ++d) {
+            bounds.min[d] = fmin(collider.a[d], collider.b[d]) - collider.radius;
+            bounds.max[d] = fmax(collider.a[d], collider.b[d]) + collider.radius;
+          }
+          break;
+        case ColliderType::BOX:
+          bounds.min = collider.a - collider.b;
+          bounds.max = collider.a + collider.b;
+          break;
+        case ColliderType::SDF:
+          bounds = boundary_sdf_.bounds();
+          bounds.min += collider.a;
+          bounds.max += collider.a;
+          break;
+        default:
+          bounds.min = collider.a - radius;
+          bounds.max = collider.a + radius;
+      }
+      return bounds;
+    }
+
+    /*! Push a position outside of a sphere
+     */
+    DEVICE_CALLABLE
+    static void push_out_sphere(const Vec<Real, Dim> &center, const Real radius, Vec<Real, Dim> &position) {
+      const Real distance_squared = magnitude_squared(position - center);
+      if (distance_squared < radius * radius && distance_squared > static_cast<Real>(0.0)) {
+        const Real distance = sqrt(distance_squared);
+        position += (radius - distance) * (position - center) / distance;
+      }
+    }
+
+    /*! Narrow phase push out of a single collider
+     */
+    DEVICE_CALLABLE
+    void push_out(const Collider<Real, Dim> &collider, Vec<Real, Dim> &position) const {
+      switch (collider.type) {
+        case ColliderType::CAPSULE: {
+          const auto segment = collider.b - collider.a;
+          const Real length_squared = magnitude_squared(segment);
+          Real t = (length_squared > static_cast<Real>(0.0) ? dot(position - collider.a, segment) / length_squared
+                                                            : static_cast<Real>(0.0));
+          t = fmin(fmax(t, static_cast<Real>(0.0)), static_cast<Real>(1.0));
+          push_out_sphere(collider.a + t * segment, collider.radius, position);
+          break;
+        }
+        case ColliderType::BOX: {
+          // Exit through the face with the least penetration
+          const auto offset = position - collider.a;
+          std::size_t exit_axis = 0;
+          Real exit_depth = static_cast<Real>(0.0);
+          for (std::size_t d = 0; d < Dim; ++d) {
+            const Real depth = collider.b[d] - fabs(offset[d]);
+            if (depth <= static_cast<Real>(0.0))
+              return;
+            if (d == 0 || depth < exit_depth) {
+              exit_axis = d;
+              exit_depth = depth;
+            }
+          }
+          position[exit_axis] = collider.a[exit_axis] + (offset[exit_axis] < static_cast<Real>(0.0) ? -1 : 1) *
+                                                        collider.b[exit_axis];
+          break;
+        }
+        case ColliderType::SDF: {
+          auto local = position - collider.a;
+          boundary_sdf_.push_out(local);
+          position = local + collider.a;
+          break;
+        }
+        default:
+          push_out_sphere(collider.a, collider.radius, position);
+      }
+    }
+  };
+
+}
@@ -29,16 +29,28 @@ THE SOFTWARE.
 #include <stdexcept>
 #include <string>
 #include <type_traits>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
 #include "vec.h"
+#include "aabb.h"
 #include "utility_math.h"
 #include "particles.h"
 #include "parameters.h"
 #include "thrust/execution_policy.h"
-#include <thrust/iterator/zip_iterator.h>
 #include "parameters.h"
 #include "mpi++.h"
 #include "device.h"
 #include "sim_algorithms.h"
+#include "halo_codec.h"
+
+
+#define MAX_NEIGHBOR_DOMAINS 26
+#define DOMAIN_HISTOGRAM_BINS 1024
+#define DOMAIN_HISTOGRAM_CHUNK_SIZE 4096
+#define MAX_HALO_SYNCS 8
 
 /***
   The distributor is responsible for all domain-to-domain communication as
@@ -46,12 +58,17 @@ THE SOFTWARE.
   Although it seems slightly odd the idea is that the distributor is the
   only class that's aware the simulation is distributed.
 
-  Particle arrays are arranged as such: { interior, edge_left, edge_right, halo_left, halo_right }
+  The compute ranks form a Cartesian grid of domains, dims_ domains along each axis with the domain
+  planes along an axis shared by every rank. Ranks are numbered x fastest so a grid with a single
+  split axis is the familiar x slab decomposition. Each domain has up to 8(2D) or 26(3D) neighbors
+  which share a face, edge, or corner.
+
+  Particle arrays are arranged as such: { interior, edge, halo_0, ..., halo_n }
 
   interior: particles which can be fully processed without halo information
-  edge: left/right edge particles from neighboring domains
+  edge: particles within the halo width of a domain face along a split axis, halo_layers_ edge widths
   resident: interor + edge particles(non halo particles)
-  halo: left/right edge particles from neighboring domains
+  halo: edge particles from each neighboring domain, ordered by neighbor index
   local: resident + halo particles
 
   index spans are defined for each region such that [begin,end) (end is one past the last index) defines the indices
@@ -64,9 +81,6 @@ template<typename Real, Dimension Dim>
 class Distributor {
 public:
 
-  typedef thrust::tuple< const Vec<Real,Dim>&, const Vec<Real,Dim>&, const Vec<Real,Dim>& > Tuple;
-  typedef thrust::zip_iterator<Tuple> ZippedTuple;
-
   /*! Distributor constructor
    *
    * Distributor Constructor: Don't use member references!
@@ -80,20 +94,82 @@ public:
   Distributor(bool manage_mpi=true) :
       environment_{manage_mpi},
       comm_compute_{1},
-      domain_{0.0, 0.0},
+      edge_width_{0.0},
+      compute_start_{0.0},
+      compute_cost_{0.0},
+      cost_smoothing_{1.0},
+      halo_layers_{1},
+      exchange_time_{0.0},
+      exchange_cost_{0.0},
+      sync_start_{0.0},
+      sync_time_{0.0},
+      sync_cost_{0.0},
+      halo_layer_count_{0.0},
       resident_count_{0},
-      edge_left_count_{0},
-      edge_right_count_{0},
-      halo_count_left_{0},
-      halo_count_right_{0},
-      receive_left_index_{0},
-      receive_right_index_{0} {
-                    sim::mpi::create_mpi_types<Real,Dim>(MPI_VEC_, MPI_PARAMETERS_);
+      edge_count_{0},
+      oob_count_{0},
+      receive_begin_{0},
+      max_receive_count_{0},
+      halo_sync_count_{0},
+      active_sync_{nullptr},
+      comm_node_{MPI_COMM_NULL},
+      node_window_{MPI_WIN_NULL},
+      window_{nullptr},
+      halo_exchange_{Parameters<Real,Dim>::MESSAGE},
+      neighbor_group_{MPI_GROUP_NULL},
+      halo_window_{MPI_WIN_NULL},
+      halo_precision_{0.0},
+      halo_velocity_precision_{0.0},
+      MPI_MIGRATE_PARTICLE_{MPI_DATATYPE_NULL},
+      MPI_HALO_PARTICLE_{MPI_DATATYPE_NULL} {
+    sim::mpi::create_mpi_types<Real,Dim>(MPI_VEC_, MPI_PARAMETERS_);
+
+    // Rank loads are reduced to their maximum and sum in a single collective
+    MPI_Type_contiguous(2, MPI_DOUBLE, &MPI_LOAD_);
+    MPI_Type_commit(&MPI_LOAD_);
+    MPI_Op_create(&max_sum_loads, 1, &MPI_MAX_SUM_);
+
+    domain_.min = Vec<Real,Dim>{(Real)0.0};
+    domain_.max = Vec<Real,Dim>{(Real)0.0};
+
+#if !defined(CUDA)
+    // Compute ranks on this node exchange halo particles through shared memory
+    MPI_Comm_split_type(comm_compute_.MPI_comm(), MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &comm_node_);
+#endif
+
+    // Balanced grid, largest number of domains along x, until the fluid extents are known
+    int dims[Dim];
+    for(int d=0; d<Dim; ++d)
+      dims[d] = 0;
+    MPI_Dims_create(comm_compute_.size(), Dim, dims);
+    this->set_topology(Vec<int,Dim>(dims));
+
+    for(int n=0; n<MAX_NEIGHBOR_DOMAINS; ++n) {
+      halo_counts_[n] = 0;
+      send_counts_[n] = 0;
+    }
+    for(auto& sync : halo_syncs_)
+      std::fill(sync.requests, sync.requests + 2*MAX_NEIGHBOR_DOMAINS, MPI_REQUEST_NULL);
   }
 
-  /*! Default destructor
+  /*! Destructor
+   * Persistent halo sync requests and the halo windows must be freed before MPI is finalized
    */
-  ~Distributor()                             = default;
+  ~Distributor() {
+    for(auto& sync : halo_syncs_)
+      sim::mpi::free_all(sync.requests, 2*MAX_NEIGHBOR_DOMAINS);
+    if(node_window_ != MPI_WIN_NULL) {
+      MPI_Win_unlock_all(node_window_);
+      MPI_Win_free(&node_window_);
+    }
+    if(comm_node_ != MPI_COMM_NULL)
+      MPI_Comm_free(&comm_node_);
+    if(halo_window_ != MPI_WIN_NULL)
+      MPI_Win_free(&halo_window_);
+    this->free_neighbor_group();
+    MPI_Op_free(&MPI_MAX_SUM_);
+    MPI_Type_free(&MPI_LOAD_);
+  }
 
   Distributor(const Distributor&)            = delete;
   Distributor& operator=(const Distributor&) = delete;
@@ -105,118 +181,363 @@ public:
    */
   void initialize_fluid(Particles<Real, Dim> &particles,
                         const Parameters<Real, Dim> &parameters) {
+    this->fit_topology(parameters.initial_fluid());
     this->set_domain_bounds(parameters.initial_fluid(),
                             parameters.boundary());
-    edge_width_ = 1.2*parameters.smoothing_radius();
+    edge_width_ = 1.2*parameters.smoothing_radius()*parameters.resolution_scale(parameters.max_resolution_level());
     this->distribute_fluid(parameters.initial_fluid(),
                            particles,
                            parameters.particle_rest_spacing(),
                            Vec<Real,Dim>{(Real)0.0});
   }
 
+  /*! Set the domain grid dimensions and find this ranks neighbors
+   * @param dims Number of domains along each axis, the product must equal the compute rank count
+   */
+  void set_topology(const Vec<int,Dim>& dims) {
+    if(product(dims) != comm_compute_.size())
+      throw std::runtime_error("Domain grid doesn't match the number of compute ranks");
+
+    dims_ = dims;
+    int rank = comm_compute_.rank();
+    for(int d=0; d<Dim; ++d) {
+      coords_[d] = rank % dims_[d];
+      rank /= dims_[d];
+    }
+
+    int n = 0;
+    for(int k=0; k<stencil_size; ++k) {
+      if(k == stencil_center)
+        continue;
+      neighbor_offsets_[n] = stencil_offset(k);
+      neighbor_ranks_[n] = this->rank_at(coords_ + neighbor_offsets_[n]);
+      ++n;
+    }
+    this->find_node_neighbors();
+
+    // Group of the distinct neighbor ranks, the origins and targets of one sided halo exchanges
+    int group_ranks[MAX_NEIGHBOR_DOMAINS];
+    int group_size = 0;
+    for(int n=0; n<neighbor_count_; ++n) {
+      if(neighbor_ranks_[n] != MPI_PROC_NULL &&
+         std::find(group_ranks, group_ranks + group_size, neighbor_ranks_[n]) == group_ranks + group_size)
+        group_ranks[group_size++] = neighbor_ranks_[n];
+    }
+    this->free_neighbor_group();
+    MPI_Group compute_group;
+    MPI_Comm_group(comm_compute_.MPI_comm(), &compute_group);
+    MPI_Group_incl(compute_group, group_size, group_ranks, &neighbor_group_);
+    MPI_Group_free(&compute_group);
+  }
+
+  /*! Assign the largest domain counts to the longest axes of the fluid
+   * Keeps the domain count along each axis but permutes the axes, ties favor x
+   * @param fluid Volume the domains will divide
+   */
+  void fit_topology(const AABB<Real,Dim>& fluid) {
+    int counts[Dim];
+    int axes[Dim];
+    for(int d=0; d<Dim; ++d) {
+      counts[d] = dims_[d];
+      axes[d] = d;
+    }
+    std::sort(counts, counts + Dim, [](int a, int b) { return a > b; });
+    std::stable_sort(axes, axes + Dim, [&](int a, int b) {
+      return fluid.max[a] - fluid.min[a] > fluid.max[b] - fluid.min[b];
+    });
+
+    Vec<int,Dim> dims;
+    for(int d=0; d<Dim; ++d)
+      dims[axes[d]] = counts[d];
+    this->set_topology(dims);
+  }
+
   /*! Set domain bounds based upon equal spacing in AABB
+   * Along each axis the fluid is divided evenly and the outer domains are stretched to the global boundary
    */
   void set_domain_bounds(const AABB<Real,Dim>& initial_fluid,
                          const AABB<Real,Dim>& global_boundary) {
-    Real domain_length = initial_fluid.length()/comm_compute_.size();
-    domain_.begin = initial_fluid.min.x + comm_compute_.rank() * domain_length;
-    domain_.end = domain_.begin + domain_length;
+    for(int d=0; d<Dim; ++d) {
+      const Real domain_length = (initial_fluid.max[d] - initial_fluid.min[d])/dims_[d];
+      splits_[d].resize(dims_[d] + 1);
+      for(int i=0; i<=dims_[d]; ++i)
+        splits_[d][i] = initial_fluid.min[d] + i * domain_length;
+
+      // Stretch first and last domains to fit global boundary
+      splits_[d].front() = global_boundary.min[d];
+      splits_[d].back() = global_boundary.max[d];
+    }
+    this->update_domain();
+  }
+
+  /*! Repartition the domains if the load is too unbalanced
+   * note: invalidate_halo must be called before balance_domains
+   * @param particles Particles to migrate to their new domains
+   * @param parameters Parameters providing the load imbalance threshold
+   * @return True if the domains were repartitioned
+   */
+  bool balance_domains(Particles<Real,Dim> & particles,
+                       const Parameters<Real,Dim> & parameters) {
+    if(comm_compute_.size() == 1 || this->load_imbalance() <= parameters.load_imbalance_threshold())
+      return false;
+
+    this->repartition_domains(particles);
+    return true;
+  }
 
-    // Stretch domain of first and last ranks to fit global boundary
-    if(this->is_last_domain())
-      domain_.end = global_boundary.max.x;
-    if(this->is_first_domain())
-      domain_.begin = global_boundary.min.x;
+  /*! Load imbalance of the compute ranks
+   * @return Fraction the most loaded rank exceeds the mean load by, 0 if perfectly balanced
+   */
+  Real load_imbalance() const {
+    const double local_load = this->compute_load();
+    const double local_loads[2] = {local_load, local_load};
+    double loads[2] = {0.0, 0.0};
+    comm_compute_.all_reduce(local_loads, loads, MPI_LOAD_, MPI_MAX_SUM_);
+
+    const double max_load = loads[0];
+    const double global_load = loads[1];
+    if(global_load <= 0.0)
+      return 0.0;
+    const double mean_load = global_load / comm_compute_.size();
+    return static_cast<Real>(max_load / mean_load - 1.0);
   }
 
-  /*! Checks for balanced number of particles in each domain
+  /*! MPI reduction of {maximum, sum} load pairs
    */
-  void balance_domains() {
-    // Particles per domain if evenly divided
-    const int64_t even_count = global_resident_count() / comm_compute_.size();
-    const int64_t max_diff = even_count * 0.05;
+  static void max_sum_loads(void* in, void* inout, int* count, MPI_Datatype*) {
+    const double* in_loads = static_cast<const double*>(in);
+    double* inout_loads = static_cast<double*>(inout);
+    for(int i=0; i<*count; ++i) {
+      inout_loads[2*i] = std::max(inout_loads[2*i], in_loads[2*i]);
+      inout_loads[2*i + 1] += in_loads[2*i + 1];
+    }
+  }
 
-    // Fixed distance to move partition if unbalanced
-    const Real dx = edge_width_ * (Real)0.15;
+  /*! Start timing this ranks compute phase
+   */
+  void begin_compute_timing() {
+    compute_start_ = MPI_Wtime();
+    sync_time_ = 0.0;
+  }
 
-    // Minimum domain width
-    const Real min_width = 3.0*edge_width_;
+  /*! Stop timing this ranks compute phase and fold the time into the smoothed compute cost
+   * Time spent in the domain sync and halo value syncs within the phase isn't compute,
+   * a rank waiting on slow neighbors isn't loaded
+   */
+  void end_compute_timing() {
+    this->smooth_cost(compute_cost_, std::max(MPI_Wtime() - compute_start_ - sync_time_, 0.0));
+  }
 
-    // Exchange information with neighbors
-    const std::size_t my_count = resident_count();
-    std::size_t right_count = 0;
-    comm_compute_.send_recv(&my_count, this->domain_to_left(),
-                            &right_count, this->domain_to_right(),
-                            1, sim::mpi::get_mpi_size_t());
+  /*! Fold a time sample into an exponentially smoothed cost
+   * @param cost Smoothed cost, 0 if no sample has been taken
+   * @param sample Newest time sample
+   */
+  void smooth_cost(double& cost, double sample) const {
+    if(cost == 0.0)
+      cost = sample;
+    else
+      cost = cost_smoothing_ * sample + (1.0 - cost_smoothing_) * cost;
+  }
 
-    const Real my_length = domain_.end - domain_.begin;
-    Real left_length = 0.0;
-    Real right_length = 0.0;
-    comm_compute_.send_recv(&my_length, this->domain_to_left(),
-                            &left_length, this->domain_to_left(),
-                            1, sim::mpi::get_mpi_type<Real>());
-    comm_compute_.send_recv(&my_length, this->domain_to_right(),
-                            &right_length, this->domain_to_right(),
-                            1, sim::mpi::get_mpi_type<Real>());
+  /*! Load of this rank used to balance the domains
+   * The smoothed compute time once it has been measured, the resident particle count before
+   * @return Load in arbitrary units consistent across the compute ranks
+   */
+  double compute_load() const {
+    if(compute_cost_ > 0.0)
+      return compute_cost_;
+    return static_cast<double>(this->resident_count());
+  }
 
-    const int64_t diff = my_count - even_count;
-    const int64_t right_diff = right_count - even_count;
+  /*! Cost of a resident particle, the rank load spread evenly over its particles
+   * @return Load per resident particle
+   */
+  double particle_cost() const {
+    return this->compute_load() / std::max(this->resident_count(), static_cast<std::size_t>(1));
+  }
 
-    if(domain_to_left() != MPI_PROC_NULL) {
-      // domain has too many particles
-      if(diff > max_diff && my_length > min_width)
-        domain_.begin += dx;
-      // domain has too few particles
-      if(diff < -max_diff && left_length > min_width)
-        domain_.begin -= dx;
+  /*! Compute new domain planes from the global cost distribution and migrate particles to them
+   * Each axis is bisected recursively at once: the planes along an axis are placed at the quantiles of a
+   * global histogram of particle positions weighted by particle_cost(), restricted to a tensor product grid so each domain keeps the
+   * same neighbors. Particles are then sent directly to their new owner, however far away it is.
+   * note: invalidate_halo must be called before repartition_domains
+   * @param particles Particles to migrate to their new domains
+   */
+  void repartition_domains(Particles<Real,Dim> & particles) {
+    // Domains must be at least as wide as the halo so edge particles are only needed by neighbors
+    const Real min_width = this->halo_width();
+
+    const Vec<Real,Dim>* position_stars = particles.position_stars().data();
+    // Particles are weighted by the measured cost of the rank computing them
+    const double particle_cost = this->particle_cost();
+    std::vector<double> my_costs(DOMAIN_HISTOGRAM_BINS);
+    std::vector<double> bin_costs(DOMAIN_HISTOGRAM_BINS);
+
+    for(int d=0; d<Dim; ++d) {
+      if(dims_[d] == 1)
+        continue;
+
+      auto& splits = splits_[d];
+
+      // Too narrow for every domain to be a halo wide, enforcing the minimum width would cross the planes
+      if(splits.back() - splits.front() < dims_[d] * min_width)
+        continue;
+
+      const Real lower = splits.front();
+      const Real bin_width = (splits.back() - lower) / DOMAIN_HISTOGRAM_BINS;
+
+      const std::size_t* counts = this->histogram(this->resident_span(), [=] DEVICE_CALLABLE (std::size_t p) {
+        const Real bin = (position_stars[p][d] - lower) / bin_width;
+        return static_cast<std::size_t>(Utility::clamp(bin, (Real)0.0, (Real)(DOMAIN_HISTOGRAM_BINS - 1)));
+      });
+      for(int b=0; b<DOMAIN_HISTOGRAM_BINS; ++b)
+        my_costs[b] = particle_cost * counts[b];
+      MPI_Allreduce(my_costs.data(), bin_costs.data(), DOMAIN_HISTOGRAM_BINS, MPI_DOUBLE, MPI_SUM,
+                    comm_compute_.MPI_comm());
+
+      double total_cost = 0.0;
+      for(const auto cost : bin_costs)
+        total_cost += cost;
+      if(total_cost <= 0.0)
+        continue;
+
+      // Place plane i at the bin edge nearest to where the cumulative cost reaches i/dims of the total
+      int b = 0;
+      double below_cost = 0.0;
+      for(int i=1; i<dims_[d]; ++i) {
+        const double target = total_cost * i / dims_[d];
+        while(b < DOMAIN_HISTOGRAM_BINS-1 && below_cost + bin_costs[b] < target) {
+          below_cost += bin_costs[b];
+          ++b;
+        }
+        const double fraction = bin_costs[b] > 0.0 ? (target - below_cost) / bin_costs[b] : 0.0;
+        splits[i] = lower + (b + (fraction < 0.5 ? 0 : 1)) * bin_width;
+      }
+
+      // Enforce the minimum width from both ends, the outer planes are fixed to the global boundary
+      for(int i=1; i<dims_[d]; ++i)
+        splits[i] = std::max(splits[i], splits[i-1] + min_width);
+      for(int i=dims_[d]-1; i>0; --i)
+        splits[i] = std::min(splits[i], splits[i+1] - min_width);
     }
 
-    if(domain_to_right() != MPI_PROC_NULL) {
-      // domain to right has too many particles
-      if(right_diff > max_diff && right_length > min_width)
-        domain_.end += dx;
-      // domain to right has too few particles
-      if(right_diff < -max_diff && my_length > min_width)
-        domain_.end -= dx;
-    }
+    this->update_domain();
+    this->migrate_particles(particles);
 
-//    std::cout<<"bounds for rank: "<<comm_compute_.rank()<<" "<<domain_.begin<<", "<<domain_.end<<std::endl;
+    // Estimate the new domains cost until it's measured again
+    if(compute_cost_ > 0.0)
+      compute_cost_ = particle_cost * this->resident_count();
   }
 
   /*! Check if domain is the last, maximum in x direction
    * @return True if last rank in domain
    */
   bool is_last_domain() const {
-    return comm_compute_.rank() == comm_compute_.size()-1;
+    return coords_[0] == dims_[0]-1;
   }
 
   /*! Check if domain is the first, minimum in x direction
    * @return True if first rank in domain
    */
   bool is_first_domain() const {
-    return comm_compute_.rank() == 0;
+    return coords_[0] == 0;
   }
 
   /*! Fetch domain to the left of this ranks domain
    * @return Rank of domain to the left or MPI_PROC_NULL
    */
   int domain_to_left() const {
-    int left = MPI_PROC_NULL;
-    if(comm_compute_.rank() > 0)
-      left = comm_compute_.rank() - 1;
-
-    return left;
+    Vec<int,Dim> offset{static_cast<int>(0)};
+    offset[0] = -1;
+    return neighbor_ranks_[neighbor_index(offset)];
   }
 
   /*! Fetch domain to the right of this ranks domain
    * @return Rank of domain to the right or MPI_PROC_NULL
    */
   int domain_to_right() const {
-    int right = MPI_PROC_NULL;
-    if(comm_compute_.rank() != comm_compute_.size()-1)
-      right = comm_compute_.rank() + 1;
+    Vec<int,Dim> offset{static_cast<int>(0)};
+    offset[0] = 1;
+    return neighbor_ranks_[neighbor_index(offset)];
+  }
+
+  /*! Get the number of neighbor slots, including those beyond the global boundary
+   * @return 8 in 2D, 26 in 3D
+   */
+  int neighbor_domain_count() const {
+    return neighbor_count_;
+  }
+
+  /*! Get the rank of a neighboring domain
+   * @param n Neighbor index
+   * @return Rank of the neighbor or MPI_PROC_NULL
+   */
+  int neighbor_rank(int n) const {
+    return neighbor_ranks_[n];
+  }
+
+  /*! Get the bounds of a neighboring domain
+   * @param n Neighbor index
+   * @return Bounds of the neighbor, empty if the neighbor is beyond the global boundary
+   */
+  AABB<Real,Dim> neighbor_domain(int n) const {
+    AABB<Real,Dim> bounds;
+    bounds.min = Vec<Real,Dim>{(Real)0.0};
+    bounds.max = Vec<Real,Dim>{(Real)0.0};
+    if(neighbor_ranks_[n] == MPI_PROC_NULL)
+      return bounds;
+
+    const Vec<int,Dim> coords = coords_ + neighbor_offsets_[n];
+    for(int d=0; d<Dim; ++d) {
+      bounds.min[d] = splits_[d][coords[d]];
+      bounds.max[d] = splits_[d][coords[d] + 1];
+    }
+    return bounds;
+  }
+
+  /*! Get the index of the neighbor at a grid offset
+   * @param offset Offset of -1, 0, or 1 along each axis, not all 0
+   * @return Neighbor index
+   */
+  static int neighbor_index(const Vec<int,Dim>& offset) {
+    int k = 0;
+    int stride = 1;
+    for(int d=0; d<Dim; ++d) {
+      k += (offset[d] + 1) * stride;
+      stride *= 3;
+    }
+    return k < stencil_center ? k : k - 1;
+  }
+
+  /*! Get the number of neighbors whose halo particles are read from shared memory
+   * @return Count of neighbors on this node once the node window has been created
+   */
+  int shared_neighbor_count() const {
+    int count = 0;
+    for(int n=0; n<neighbor_count_; ++n)
+      count += neighbor_windows_[n] != nullptr;
+    return count;
+  }
+
+  /*! Get the domain grid dimensions
+   * @return Number of domains along each axis
+   */
+  const Vec<int,Dim>& dims() const {
+    return dims_;
+  }
+
+  /*! Get the coordinates of this ranks domain in the domain grid
+   * @return Domain grid coordinates
+   */
+  const Vec<int,Dim>& coords() const {
+    return coords_;
+  }
 
-    return right;
+  /*! Get the bounds of this ranks domain
+   * @return Domain bounds
+   */
+  const AABB<Real,Dim>& domain() const {
+    return domain_;
   }
 
   /*! Get the MPI rank within the compute communicator
@@ -258,11 +579,11 @@ public:
      @return count of edge particles
    */
   std::size_t edge_count() const {
-    return edge_left_count_ + edge_right_count_;
+    return edge_count_;
   }
 
   /*! Get the span defining the edge particle indices:
-     @return span of edge particle indices: left/right edge particles from neighboring domains
+     @return span of edge particle indices: particles needed by neighboring domains
    */
   IndexSpan edge_span() const {
     return IndexSpan(resident_count_ - edge_count(), resident_count_);
@@ -272,10 +593,13 @@ public:
      @return count of halo particles
    */
   std::size_t halo_count() const {
-    return halo_count_left_ + halo_count_right_;
+    std::size_t count = 0;
+    for(int n=0; n<neighbor_count_; ++n)
+      count += halo_counts_[n];
+    return count;
   }
 
-  /*! Get the span defining halo particles: left/right edge particles from neighboring domains
+  /*! Get the span defining halo particles: edge particles from neighboring domains
      @return span of halo indices
    */
   IndexSpan halo_span() const {
@@ -303,6 +627,105 @@ public:
     return this->local_span().end - this->local_span().begin;
   }
 
+  /*! Get the halo depth
+     @return Number of edge widths from a domain face within which particles are sent to the neighbor
+   */
+  int halo_layers() const {
+    return halo_layers_;
+  }
+
+  /*! Get the halo width
+     @return Distance from a domain face within which particles are sent to the neighbor
+   */
+  Real halo_width() const {
+    return halo_layers_ * edge_width_;
+  }
+
+  /*! Check if solver substeps are computed redundantly on a deep halo
+     @return True if the halo is deep and halo values are not synced between substeps
+   */
+  bool deep_halo() const {
+    return halo_layers_ > 1;
+  }
+
+  /*! Get the span solver substeps process
+     @return local span when the halo is deep, otherwise the resident span
+   */
+  IndexSpan solve_span() const {
+    return this->deep_halo() ? this->local_span() : this->resident_span();
+  }
+
+  /*! Set the halo depth used by the next halo exchange
+   * @param layers Halo depth in edge widths, limited by the narrowest domain
+   */
+  void set_halo_layers(int layers) {
+    halo_layers_ = std::max(1, std::min(layers, this->max_halo_layers()));
+  }
+
+  /*! Deepest halo the domains allow, the halo may not reach past a neighboring domain
+   * @return Number of edge widths that fit in the narrowest domain along a split axis
+   */
+  int max_halo_layers() const {
+    Real min_width = std::numeric_limits<Real>::max();
+    for(int d=0; d<Dim; ++d) {
+      if(dims_[d] == 1)
+        continue;
+      for(int i=0; i<dims_[d]; ++i)
+        min_width = std::min(min_width, splits_[d][i+1] - splits_[d][i]);
+    }
+    if(edge_width_ <= 0.0 || min_width == std::numeric_limits<Real>::max())
+      return 1;
+    return std::max(1, static_cast<int>(std::floor(min_width / edge_width_)));
+  }
+
+  /*! Halo depth at which solver substeps are exact without syncing halo values
+   * Each substep's density, lambda, and delta position stages reach one smoothing radius further into
+   * the domain from the truncated outer halo, and the final velocities one more
+   * @param parameters Parameters providing the substep count and smoothing radius
+   * @return Halo depth in edge widths
+   */
+  int required_halo_layers(const Parameters<Real,Dim>& parameters) const {
+    const Real radius = parameters.smoothing_radius()*parameters.resolution_scale(parameters.max_resolution_level());
+    const Real depth = (2*parameters.solve_step_count() + 1) * radius;
+    return static_cast<int>(std::ceil(depth / edge_width_));
+  }
+
+  /*! Choose between a deep halo and syncing halo values every substep
+   * Relative to a single layer halo, a deep halo costs redundant substep compute on its particles and a larger
+   * exchange, syncing costs two halo value syncs per substep. Costs are summed over the compute ranks so
+   * every rank makes the same choice.
+   * @param parameters Parameters providing the configured halo depth and substep count
+   */
+  void choose_halo_layers(const Parameters<Real,Dim>& parameters) {
+    if(parameters.halo_layers() > 0) {
+      this->set_halo_layers(parameters.halo_layers());
+      return;
+    }
+
+    const int required = this->required_halo_layers(parameters);
+    if(comm_compute_.size() == 1 || required > this->max_halo_layers()) {
+      this->set_halo_layers(1);
+      return;
+    }
+
+    // The halo and its exchange grow about linearly with depth, the cost of a particle covers all of its substeps
+    // and, with a deep halo, the last step also solved the halo particles
+    const double solved_count = this->resident_count() + (this->deep_halo() ? halo_layer_count_ * halo_layers_ : 0.0);
+    const double particle_cost = compute_cost_ / std::max(solved_count, 1.0);
+    const double layer_exchange_cost = exchange_cost_ / halo_layers_;
+    double costs[3];
+    costs[0] = particle_cost * halo_layer_count_ * required + layer_exchange_cost * (required - 1);
+    costs[1] = 2.0 * parameters.solve_step_count() * (sync_cost_ > 0.0 ? sync_cost_ : layer_exchange_cost);
+    costs[2] = (compute_cost_ > 0.0 && exchange_cost_ > 0.0) ? 0.0 : 1.0;
+    double global_costs[3];
+    MPI_Allreduce(costs, global_costs, 3, MPI_DOUBLE, MPI_SUM, comm_compute_.MPI_comm());
+
+    // Keep the current depth until every rank has been timed
+    if(global_costs[2] > 0.0)
+      return;
+    this->set_halo_layers(global_costs[0] < global_costs[1] ? required : 1);
+  }
+
   /*! Get the number of global resident particles
      @return number of global resident particles
    */
@@ -328,24 +751,16 @@ public:
     Real spacing = particle_rest_spacing;
     AABB<Real,Dim> local_fluid = global_fluid;
 
-    // If local_fluid not in domain then return
-    bool contains_fluid_start = (global_fluid.min.x >= domain_.begin) &&
-                                (global_fluid.min.x <= domain_.end);
-    bool contains_fluid_end   = (global_fluid.max.x >= domain_.begin) &&
-                                (global_fluid.max.x <= domain_.end);
-    bool filled_with_fluid    = (global_fluid.min.x <= domain_.begin) &&
-                                (global_fluid.max.x >= domain_.begin);
-    if(!contains_fluid_start && !contains_fluid_end && !filled_with_fluid)
-      return;
-
-    // Ensure that particle spacing is consistent at boundaries
-    int x_count_previous = std::max((Real)0.0, std::floor((domain_.begin - global_fluid.min.x)/(Real)spacing));
-    local_fluid.min.x = global_fluid.min.x + x_count_previous * spacing;
+    for(int d=0; d<Dim; ++d) {
+      // If local_fluid not in domain then return
+      if(global_fluid.max[d] < domain_.min[d] || global_fluid.min[d] > domain_.max[d])
+        return;
 
-    if(contains_fluid_end)
-      local_fluid.max.x = global_fluid.max.x;
-    else
-      local_fluid.max.x = domain_.end;
+      // Ensure that particle spacing is consistent at boundaries
+      int count_previous = std::max((Real)0.0, std::floor((domain_.min[d] - global_fluid.min[d])/(Real)spacing));
+      local_fluid.min[d] = global_fluid.min[d] + count_previous * spacing;
+      local_fluid.max[d] = std::min(global_fluid.max[d], domain_.max[d]);
+    }
 
     // Fill AABB with particles
     auto particles_added = particles.construct_fluid(local_fluid, velocity);
@@ -356,6 +771,12 @@ public:
    */
   void process_parameters(const Parameters<Real,Dim>& parameters,
                           Particles<Real,Dim> & particles) {
+    cost_smoothing_ = parameters.load_cost_smoothing();
+    halo_exchange_ = parameters.halo_exchange();
+    halo_precision_ = parameters.halo_position_precision();
+    halo_velocity_precision_ = parameters.halo_velocity_precision();
+    this->choose_halo_layers(parameters);
+
     if(parameters.emitter_active()) {
       AABB<Real, three_dimensional> add_volume;
       Vec<Real, three_dimensional> emitter_volume_extents{(Real)1.1 * parameters.particle_rest_spacing(),
@@ -373,78 +794,114 @@ public:
     this->remove_halo_particles(particles);
   }
 
+  /*! Merge and split resident particles based upon their distance to the free surface
+   *  note: invalidate_halo must be called before adapt_resolution
+   */
+  void adapt_resolution(Particles<Real,Dim> & particles) {
+    resident_count_ = particles.adapt_resolution(this->resident_span());
+  }
+
   /*! Transfer out of bounds particles and update halo
    *  note: invalidate_halo must be called before domain_sync
    */
   void domain_sync(Particles<Real,Dim> & particles) {
+    this->initiate_domain_sync(particles);
+    this->finalize_domain_sync(particles);
+  }
 
+  /*! Transfer out of bounds particles and start updating the halo
+   * Once this returns the resident particles are final and interior_span() is valid,
+   * interior particles may be processed until finalize_domain_sync is called
+   *  note: invalidate_halo must be called before initiate_domain_sync
+   */
+  void initiate_domain_sync(Particles<Real,Dim> & particles) {
     this->initiate_oob_exchange(particles);
     this->finalize_oob_exchange(particles);
 
     this->initiate_halo_exchange(particles);
-    this->finalize_halo_exchange(particles);
   }
 
-  /*! Initiate syncronize of halo scalar values
-   * @param halo_values scalar array of values to be synced between left/right domains
+  /*! Finish updating the halo, the halo particles are appended after the resident particles
    */
-  void initiate_sync_halo_scalar(sim::Array<Real>& halo_values) {
-    const int max_recv_left = halo_count_left_;
-    const int max_recv_right = halo_count_right_;
-
-    const std::size_t receive_left_index = resident_count();
-    const std::size_t receive_right_index = receive_left_index + halo_count_left_;
-
-    const std::size_t send_left_index = interior_count();
-    const std::size_t send_right_index = send_left_index + edge_left_count_;
+  void finalize_domain_sync(Particles<Real,Dim> & particles) {
+    const double sync_start = MPI_Wtime();
+    this->finalize_halo_exchange(particles);
+    sync_time_ += MPI_Wtime() - sync_start;
 
-    requests_[0] = comm_compute_.i_recv(this->domain_to_left(), 0,
-                                       &halo_values[receive_left_index], max_recv_left, sim::mpi::get_mpi_type<Real>());
-    requests_[1] = comm_compute_.i_recv(this->domain_to_right(), 1,
-                                       &halo_values[receive_right_index], max_recv_right, sim::mpi::get_mpi_type<Real>());
+    // The halo is invalidated before the depth is next chosen
+    halo_layer_count_ = static_cast<double>(this->halo_count()) / halo_layers_;
+  }
 
-    requests_[2] = comm_compute_.i_send(this->domain_to_left(), 1,
-                                       &halo_values[send_left_index], edge_left_count_, sim::mpi::get_mpi_type<Real>());
-    requests_[3]  = comm_compute_.i_send(this->domain_to_right(), 0,
-                                        &halo_values[send_right_index], edge_right_count_, sim::mpi::get_mpi_type<Real>());
+  /*! Initiate syncronize of halo scalar values
+   * @param particles Particles whose edge particles were sent by the last halo exchange
+   * @param halo_values scalar array of values to be synced between neighboring domains
+   */
+  void initiate_sync_halo_scalar(Particles<Real,Dim> & particles, sim::Array<Real>& halo_values) {
+    this->initiate_sync_halo(particles, halo_values, sim::mpi::get_mpi_type<Real>());
   }
 
   /*! Finalize halo scarlar sync
    */
   void finalize_sync_halo_scalar() {
-    MPI_Status statuses[4];
-    sim::mpi::wait_all(requests_, 4, statuses);
+    this->finalize_sync_halo();
   }
 
   /*! Initiate syncronize of halo vec values
-   * @param halo_values vec array of values to be synced between left/right domains
+   * @param particles Particles whose edge particles were sent by the last halo exchange
+   * @param halo_values vec array of values to be synced between neighboring domains
    */
-  void initiate_sync_halo_vec(sim::Array<Vec<Real,Dim>> & halo_values) {
-    const int max_recv_left = halo_count_left_;
-    const int max_recv_right = halo_count_right_;
-
-    const std::size_t receive_left_index = resident_count();
-    const std::size_t receive_right_index = receive_left_index + halo_count_left_;
+  void initiate_sync_halo_vec(Particles<Real,Dim> & particles, sim::Array<Vec<Real,Dim>> & halo_values) {
+    this->initiate_sync_halo(particles, halo_values, MPI_VEC_);
+  }
 
-    const std::size_t send_left_index = interior_count();
-    const std::size_t send_right_index = send_left_index + edge_left_count_;
+  /*! Finalize halo vec sync
+   */
+  void finalize_sync_halo_vec() {
+    this->finalize_sync_halo();
+  }
 
-    requests_[0] = comm_compute_.i_recv(this->domain_to_left(), 0,
-                                       &halo_values[receive_left_index], max_recv_left, MPI_VEC_);
-    requests_[1] = comm_compute_.i_recv(this->domain_to_right(), 1,
-                                       &halo_values[receive_right_index], max_recv_right, MPI_VEC_);
+  /*! Initiate a sync of values between neighboring domains which aren't particle attributes, such as grid cells
+   * The values exchanged with each neighbor are contiguous and in neighbor order in both buffers. The persistent
+   * requests are only rebuilt when the buffers or counts change
+   * @param send_values Values sent to the neighbors
+   * @param send_counts Number of values sent to each neighbor
+   * @param receive_values Buffer receiving the neighbors values
+   * @param receive_counts Number of values received from each neighbor
+   */
+  void initiate_sync_neighbor_values(Real* send_values, const std::size_t* send_counts,
+                                     Real* receive_values, const std::size_t* receive_counts) {
+    sync_start_ = MPI_Wtime();
+    HaloSync& sync = this->halo_sync(receive_values, reinterpret_cast<char*>(send_values), send_counts,
+                                     reinterpret_cast<char*>(receive_values), receive_counts,
+                                     sim::mpi::get_mpi_type<Real>(), sizeof(Real));
+    active_sync_ = &sync;
+    sim::mpi::start_all(sync.requests, 2*neighbor_count_);
+  }
 
-    requests_[2] = comm_compute_.i_send(this->domain_to_left(), 1,
-                                       &halo_values[send_left_index], edge_left_count_, MPI_VEC_);
-    requests_[3]  = comm_compute_.i_send(this->domain_to_right(), 0,
-                                        &halo_values[send_right_index], edge_right_count_, MPI_VEC_);
+  /*! Finalize the neighbor value sync
+   * The wait is excluded from the compute cost but, unlike halo value syncs, not counted as a sync cost
+   */
+  void finalize_sync_neighbor_values() {
+    sim::mpi::wait_all(active_sync_->requests, 2*neighbor_count_, MPI_STATUSES_IGNORE);
+    active_sync_ = nullptr;
+    sync_time_ += MPI_Wtime() - sync_start_;
   }
 
-  /*! Finalize halo vec sync
+  static constexpr int stencil_size = (Dim == three_dimensional ? 27 : 9); /**< Domains in a 3^Dim block */
+  static constexpr int stencil_center = stencil_size / 2;                  /**< Stencil index of this domain */
+
+  /*! Grid offset of a stencil index
+   * @param k Stencil index, x fastest
+   * @return Offset of -1, 0, or 1 along each axis
    */
-  void finalize_sync_halo_vec() {
-    MPI_Status statuses[4];
-    sim::mpi::wait_all(requests_, 4, statuses);
+  DEVICE_CALLABLE
+  static Vec<int,Dim> stencil_offset(int k) {
+    Vec<int,Dim> offset;
+    for(int d=0; d<Dim; ++d) {
+      offset[d] = k % 3 - 1;
+      k /= 3;
+    }
+    return offset;
   }
 
 public:
@@ -452,33 +909,274 @@ public:
 // currently DEVICE_CALLABLE lambdas don't allow private access
 // private:
 
+  /*! Persistent requests syncing the halo of one array
+   * The requests are bound to the array, the staging buffer and the halo layout they were built for
+   */
+  struct HaloSync {
+    const void* values = nullptr;                             /**< Array the requests sync */
+    MPI_Datatype data_type = MPI_DATATYPE_NULL;               /**< MPI type of the array elements */
+    const char* send_values = nullptr;                        /**< Buffer the requests send from */
+    const char* receive_values = nullptr;                     /**< Buffer the requests receive into */
+    std::size_t send_counts[MAX_NEIGHBOR_DOMAINS] = {};       /**< Send counts the requests were built for */
+    std::size_t receive_counts[MAX_NEIGHBOR_DOMAINS] = {};    /**< Receive counts the requests were built for */
+    MPI_Request requests[2*MAX_NEIGHBOR_DOMAINS];             /**< Receives from then sends to each neighbor */
+  };
+
   const sim::mpi::Environment environment_;    /**< MPI environment */
   const sim::mpi::Communicator comm_world_;    /**< World communicator */
   const sim::mpi::Communicator comm_compute_;  /**< Compute subset of simulation */
-  Vec<Real,2>  domain_;                        /**< X coordinate of domain domain range */
+  Vec<int,Dim> dims_;                          /**< Number of domains along each axis */
+  Vec<int,Dim> coords_;                        /**< Grid coordinates of this ranks domain */
+  std::vector<Real> splits_[Dim];              /**< Domain planes along each axis, dims_ + 1 per axis */
+  AABB<Real,Dim> domain_;                      /**< Bounds of this ranks domain */
   Real edge_width_;                            /**< Width from domain bounds which is needed by neighboring domains */
+  double compute_start_;                       /**< MPI_Wtime at the start of the timed compute phase */
+  double compute_cost_;                        /**< Smoothed compute time per step, 0 until measured */
+  double cost_smoothing_;                      /**< Weight of the newest sample in compute_cost_ */
+  int halo_layers_;                            /**< Halo depth in edge widths */
+  double exchange_time_;                       /**< Time spent in the current halo exchange */
+  double exchange_cost_;                       /**< Smoothed time of a halo exchange, 0 until measured */
+  double sync_start_;                          /**< MPI_Wtime at the start of the current halo sync */
+  double sync_time_;                           /**< Time spent syncing the halo since the compute phase began */
+  double sync_cost_;                           /**< Smoothed time of a halo value sync, 0 until measured */
+  double halo_layer_count_;                    /**< Halo particles per layer of the last halo exchange, 0 until exchanged */
+
+  static constexpr int neighbor_count_ = stencil_size - 1;    /**< Number of neighbor slots */
+  int neighbor_ranks_[MAX_NEIGHBOR_DOMAINS];                  /**< Neighbor ranks, MPI_PROC_NULL past the boundary */
+  Vec<int,Dim> neighbor_offsets_[MAX_NEIGHBOR_DOMAINS];       /**< Grid offset of each neighbor */
 
   std::size_t resident_count_;                 /**< Count of interor + edge particles(non halo particles) */
-  std::size_t edge_left_count_;                /**< Count of particles within edge_width_ of left domain boundary */
-  std::size_t edge_right_count_;               /**< Count of particles within edge_width_ of right domain boundary */
-  std::size_t halo_count_left_;                /**< Count of left domains right edge particles residing on current domain */
-  std::size_t halo_count_right_;               /**< Count of right domains left edge particles residing on current domain */
-  std::size_t receive_left_index_;             /**< Index in which to receieve OOB particles from left domain */
-  std::size_t receive_right_index_;            /**< Index in which to receieve OOB particles from right domain */
-  std::size_t oob_left_count_;                 /**< Count of particles which have left current domain to the left */
-  std::size_t oob_right_count_;                /**< Count of particles which have left current domain to the right */
-
-  MPI_Request requests_[12];                   /**< Array of requests to keep track of async MPI calls */
+  std::size_t edge_count_;                     /**< Count of particles within halo_width() of a split domain face */
+  std::size_t oob_count_;                      /**< Count of particles which have left the current domain */
+  std::size_t halo_counts_[MAX_NEIGHBOR_DOMAINS];      /**< Count of halo particles from each neighbor */
+  std::size_t send_counts_[MAX_NEIGHBOR_DOMAINS];      /**< Count of particles sent to each neighbor */
+  std::size_t receive_offsets_[MAX_NEIGHBOR_DOMAINS];  /**< Staging byte offset receiving from each neighbor */
+  std::size_t receive_begin_;                  /**< Staging byte offset of the receive space */
+  std::size_t max_receive_count_;              /**< Number of particles which fit in the receive space */
+  std::unique_ptr<sim::Array<std::uint32_t>> edge_masks_; /**< Bit n set if edge particle is sent to neighbor n */
+  std::unique_ptr<sim::Array<std::size_t>> class_offsets_; /**< Offsets of migration partitions */
+  std::unique_ptr<sim::Array<std::size_t>> histogram_counts_; /**< Per chunk histograms of repartitioning */
+  std::unique_ptr<sim::Array<Real>> planes_;              /**< Device copy of splits_, axis after axis */
+
+  MPI_Request requests_[2*MAX_NEIGHBOR_DOMAINS]; /**< Array of requests to keep track of async MPI calls */
+  HaloSync halo_syncs_[MAX_HALO_SYNCS];          /**< Persistent requests of recently synced arrays */
+  std::size_t halo_sync_count_;                  /**< Number of halo syncs built, selects the next one replaced */
+  HaloSync* active_sync_;                        /**< Halo sync in progress */
+
+  MPI_Comm comm_node_;                           /**< Compute ranks sharing this ranks node */
+  MPI_Win node_window_;                          /**< Shared memory window of the compute ranks on this node */
+  char* window_;                                 /**< This ranks part of the node window, holds its packed edge particles */
+  int node_ranks_[MAX_NEIGHBOR_DOMAINS];         /**< Rank of each neighbor in comm_node_, MPI_UNDEFINED if off node */
+  const char* neighbor_windows_[MAX_NEIGHBOR_DOMAINS]; /**< Window part of each neighbor on this node, nullptr otherwise */
+  std::uint64_t window_notices_[MAX_NEIGHBOR_DOMAINS][2]; /**< Window offset and count of edge particles for each neighbor */
+
+  typename Parameters<Real,Dim>::HaloExchange halo_exchange_; /**< How the next halo exchange is done */
+  MPI_Group neighbor_group_;                     /**< Distinct neighbor ranks of comm_compute_ */
+  MPI_Win halo_window_;                          /**< Receive window of one sided halo exchanges */
+  std::unique_ptr<sim::Array<std::uint64_t>> halo_window_buffer_; /**< Header followed by received halo particles */
+  Real halo_precision_;                          /**< Position precision of encoded halo particles, 0 if not encoded */
+  Real halo_velocity_precision_;                 /**< Velocity precision of encoded halo particles, 0 if exact */
 
   MPI_Datatype MPI_VEC_;                       /**< Vec<Real,Dim> MPI type */
   MPI_Datatype MPI_PARAMETERS_;                /**< MPI_Parameters<Real,Dim> MPI type */
+  MPI_Datatype MPI_MIGRATE_PARTICLE_;          /**< Packed ATTRIBUTE_MIGRATE particle MPI type */
+  MPI_Datatype MPI_HALO_PARTICLE_;             /**< Packed ATTRIBUTE_HALO particle MPI type */
+  MPI_Datatype MPI_LOAD_;                      /**< {maximum, sum} load pair MPI type */
+  MPI_Op MPI_MAX_SUM_;                         /**< Reduction of load pairs */
+
+  /*! Rank at domain grid coordinates
+   * @param coords Domain grid coordinates
+   * @return Rank of the domain or MPI_PROC_NULL if outside of the grid
+   */
+  int rank_at(const Vec<int,Dim>& coords) const {
+    int rank = 0;
+    for(int d=Dim-1; d>=0; --d) {
+      if(coords[d] < 0 || coords[d] >= dims_[d])
+        return MPI_PROC_NULL;
+      rank = rank * dims_[d] + coords[d];
+    }
+    return rank;
+  }
+
+  /*! Find which neighbors are on this node and map their part of the node window
+   */
+  void find_node_neighbors() {
+    MPI_Group compute_group = MPI_GROUP_NULL;
+    MPI_Group node_group = MPI_GROUP_NULL;
+    if(comm_node_ != MPI_COMM_NULL) {
+      MPI_Comm_group(comm_compute_.MPI_comm(), &compute_group);
+      MPI_Comm_group(comm_node_, &node_group);
+    }
+
+    for(int n=0; n<neighbor_count_; ++n) {
+      node_ranks_[n] = MPI_UNDEFINED;
+      if(comm_node_ != MPI_COMM_NULL && neighbor_ranks_[n] != MPI_PROC_NULL)
+        MPI_Group_translate_ranks(compute_group, 1, &neighbor_ranks_[n], node_group, &node_ranks_[n]);
+    }
+
+    if(comm_node_ != MPI_COMM_NULL) {
+      MPI_Group_free(&compute_group);
+      MPI_Group_free(&node_group);
+    }
+    this->map_neighbor_windows();
+  }
+
+  /*! Query the base of each on node neighbors part of the node window
+   * The node window is created by the first exchange, until then no neighbor is read from shared memory
+   */
+  void map_neighbor_windows() {
+    for(int n=0; n<neighbor_count_; ++n) {
+      neighbor_windows_[n] = nullptr;
+      if(node_window_ == MPI_WIN_NULL || node_ranks_[n] == MPI_UNDEFINED)
+        continue;
+
+      MPI_Aint size = 0;
+      int displacement_unit = 0;
+      void* base = nullptr;
+      MPI_Win_shared_query(node_window_, node_ranks_[n], &size, &displacement_unit, &base);
+      neighbor_windows_[n] = static_cast<const char*>(base);
+    }
+  }
+
+  /*! Free the neighbor group if one has been created
+   */
+  void free_neighbor_group() {
+    if(neighbor_group_ != MPI_GROUP_NULL && neighbor_group_ != MPI_GROUP_EMPTY)
+      MPI_Group_free(&neighbor_group_);
+    neighbor_group_ = MPI_GROUP_NULL;
+  }
+
+  /*! Set domain_ from the domain planes
+   */
+  void update_domain() {
+    for(int d=0; d<Dim; ++d) {
+      domain_.min[d] = splits_[d][coords_[d]];
+      domain_.max[d] = splits_[d][coords_[d] + 1];
+    }
+  }
+
+  /*! Count particles in DOMAIN_HISTOGRAM_BINS bins without reordering them
+   * Each chunk of DOMAIN_HISTOGRAM_CHUNK_SIZE particles fills its own histogram, which are then summed per bin
+   * @param span Particles to count
+   * @param binner Function taking a particle index and returning its bin in [0, DOMAIN_HISTOGRAM_BINS)
+   * @return Pointer to the count of each bin
+   */
+  template<typename Binner>
+  const std::size_t* histogram(IndexSpan span, Binner binner) {
+    const std::size_t count = span.end - span.begin;
+    const std::size_t chunks = std::max((count + DOMAIN_HISTOGRAM_CHUNK_SIZE - 1) / DOMAIN_HISTOGRAM_CHUNK_SIZE,
+                                        static_cast<std::size_t>(1));
+    if(!histogram_counts_ || histogram_counts_->capacity() < chunks * DOMAIN_HISTOGRAM_BINS)
+      histogram_counts_.reset(new sim::Array<std::size_t>(chunks * DOMAIN_HISTOGRAM_BINS));
+    std::size_t* counts = histogram_counts_->data();
+    const std::size_t begin = span.begin;
+
+    sim::algorithms::for_each_index(IndexSpan{0, chunks}, [=] DEVICE_CALLABLE (std::size_t k) {
+      std::size_t* chunk_counts = counts + k * DOMAIN_HISTOGRAM_BINS;
+      for(std::size_t b=0; b<DOMAIN_HISTOGRAM_BINS; ++b)
+        chunk_counts[b] = 0;
+      const std::size_t end = ((k + 1) * DOMAIN_HISTOGRAM_CHUNK_SIZE < count ? (k + 1) * DOMAIN_HISTOGRAM_CHUNK_SIZE
+                                                                              : count);
+      for(std::size_t i = k * DOMAIN_HISTOGRAM_CHUNK_SIZE; i < end; ++i)
+        ++chunk_counts[binner(begin + i)];
+    });
+
+    // The first chunk's histogram accumulates the others
+    sim::algorithms::for_each_index(IndexSpan{0, DOMAIN_HISTOGRAM_BINS}, [=] DEVICE_CALLABLE (std::size_t b) {
+      for(std::size_t k=1; k<chunks; ++k)
+        counts[b] += counts[k * DOMAIN_HISTOGRAM_BINS + b];
+    });
+
+    return counts;
+  }
+
+  /*! Device accessible class offsets for partitioning into many classes
+   * @param class_count Number of classes the offsets must hold
+   * @return Pointer to at least class_count + 1 offsets
+   */
+  std::size_t* class_offsets(std::size_t class_count) {
+    if(!class_offsets_ || class_offsets_->capacity() < class_count + 1)
+      class_offsets_.reset(new sim::Array<std::size_t>(class_count + 1));
+    return class_offsets_->data();
+  }
+
+  /*! Send each resident particle to the rank owning the domain it's in
+   * Unlike the OOB exchange particles may move any number of domains
+   * @param particles Particles to migrate
+   */
+  void migrate_particles(Particles<Real,Dim> & particles) {
+    this->create_particle_types(particles);
+
+    // Copy the domain planes to device accessible memory
+    std::size_t plane_count = 0;
+    for(int d=0; d<Dim; ++d)
+      plane_count += splits_[d].size();
+    if(!planes_ || planes_->capacity() < plane_count)
+      planes_.reset(new sim::Array<Real>(plane_count));
+    Real* planes = planes_->data();
+    for(int d=0, i=0; d<Dim; ++d) {
+      std::copy(splits_[d].begin(), splits_[d].end(), planes + i);
+      i += splits_[d].size();
+    }
+
+    const Vec<Real,Dim>* position_stars = particles.position_stars().data();
+    const auto dims = dims_;
+    const int rank = comm_compute_.rank();
+    const int size = comm_compute_.size();
+
+    // Arrange particles as {staying, to rank 0, ..., to rank size-1}
+    auto& attributes = particles.attributes();
+    std::size_t* offsets = this->class_offsets(size + 1);
+    attributes.partition_by_class(this->resident_span(), size + 1, [=] DEVICE_CALLABLE (std::size_t p) {
+      int owner = 0;
+      int stride = 1;
+      const Real* axis_planes = planes;
+      for(int d=0; d<Dim; ++d) {
+        int slab = 0;
+        while(slab < dims[d]-1 && position_stars[p][d] >= axis_planes[slab+1])
+          ++slab;
+        owner += slab * stride;
+        stride *= dims[d];
+        axis_planes += dims[d] + 1;
+      }
+      return static_cast<std::size_t>(owner == rank ? 0 : owner + 1);
+    }, offsets);
+    attributes.permute(this->resident_span());
+
+    const std::size_t stay_count = offsets[1];
+    std::vector<int> send_counts(size), send_displs(size), receive_counts(size), receive_displs(size);
+    for(int r=0; r<size; ++r) {
+      send_counts[r] = static_cast<int>(offsets[r+2] - offsets[r+1]);
+      send_displs[r] = static_cast<int>(offsets[r+1]);
+    }
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT, receive_counts.data(), 1, MPI_INT, comm_compute_.MPI_comm());
+
+    std::size_t receive_count = 0;
+    for(int r=0; r<size; ++r) {
+      receive_displs[r] = static_cast<int>(particles.local_count() + receive_count);
+      receive_count += receive_counts[r];
+    }
+    if(receive_count > particles.available())
+      throw std::runtime_error("Migrated particles exceed the local particle capacity");
+
+    // The staging buffer mirrors the particle arrays, sends at their own index and receives after the resident particles
+    char* staging = attributes.staging();
+    const std::size_t stride = attributes.stride(ATTRIBUTE_MIGRATE);
+    attributes.pack(ATTRIBUTE_MIGRATE, IndexSpan{stay_count, resident_count_}, staging + stay_count*stride);
+    MPI_Alltoallv(staging, send_counts.data(), send_displs.data(), MPI_MIGRATE_PARTICLE_,
+                  staging, receive_counts.data(), receive_displs.data(), MPI_MIGRATE_PARTICLE_,
+                  comm_compute_.MPI_comm());
+
+    this->remove_resident_particles(particles, resident_count_ - stay_count);
+    this->add_resident_particles(particles, staging + receive_displs[0]*stride, receive_count);
+  }
 
   /*! Invalidates halo particles
   **/
   void remove_halo_particles(Particles<Real,Dim> & particles) {
     particles.remove(this->halo_count());
-    halo_count_left_ = 0;
-    halo_count_right_ = 0;
+    for(int n=0; n<neighbor_count_; ++n)
+      halo_counts_[n] = 0;
   }
 
   /*! Remove resident particles
@@ -493,151 +1191,227 @@ public:
 
   /*! Add resident particles
    * @param particles Particles in which to add to
-   * @param new_positions Pointer to new positions
-   * @param new_position_stars Pointer to new position_stars
-   * @param new_velocities Pointer to new velocities
+   * @param packed Particles packed with ATTRIBUTE_MIGRATE
    * @param count Number of new particles to add
    */
   void add_resident_particles(Particles<Real,Dim> & particles,
-                              const Vec<Real,Dim>* new_positions,
-                              const Vec<Real,Dim>* new_position_stars,
-                              const Vec<Real,Dim>* new_velocities,
+                              const char* packed,
                               std::size_t count) {
-    particles.add(new_positions, new_position_stars, new_velocities, count);
+    particles.attributes().unpack(ATTRIBUTE_MIGRATE, packed, count);
     resident_count_ += count;
   }
 
-  /*! Add halo particles from domain to the left
+  /*! Add halo particles from a neighboring domain
    * @param particles Particles in which to add halos to
-   * @param new_positions Pointer to new halo positions
-   * @param new_position_stars Pointer to new halo position_stars
-   * @param new_velocities Pointer to new halo velocities
+   * @param neighbor Index of the neighbor the particles were received from
+   * @param packed Halo particles packed with ATTRIBUTE_HALO
    * @param count Number of new halo particles to add
    */
-  void add_halo_particles_left(Particles<Real,Dim> & particles,
-                          const Vec<Real,Dim>* new_positions,
-                          const Vec<Real,Dim>* new_position_stars,
-                          const Vec<Real,Dim>* new_velocities,
+  void add_halo_particles(Particles<Real,Dim> & particles,
+                          int neighbor,
+                          const char* packed,
                           std::size_t count) {
-    particles.add(new_positions, new_position_stars, new_velocities, count);
-    halo_count_left_ += count;
+    particles.attributes().unpack(ATTRIBUTE_HALO, packed, count);
+    halo_counts_[neighbor] += count;
   }
 
-  /*! Add halo particles from domain to the right
+  /*! Add encoded halo particles from a neighboring domain
    * @param particles Particles in which to add halos to
-   * @param new_positions Pointer to new halo positions
-   * @param new_position_stars Pointer to new halo position_stars
-   * @param new_velocities Pointer to new halo velocities
-   * @param count Number of new halo particles to add
+   * @param neighbor Index of the neighbor the particles were received from
+   * @param encoded Halo particles encoded by the neighbors halo_codec
    */
-  void add_halo_particles_right(Particles<Real,Dim> & particles,
-                          const Vec<Real,Dim>* new_positions,
-                          const Vec<Real,Dim>* new_position_stars,
-                          const Vec<Real,Dim>* new_velocities,
-                          std::size_t count) {
-    particles.add(new_positions, new_position_stars, new_velocities, count);
-    halo_count_right_ += count;
+  void add_encoded_halo_particles(Particles<Real,Dim> & particles,
+                                  int neighbor,
+                                  const char* encoded) {
+    halo_counts_[neighbor] += this->halo_codec(coords_ + neighbor_offsets_[neighbor]).decode(particles, encoded);
   }
 
-  /*! Initiate syncronize of particles that have gone out of the domain bounds(OOB)
+  /*! Whether halo particles exchanged with a neighbor are encoded
+   * Only traffic which leaves the node is encoded, neighbors on the node read the node window directly
+   * @param n Neighbor index
+   * @return True if the halo codec is enabled and the neighbor exists and isn't read from the node window
    */
-  void initiate_oob_exchange(Particles<Real,Dim> & particles) {
-    // Zip iterator of pointers to particle quantities to update
-    const auto begin = thrust::make_zip_iterator(thrust::make_tuple(particles.position_stars().data(),
-                                                                    particles.positions().data(),
-                                                                    particles.velocities().data()));
-    const auto end = begin + this->resident_count_;
-
-    // These must be unpacked as domain isn't available in lambda
-    const auto domain_begin = domain_.begin;
-    const auto domain_end = domain_.end;
-
-    // Move oob-left/right particles to end of arrays
-    auto oob_begin = sim::algorithms::partition(begin, end, [=] DEVICE_CALLABLE (const Tuple& tuple) {
-      const auto position_star = thrust::get<0>(tuple);
-      const auto x_star = position_star.x;
-      return (x_star >= domain_begin && x_star <= domain_end); // True if not OOB
-    });
-    // Move oob-right to end of array, arrays now {staying,oob-left,oob-right}
-    auto oob_right_begin = sim::algorithms::partition(oob_begin, end, [=] DEVICE_CALLABLE (const Tuple& tuple) {
-      const auto position_star = thrust::get<0>(tuple);
-      const auto x_star = position_star.x;
-      return (x_star <= domain_begin); // True if oob-left
-    });
+  bool encoded_neighbor(int n) const {
+    if(halo_precision_ <= 0 || neighbor_ranks_[n] == MPI_PROC_NULL)
+      return false;
+    return halo_exchange_ == Parameters<Real,Dim>::RMA || !neighbor_windows_[n];
+  }
 
-    oob_left_count_  = oob_right_begin - oob_begin;
-    oob_right_count_ = end - oob_right_begin;
+  /*! Halo codec of the domain at grid coordinates
+   * Positions are quantized relative to the domain extended by the halo width, which both sides can compute
+   * @param coords Domain grid coordinates of the sending domain
+   * @return Codec encoding the domains edge particles
+   */
+  HaloCodec<Real,Dim> halo_codec(const Vec<int,Dim>& coords) const {
+    AABB<Real,Dim> bounds;
+    for(int d=0; d<Dim; ++d) {
+      bounds.min[d] = splits_[d][coords[d]] - this->halo_width();
+      bounds.max[d] = splits_[d][coords[d] + 1] + this->halo_width();
+    }
+    return HaloCodec<Real,Dim>(halo_precision_, halo_velocity_precision_, bounds);
+  }
+
+  /*! Create the packed particle MPI types
+   * Packed particles are opaque bytes, the attribute strides are fixed once particles are constructed
+   * @param particles Particles whose registered attributes define the packed layout
+   */
+  void create_particle_types(Particles<Real,Dim> & particles) {
+    if(MPI_MIGRATE_PARTICLE_ != MPI_DATATYPE_NULL)
+      return;
+    const auto& attributes = particles.attributes();
+    MPI_Type_contiguous(static_cast<int>(attributes.stride(ATTRIBUTE_MIGRATE)), MPI_BYTE, &MPI_MIGRATE_PARTICLE_);
+    MPI_Type_commit(&MPI_MIGRATE_PARTICLE_);
+    MPI_Type_contiguous(static_cast<int>(attributes.stride(ATTRIBUTE_HALO)), MPI_BYTE, &MPI_HALO_PARTICLE_);
+    MPI_Type_commit(&MPI_HALO_PARTICLE_);
+
+    // Each rank on a shared node packs its edge particles into its own staging sized part of the node window
+    int node_size = 1;
+    if(comm_node_ != MPI_COMM_NULL)
+      MPI_Comm_size(comm_node_, &node_size);
+    if(node_size > 1) {
+      MPI_Info info;
+      MPI_Info_create(&info);
+      MPI_Info_set(info, "alloc_shared_noncontig", "true");
+      MPI_Win_allocate_shared(static_cast<MPI_Aint>(attributes.staging_bytes()), 1, info, comm_node_,
+                              &window_, &node_window_);
+      MPI_Info_free(&info);
+      MPI_Win_lock_all(MPI_MODE_NOCHECK, node_window_);
+      this->map_neighbor_windows();
+    }
+  }
+
+  /*! Tag of messages sent to a neighbor
+   * A message sent to neighbor n is received from the opposite neighbor, which has index neighbor_count_-1-n
+   * @param n Index of the neighbor the message is sent to
+   * @return Message tag
+   */
+  static int send_tag(int n) {
+    return n;
+  }
+
+  /*! Tag of messages received from a neighbor
+   * @param n Index of the neighbor the message is received from
+   * @return Message tag
+   */
+  static int receive_tag(int n) {
+    return neighbor_count_ - 1 - n;
+  }
 
-    const int max_recv_per_side = static_cast<int>(particles.available()/2);
+  /*! Reserve staging space for particles received by the next exchange
+   * @param offset Byte offset of the receive space in the staging buffer
+   * @param max_receive_count Number of particles which fit in the receive space
+   */
+  void reserve_receive_space(std::size_t offset, std::size_t max_receive_count) {
+    receive_begin_ = offset;
+    max_receive_count_ = max_receive_count;
+    for(int n=0; n<neighbor_count_; ++n)
+      requests_[n] = MPI_REQUEST_NULL;
+  }
 
-    receive_left_index_ = end - begin;
-    receive_right_index_ = receive_left_index_ + max_recv_per_side;
-    std::size_t send_left_index = oob_begin - begin;
-    std::size_t send_right_index = oob_right_begin - begin;
+  /*! Receive packed particles from every neighbor
+   * Each message is probed for its exact size and received directly after the previous one
+   * so the receive space isn't divided up front
+   * @param staging Staging buffer to receive into
+   * @param stride Bytes per packed particle
+   * @param particle_type Packed particle MPI type
+   * @param received_counts Set to the number of particles received from each neighbor
+   * @param skip_shared Skip neighbors whose particles are read from the node window
+   */
+  void receive_particles(char* staging,
+                         std::size_t stride,
+                         MPI_Datatype particle_type,
+                         int* received_counts,
+                         bool skip_shared = false) {
+    std::size_t offset = receive_begin_;
+    std::size_t receive_count = 0;
+    for(int n=0; n<neighbor_count_; ++n) {
+      received_counts[n] = 0;
+      if(skip_shared && neighbor_windows_[n])
+        continue;
+
+      int count = 0;
+      MPI_Message message = comm_compute_.m_probe(neighbor_ranks_[n], receive_tag(n), particle_type, count);
+      receive_count += count;
+      if(receive_count > max_receive_count_)
+        throw std::runtime_error("Received particles exceed the local particle capacity");
+
+      comm_compute_.m_recv(staging + offset, count, particle_type, message);
+      receive_offsets_[n] = offset;
+      received_counts[n] = count;
+      offset += count * stride;
+    }
+  }
 
-//    std::cout<<"rank "<<comm_compute_.rank()<<" receive indices: "<<receive_left_index_<<", "<<receive_right_index_<<" send indices: "<<send_left_index<<", "<<send_right_index<<std::endl;
+  /*! Wait for the neighbor receives and sends to complete
+   */
+  void wait_neighbor_requests() {
+    sim::mpi::wait_all(requests_, 2*neighbor_count_, MPI_STATUSES_IGNORE);
+  }
 
-    requests_[0] = comm_compute_.i_recv(this->domain_to_left(), 0,
-                                       &(particles.position_stars()[receive_left_index_]), max_recv_per_side, MPI_VEC_);
-    requests_[1] = comm_compute_.i_recv(this->domain_to_left(), 1,
-                                       &(particles.positions()[receive_left_index_]), max_recv_per_side, MPI_VEC_);
-    requests_[2] = comm_compute_.i_recv(this->domain_to_left(), 2,
-                                       &(particles.velocities()[receive_left_index_]), max_recv_per_side, MPI_VEC_);
+  /*! Initiate syncronize of particles that have gone out of the domain bounds(OOB)
+   */
+  void initiate_oob_exchange(Particles<Real,Dim> & particles) {
+    this->create_particle_types(particles);
+
+    const Vec<Real,Dim>* position_stars = particles.position_stars().data();
+
+    // These must be unpacked as members aren't available in lambda
+    const auto domain = domain_;
+    const auto dims = dims_;
+    const auto coords = coords_;
+
+    // Classify once and arrange arrays as {staying, oob to neighbor 0, ..., oob to neighbor n}
+    auto& attributes = particles.attributes();
+    const std::size_t* offsets = attributes.partition_by_class(this->resident_span(), neighbor_count_ + 1,
+                                                               [=] DEVICE_CALLABLE (std::size_t p) {
+      const auto x_star = position_stars[p];
+      int k = 0;
+      int stride = 1;
+      for(int d=0; d<Dim; ++d) {
+        int offset = (x_star[d] < domain.min[d] ? -1 : (x_star[d] > domain.max[d] ? 1 : 0));
+        // Particles past the global boundary stay
+        if(coords[d] + offset < 0 || coords[d] + offset >= dims[d])
+          offset = 0;
+        k += (offset + 1) * stride;
+        stride *= 3;
+      }
+      return static_cast<std::size_t>(k == stencil_center ? 0 : (k < stencil_center ? k + 1 : k));
+    });
+    attributes.permute(this->resident_span());
 
-    requests_[3] = comm_compute_.i_recv(this->domain_to_right(), 3,
-                                       &(particles.position_stars()[receive_right_index_]), max_recv_per_side, MPI_VEC_);
-    requests_[4] = comm_compute_.i_recv(this->domain_to_right(), 4,
-                                       &(particles.positions()[receive_right_index_]), max_recv_per_side, MPI_VEC_);
-    requests_[5] = comm_compute_.i_recv(this->domain_to_right(), 5,
-                                       &(particles.velocities()[receive_right_index_]), max_recv_per_side, MPI_VEC_);
+    const std::size_t stay_count = offsets[1];
+    oob_count_ = resident_count_ - stay_count;
+    for(int n=0; n<neighbor_count_; ++n)
+      send_counts_[n] = offsets[n+2] - offsets[n+1];
 
-    requests_[6] = comm_compute_.i_send(this->domain_to_left(), 3,
-                                       &(particles.position_stars()[send_left_index]), oob_left_count_, MPI_VEC_);
-    requests_[7] = comm_compute_.i_send(this->domain_to_left(), 4,
-                                       &(particles.positions()[send_left_index]), oob_left_count_, MPI_VEC_);
-    requests_[8] = comm_compute_.i_send(this->domain_to_left(), 5,
-                                       &(particles.velocities()[send_left_index]), oob_left_count_, MPI_VEC_);
+    // The staging buffer mirrors the particle arrays, sends at their own index and receives after the resident particles
+    char* staging = attributes.staging();
+    const std::size_t stride = attributes.stride(ATTRIBUTE_MIGRATE);
+    attributes.pack(ATTRIBUTE_MIGRATE, IndexSpan{stay_count, resident_count_}, staging + stay_count*stride);
 
-    requests_[9]  = comm_compute_.i_send(this->domain_to_right(), 0,
-                                        &(particles.position_stars()[send_right_index]), oob_right_count_, MPI_VEC_);
-    requests_[10] = comm_compute_.i_send(this->domain_to_right(), 1,
-                                        &(particles.positions()[send_right_index]), oob_right_count_, MPI_VEC_);
-    requests_[11] = comm_compute_.i_send(this->domain_to_right(), 2,
-                                        &(particles.velocities()[send_right_index]), oob_right_count_, MPI_VEC_);
+    this->reserve_receive_space(particles.local_count()*stride, particles.available());
 
-//   std::cout<<"rank : "<<comm_compute_.rank()<<" sending "<<oob_left_count_<<" to rank "<<this->domain_to_left()<<" and "<<oob_right_count_<<" to rank "<<this->domain_to_right()<<std::endl;
+    for(int n=0; n<neighbor_count_; ++n) {
+      requests_[neighbor_count_ + n] = comm_compute_.i_send(neighbor_ranks_[n], send_tag(n),
+                                                            staging + offsets[n+1]*stride,
+                                                            static_cast<int>(send_counts_[n]), MPI_MIGRATE_PARTICLE_);
+    }
   }
 
   /*! Finalize OOB sync
   */
   void finalize_oob_exchange(Particles<Real,Dim> & particles) {
-    MPI_Status statuses[12];
-    sim::mpi::wait_all(requests_, 12, statuses);
+    char* staging = particles.attributes().staging();
+    int received_counts[MAX_NEIGHBOR_DOMAINS];
+    this->receive_particles(staging, particles.attributes().stride(ATTRIBUTE_MIGRATE),
+                            MPI_MIGRATE_PARTICLE_, received_counts);
+    this->wait_neighbor_requests();
 
-    // copy received left/right to correct position in particle array
-    int received_left_count, received_right_count;
-    MPI_Get_count(&statuses[0], MPI_VEC_, &received_left_count);
-    MPI_Get_count(&statuses[3], MPI_VEC_, &received_right_count);
-    const int sent_count = oob_left_count_ + oob_right_count_;
+    this->remove_resident_particles(particles, oob_count_);
 
-//    std::cout<<"rank "<<comm_compute_.rank()<<" sent "<<oob_left_count_<<" to rank "<<this->domain_to_left()<<" and "<<oob_right_count_<<" to rank "<<this->domain_to_right()<<std::endl;
-//    std::cout<<"rank "<<comm_compute_.rank()<<" received "<<received_left_count<<" from "<<this->domain_to_left()<<" and "<<received_right_count<<" from "<<this->domain_to_right()<<std::endl;
-
-    this->remove_resident_particles(particles, sent_count);
-
-    this->add_resident_particles(particles,
-                                 &particles.positions()[receive_left_index_],
-                                 &particles.position_stars()[receive_left_index_],
-                                 &particles.velocities()[receive_left_index_],
-                                 received_left_count);
-
-    this->add_resident_particles(particles,
-                                 &particles.positions()[receive_right_index_],
-                                 &particles.position_stars()[receive_right_index_],
-                                 &particles.velocities()[receive_right_index_],
-                                 received_right_count);
-
-//    std::cout<<"rank "<<comm_compute_.rank()<<" resident count: "<<resident_count()<<" local count: "<<local_count()<<std::endl;
+    // Received particles are unpacked from the staging buffer, which appending doesn't touch
+    for(int n=0; n<neighbor_count_; ++n)
+      this->add_resident_particles(particles, staging + receive_offsets_[n], received_counts[n]);
   }
 
   /*! Initiate syncronize of halo particles
@@ -645,94 +1419,380 @@ public:
       Send edge particles and receive halo particles from neighbor
 
       Edge particles will need to be accessed multiple times
-      And so they are placed continously at the end of the array
+      And so they are placed continously at the end of the array.
+      Particles near an edge or corner of the domain are sent to several neighbors
    */
   void initiate_halo_exchange(Particles<Real,Dim> & particles) {
-    // Zip iterator of pointers to particle quantities to update
-    const auto begin = thrust::make_zip_iterator(thrust::make_tuple(particles.position_stars().data(),
-                                                                    particles.positions().data(),
-                                                                    particles.velocities().data() ));
-    const auto end = begin + this->resident_count_;
-
-    const auto edge_left = domain_.begin + edge_width_;
-    const auto edge_right = domain_.end - edge_width_;
-
-    // Move left/right edge particles to end of arrays
-    auto edge_begin = sim::algorithms::partition(begin, end, [=] DEVICE_CALLABLE  (const Tuple& tuple) {
-      const auto position_star = thrust::get<0>(tuple);
-      const auto x_star = position_star.x;
-      return (x_star >= edge_left && x_star <= edge_right ); // True if not edge
+    this->create_particle_types(particles);
+
+    const Vec<Real,Dim>* position_stars = particles.position_stars().data();
+
+    // Only faces along split axes have edges
+    const double exchange_start = MPI_Wtime();
+
+    Vec<Real,Dim> edge_min = domain_.min + this->halo_width();
+    Vec<Real,Dim> edge_max = domain_.max - this->halo_width();
+    for(int d=0; d<Dim; ++d) {
+      if(dims_[d] == 1) {
+        edge_min[d] = std::numeric_limits<Real>::lowest();
+        edge_max[d] = std::numeric_limits<Real>::max();
+      }
+    }
+
+    // Classify once and arrange arrays as {interior, edge}
+    auto& attributes = particles.attributes();
+    const auto counts = attributes.partition_three_way(this->resident_span(), [=] DEVICE_CALLABLE (std::size_t p) {
+      const auto x_star = position_stars[p];
+      bool edge = false;
+      for(int d=0; d<Dim; ++d)
+        edge = edge || x_star[d] < edge_min[d] || x_star[d] > edge_max[d];
+      return edge ? 1 : 0;
     });
-    // Move right edge to end of array, arrays now {interior, edge-left, edge-right}
-    auto edge_right_begin = sim::algorithms::partition(edge_begin, end, [=] DEVICE_CALLABLE  (const Tuple& tuple) {
-      const auto position_star = thrust::get<0>(tuple);
-      const auto x_star = position_star.x;
-      return (x_star <= edge_left); // True if edge-left
+    attributes.permute(this->resident_span());
+    edge_count_ = counts[1];
+
+    // Record which neighbors each edge particle is sent to
+    if(!edge_masks_ || edge_masks_->capacity() < particles.max_local_count())
+      edge_masks_.reset(new sim::Array<std::uint32_t>(particles.max_local_count()));
+    std::uint32_t* masks = edge_masks_->data();
+    const std::size_t edge_begin = this->edge_span().begin;
+    sim::algorithms::for_each_index(this->edge_span(), [=] DEVICE_CALLABLE (std::size_t p) {
+      const auto x_star = position_stars[p];
+      std::uint32_t mask = 0;
+      int n = 0;
+      for(int k=0; k<stencil_size; ++k) {
+        if(k == stencil_center)
+          continue;
+        const auto offset = stencil_offset(k);
+        bool sent = true;
+        for(int d=0; d<Dim; ++d) {
+          if(offset[d] < 0)
+            sent = sent && x_star[d] < edge_min[d];
+          if(offset[d] > 0)
+            sent = sent && x_star[d] > edge_max[d];
+        }
+        if(sent)
+          mask |= (std::uint32_t(1) << n);
+        ++n;
+      }
+      masks[p - edge_begin] = mask;
     });
 
-    edge_left_count_ = edge_right_begin - edge_begin;
-    edge_right_count_ = end - edge_right_begin;
-
-    const int max_recv_per_side = static_cast<int>(particles.available()/2);
-
-    receive_left_index_ = this->resident_count_;
-    receive_right_index_ = receive_left_index_ + max_recv_per_side;
-    const std::size_t send_left_index = edge_begin - begin;
-    const std::size_t send_right_index = edge_right_begin - begin;
-
-    requests_[0] = comm_compute_.i_recv(this->domain_to_left(), 0,
-                                       &particles.position_stars()[receive_left_index_], max_recv_per_side, MPI_VEC_);
-    requests_[1] = comm_compute_.i_recv(this->domain_to_left(), 1,
-                                       &particles.positions()[receive_left_index_], max_recv_per_side, MPI_VEC_);
-    requests_[2] = comm_compute_.i_recv(this->domain_to_left(), 2,
-                                       &particles.velocities()[receive_left_index_], max_recv_per_side, MPI_VEC_);
-
-    requests_[3] = comm_compute_.i_recv(this->domain_to_right(), 3,
-                                       &particles.position_stars()[receive_right_index_], max_recv_per_side, MPI_VEC_);
-    requests_[4] = comm_compute_.i_recv(this->domain_to_right(), 4,
-                                       &particles.positions()[receive_right_index_], max_recv_per_side, MPI_VEC_);
-    requests_[5] = comm_compute_.i_recv(this->domain_to_right(), 5,
-                                       &particles.velocities()[receive_right_index_], max_recv_per_side, MPI_VEC_);
-
-    requests_[6] = comm_compute_.i_send(this->domain_to_left(), 3,
-                                       &particles.position_stars()[send_left_index], edge_left_count_, MPI_VEC_);
-    requests_[7] = comm_compute_.i_send(this->domain_to_left(), 4,
-                                       &particles.positions()[send_left_index], edge_left_count_, MPI_VEC_);
-    requests_[8] = comm_compute_.i_send(this->domain_to_left(), 5,
-                                       &particles.velocities()[send_left_index], edge_left_count_, MPI_VEC_);
-
-    requests_[9]  = comm_compute_.i_send(this->domain_to_right(), 0,
-                                        &particles.position_stars()[send_right_index], edge_right_count_, MPI_VEC_);
-    requests_[10] = comm_compute_.i_send(this->domain_to_right(), 1,
-                                        &particles.positions()[send_right_index], edge_right_count_, MPI_VEC_);
-    requests_[11] = comm_compute_.i_send(this->domain_to_right(), 2,
-                                        &particles.velocities()[send_right_index], edge_right_count_, MPI_VEC_);
-}
+    // Pack each neighbors edge particles one after another at the start of the staging buffer
+    // or, if this node is shared, the node window so neighbors on the node can read them in place
+    const bool one_sided = halo_exchange_ == Parameters<Real,Dim>::RMA;
+    char* staging = attributes.staging();
+    char* send_buffer = window_ && !one_sided ? window_ : staging;
+    const std::size_t stride = attributes.stride(ATTRIBUTE_HALO);
+    std::size_t offset = 0;
+    std::size_t send_offsets[MAX_NEIGHBOR_DOMAINS];
+    std::size_t send_bytes[MAX_NEIGHBOR_DOMAINS];
+    for(int n=0; n<neighbor_count_; ++n) {
+      send_offsets[n] = offset;
+      send_counts_[n] = 0;
+      send_bytes[n] = 0;
+      if(neighbor_ranks_[n] == MPI_PROC_NULL)
+        continue;
+
+      const IndexList list = this->edge_list(particles, n);
+      if(this->encoded_neighbor(n)) {
+        send_bytes[n] = this->halo_codec(coords_).encode(particles, list, send_buffer + offset,
+                                                         attributes.staging_bytes() - offset);
+      } else {
+        if(offset + list.count*stride > attributes.staging_bytes())
+          throw std::runtime_error("Not enough staging space to send halo particles");
+        attributes.pack(ATTRIBUTE_HALO, list, send_buffer + offset);
+        send_bytes[n] = list.count*stride;
+      }
+      send_counts_[n] = list.count;
+      offset += send_bytes[n];
+    }
+
+    if(one_sided) {
+      this->put_halo_particles(particles, send_offsets, send_bytes);
+      exchange_time_ = MPI_Wtime() - exchange_start;
+      return;
+    }
+
+    // The window isn't repacked until every neighbor has sent its next OOB particles, which it does after reading
+    if(window_)
+      MPI_Win_sync(node_window_);
+
+    // Encoded messages are received as bytes, the particle capacity is checked as they're decoded
+    const std::size_t receive_begin = window_ ? 0 : offset;
+    const std::size_t max_receive_count = halo_precision_ > 0 ? attributes.staging_bytes() - receive_begin :
+                                          std::min(particles.available(),
+                                                   (attributes.staging_bytes() - receive_begin)/stride);
+    this->reserve_receive_space(receive_begin, max_receive_count);
+
+    // Neighbors on this node are only sent where in the window their particles are
+    for(int n=0; n<neighbor_count_; ++n) {
+      if(neighbor_windows_[n]) {
+        window_notices_[n][0] = send_offsets[n];
+        window_notices_[n][1] = send_counts_[n];
+        requests_[neighbor_count_ + n] = comm_compute_.i_send(neighbor_ranks_[n], send_tag(n),
+                                                              window_notices_[n], 2, MPI_UINT64_T);
+      } else if(this->encoded_neighbor(n)) {
+        requests_[neighbor_count_ + n] = comm_compute_.i_send(neighbor_ranks_[n], send_tag(n),
+                                                              send_buffer + send_offsets[n],
+                                                              static_cast<int>(send_bytes[n]), MPI_BYTE);
+      } else {
+        requests_[neighbor_count_ + n] = comm_compute_.i_send(neighbor_ranks_[n], send_tag(n),
+                                                              send_buffer + send_offsets[n],
+                                                              static_cast<int>(send_counts_[n]), MPI_HALO_PARTICLE_);
+      }
+    }
+    exchange_time_ = MPI_Wtime() - exchange_start;
+  }
 
   /*! Finalize halo sync
    */
   void finalize_halo_exchange(Particles<Real,Dim> & particles) {
-    MPI_Status statuses[12];
-    sim::mpi::wait_all(requests_, 12, statuses);
-
-    // copy received left/right to correct position in particle array
-
-    int received_left_count, received_right_count;//, sent_left_count, sent_right_count;
-    MPI_Get_count(&statuses[0], MPI_VEC_, &received_left_count);
-    MPI_Get_count(&statuses[3], MPI_VEC_, &received_right_count);
-
-    // Left halo doesn't need to be copied but does need to increment particle counts
-    this->add_halo_particles_left(particles,
-                             &particles.positions()[receive_left_index_],
-                             &particles.position_stars()[receive_left_index_],
-                             &particles.velocities()[receive_left_index_],
-                             received_left_count);
-
-    this->add_halo_particles_right(particles,
-                             &particles.positions()[receive_right_index_],
-                             &particles.position_stars()[receive_right_index_],
-                             &particles.velocities()[receive_right_index_],
-                             received_right_count);
+    const double exchange_start = MPI_Wtime();
+    if(halo_exchange_ == Parameters<Real,Dim>::RMA) {
+      this->finalize_put_halo_particles(particles);
+      this->smooth_cost(exchange_cost_, exchange_time_ + MPI_Wtime() - exchange_start);
+      return;
+    }
+
+    // Every neighbor which isn't read from the node window is encoded if any are
+    const bool encoded = halo_precision_ > 0;
+    char* staging = particles.attributes().staging();
+    int received_counts[MAX_NEIGHBOR_DOMAINS];
+    this->receive_particles(staging, encoded ? 1 : particles.attributes().stride(ATTRIBUTE_HALO),
+                            encoded ? MPI_BYTE : MPI_HALO_PARTICLE_, received_counts, true);
+
+    // Particles of neighbors on this node are unpacked straight from their part of the node window
+    const char* packed[MAX_NEIGHBOR_DOMAINS];
+    for(int n=0; n<neighbor_count_; ++n) {
+      packed[n] = staging + receive_offsets_[n];
+      if(!neighbor_windows_[n])
+        continue;
+
+      std::uint64_t notice[2];
+      int count = 0;
+      MPI_Message message = comm_compute_.m_probe(neighbor_ranks_[n], receive_tag(n), MPI_UINT64_T, count);
+      comm_compute_.m_recv(notice, count, MPI_UINT64_T, message);
+      packed[n] = neighbor_windows_[n] + notice[0];
+      received_counts[n] = static_cast<int>(notice[1]);
+    }
+    if(window_)
+      MPI_Win_sync(node_window_);
+    this->wait_neighbor_requests();
+
+    for(int n=0; n<neighbor_count_; ++n) {
+      if(this->encoded_neighbor(n))
+        this->add_encoded_halo_particles(particles, n, packed[n]);
+      else
+        this->add_halo_particles(particles, n, packed[n], received_counts[n]);
+    }
+
+    this->smooth_cost(exchange_cost_, exchange_time_ + MPI_Wtime() - exchange_start);
+  }
+
+  /*! Byte displacement of a neighbors notice in the halo window header
+   * The header holds the put cursor followed by an {offset, count} notice from each neighbor
+   * @param n Index of the neighbor the notice is from
+   * @return Byte displacement in the halo window
+   */
+  static MPI_Aint halo_notice_displacement(int n) {
+    return static_cast<MPI_Aint>((1 + 2*n) * sizeof(std::uint64_t));
+  }
+
+  /*! Create the halo receive window, collective over the compute ranks
+   * @param particles Particles whose staging size bounds the halo received from all neighbors
+   */
+  void create_halo_window(Particles<Real,Dim> & particles) {
+    if(halo_window_ != MPI_WIN_NULL)
+      return;
+    const std::size_t words = halo_notice_displacement(neighbor_count_)/sizeof(std::uint64_t)
+                            + (particles.attributes().staging_bytes() + sizeof(std::uint64_t) - 1)/sizeof(std::uint64_t);
+    halo_window_buffer_.reset(new sim::Array<std::uint64_t>(words));
+
+    // Only general active target synchronization is used
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "no_locks", "true");
+    MPI_Win_create(halo_window_buffer_->data(), static_cast<MPI_Aint>(words*sizeof(std::uint64_t)), 1,
+                   info, comm_compute_.MPI_comm(), &halo_window_);
+    MPI_Info_free(&info);
+  }
+
+  /*! Initiate a one sided halo exchange of the packed edge particles
+   * A first epoch reserves space in each neighbors window with an atomic add to its put cursor,
+   * a second puts the particles and an {offset, count} notice, it's completed by finalize_put_halo_particles
+   * @param particles Particles whose edge particles are packed in staging
+   * @param send_offsets Staging byte offset of the particles packed for each neighbor
+   * @param send_bytes Bytes packed for each neighbor
+   */
+  void put_halo_particles(Particles<Real,Dim> & particles,
+                          const std::size_t* send_offsets,
+                          const std::size_t* send_bytes) {
+    this->create_halo_window(particles);
+    const char* staging = particles.attributes().staging();
+    const std::uint64_t window_bytes = halo_window_buffer_->capacity() * sizeof(std::uint64_t);
+
+    // Local updates become visible to neighbors when the window is posted
+    std::uint64_t* header = halo_window_buffer_->data();
+    header[0] = halo_notice_displacement(neighbor_count_);
+    std::fill(header + 1, header + halo_notice_displacement(neighbor_count_)/sizeof(std::uint64_t), 0);
+
+    std::uint64_t bytes[MAX_NEIGHBOR_DOMAINS];
+    std::uint64_t put_offsets[MAX_NEIGHBOR_DOMAINS];
+    MPI_Win_post(neighbor_group_, 0, halo_window_);
+    MPI_Win_start(neighbor_group_, 0, halo_window_);
+    for(int n=0; n<neighbor_count_; ++n) {
+      if(neighbor_ranks_[n] == MPI_PROC_NULL)
+        continue;
+      bytes[n] = send_bytes[n];
+      MPI_Fetch_and_op(&bytes[n], &put_offsets[n], MPI_UINT64_T, neighbor_ranks_[n], 0, MPI_SUM, halo_window_);
+    }
+    MPI_Win_complete(halo_window_);
+    MPI_Win_wait(halo_window_);
+
+    MPI_Win_post(neighbor_group_, 0, halo_window_);
+    MPI_Win_start(neighbor_group_, 0, halo_window_);
+    for(int n=0; n<neighbor_count_; ++n) {
+      if(neighbor_ranks_[n] == MPI_PROC_NULL)
+        continue;
+      if(put_offsets[n] + bytes[n] > window_bytes)
+        throw std::runtime_error("Not enough halo window space to put halo particles");
+
+      window_notices_[n][0] = put_offsets[n];
+      window_notices_[n][1] = send_counts_[n];
+      MPI_Put(staging + send_offsets[n], static_cast<int>(bytes[n]), MPI_BYTE, neighbor_ranks_[n],
+              static_cast<MPI_Aint>(put_offsets[n]), static_cast<int>(bytes[n]), MPI_BYTE, halo_window_);
+      MPI_Put(window_notices_[n], 2, MPI_UINT64_T, neighbor_ranks_[n],
+              halo_notice_displacement(neighbor_count_ - 1 - n), 2, MPI_UINT64_T, halo_window_);
+    }
+  }
+
+  /*! Finalize a one sided halo exchange, adding the particles put in the halo window
+   * @param particles Particles in which to add halos to
+   */
+  void finalize_put_halo_particles(Particles<Real,Dim> & particles) {
+    MPI_Win_complete(halo_window_);
+    MPI_Win_wait(halo_window_);
+
+    const std::uint64_t* header = halo_window_buffer_->data();
+    const char* window = reinterpret_cast<const char*>(header);
+    for(int n=0; n<neighbor_count_; ++n) {
+      const std::uint64_t* notice = header + halo_notice_displacement(n)/sizeof(std::uint64_t);
+      if(this->encoded_neighbor(n))
+        this->add_encoded_halo_particles(particles, n, window + notice[0]);
+      else
+        this->add_halo_particles(particles, n, window + notice[0], notice[1]);
+    }
+  }
+
+  /*! Compact the edge particles sent to a neighbor by the last halo exchange
+   * The list is stored in the particle attribute order and is valid until the order is next used
+   * @param particles Particles which were exchanged
+   * @param n Neighbor index
+   * @return List of edge particle indices
+   */
+  IndexList edge_list(Particles<Real,Dim> & particles, int n) {
+    const std::uint32_t* masks = edge_masks_->data();
+    const std::size_t edge_begin = this->edge_span().begin;
+    const std::uint32_t bit = std::uint32_t(1) << n;
+    std::size_t* indices = particles.attributes().order();
+    const std::size_t count = sim::algorithms::copy_index_if(this->edge_span(), indices,
+                                                             [=] DEVICE_CALLABLE (std::size_t p) {
+      return (masks[p - edge_begin] & bit) != 0;
+    });
+    return IndexList{indices, count};
+  }
+
+  /*! Find the persistent requests syncing an array, rebuilding them if the buffers or counts have changed
+   * @param values Array to sync, identifies the requests
+   * @param send_values Buffer the values sent to each neighbor are gathered into, in neighbor order
+   * @param send_counts Number of values sent to each neighbor
+   * @param receive_values Buffer the values of each neighbor are received into, in neighbor order
+   * @param receive_counts Number of values received from each neighbor
+   * @param data_type MPI type of the array elements
+   * @param value_size Bytes per array element
+   * @return Persistent requests ready to be started
+   */
+  HaloSync& halo_sync(const void* values, char* send_values, const std::size_t* send_counts,
+                      char* receive_values, const std::size_t* receive_counts,
+                      MPI_Datatype data_type, std::size_t value_size) {
+    HaloSync* sync = nullptr;
+    for(auto& candidate : halo_syncs_) {
+      if(candidate.values == values && candidate.data_type == data_type)
+        sync = &candidate;
+    }
+    if(!sync)
+      sync = &halo_syncs_[halo_sync_count_++ % MAX_HALO_SYNCS];
+
+    bool current = (sync->values == values && sync->send_values == send_values &&
+                    sync->receive_values == receive_values);
+    for(int n=0; n<neighbor_count_; ++n)
+      current = current && sync->send_counts[n] == send_counts[n] && sync->receive_counts[n] == receive_counts[n];
+    if(current)
+      return *sync;
+
+    sim::mpi::free_all(sync->requests, 2*MAX_NEIGHBOR_DOMAINS);
+    sync->values = values;
+    sync->data_type = data_type;
+    sync->send_values = send_values;
+    sync->receive_values = receive_values;
+
+    for(int n=0; n<neighbor_count_; ++n) {
+      sync->send_counts[n] = send_counts[n];
+      sync->receive_counts[n] = receive_counts[n];
+      sync->requests[n] = comm_compute_.recv_init(neighbor_ranks_[n], receive_tag(n), receive_values,
+                                                  static_cast<int>(receive_counts[n]), data_type);
+      sync->requests[neighbor_count_ + n] = comm_compute_.send_init(neighbor_ranks_[n], send_tag(n), send_values,
+                                                                    static_cast<int>(send_counts[n]), data_type);
+      receive_values += receive_counts[n]*value_size;
+      send_values += send_counts[n]*value_size;
+    }
+    return *sync;
+  }
+
+  /*! Initiate syncronize of halo values
+   * Edge values are gathered into the staging buffer per neighbor, halo values are received in place.
+   * Requests are persistent and only rebuilt when a halo exchange changes the counts
+   * @param particles Particles whose edge particles were sent by the last halo exchange
+   * @param halo_values Array of values to be synced between neighboring domains
+   * @param data_type MPI type of T
+   */
+  template<typename T>
+  void initiate_sync_halo(Particles<Real,Dim> & particles, sim::Array<T>& halo_values, MPI_Datatype data_type) {
+    sync_start_ = MPI_Wtime();
+    char* staging = particles.attributes().staging();
+    char* receive_values = reinterpret_cast<char*>(halo_values.data() + resident_count_);
+    HaloSync& sync = this->halo_sync(halo_values.data(), staging, send_counts_, receive_values, halo_counts_,
+                                     data_type, sizeof(T));
+    active_sync_ = &sync;
+
+    // Receives can start before the edge values are gathered
+    sim::mpi::start_all(sync.requests, neighbor_count_);
+
+    T* send_values = reinterpret_cast<T*>(staging);
+    const T* values = halo_values.data();
+    for(int n=0; n<neighbor_count_; ++n) {
+      if(neighbor_ranks_[n] == MPI_PROC_NULL)
+        continue;
+      const IndexList list = this->edge_list(particles, n);
+      sim::algorithms::for_each_index(IndexSpan{0, list.count}, [=] DEVICE_CALLABLE (std::size_t i) {
+        send_values[i] = values[list.indices[i]];
+      });
+      send_values += list.count;
+    }
+
+    sim::mpi::start_all(sync.requests + neighbor_count_, neighbor_count_);
+  }
+
+  /*! Finalize the active halo sync
+   * The persistent requests become inactive and may be started again
+   */
+  void finalize_sync_halo() {
+    sim::mpi::wait_all(active_sync_->requests, 2*neighbor_count_, MPI_STATUSES_IGNORE);
+    active_sync_ = nullptr;
+    const double sync_time = MPI_Wtime() - sync_start_;
+    this->smooth_cost(sync_cost_, sync_time);
+    sync_time_ += sync_time;
   }
 
 public:
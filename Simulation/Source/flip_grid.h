@@ -0,0 +1,675 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include "managed_allocation.h"
+#include "dimension.h"
+#include "array.h"
+#include "vec.h"
+#include "aabb.h"
+#include "parameters.h"
+#include "device.h"
+#include "sim_algorithms.h"
+#include "neighbors.h"
+#include "particles.h"
+
+namespace sim {
+
+  /*! MAC grid used by the hybrid FLIP/PIC solver
+   * Cells coincide with the neighbor bins so particles can be gathered from the already sorted bins,
+   * including the one bin pad surrounding the boundary. Cell i spans [(i-1)*spacing, i*spacing) and
+   * face i along an axis lies on the lower side of cell i. Storage covers the whole grid, like the bins, but
+   * each process only works on the subgrid of cells it owns, those with centers in its domain, and a one cell
+   * ghost layer holding the types and pressures of the cells its neighbors own
+   */
+  template<typename Real, Dimension Dim>
+  class FlipGrid : public ManagedAllocation {
+  public:
+    enum CellType {
+      AIR = 0,
+      FLUID = 1,
+      SOLID = 2
+    };
+
+    /*! Constructor
+     * The grid is decomposed for a single process owning the whole boundary
+     * @param parameters Populated simulation parameters
+     * @param neighbors  Particle neighbors, the grid shares its bins
+     */
+    FlipGrid(const Parameters<Real, Dim> &parameters,
+             const Neighbors<Real, Dim> &neighbors) : parameters_{parameters},
+                                                      neighbors_{neighbors},
+                                                      spacing_{neighbors.bin_spacing()},
+                                                      cell_dimensions_{padded(neighbors.bin_dimensions(), 0)},
+                                                      face_dimensions_{padded(neighbors.bin_dimensions(), 1)},
+                                                      cell_count_{product(cell_dimensions_)},
+                                                      face_count_{product(face_dimensions_)},
+                                                      cell_types_{cell_count_},
+                                                      divergences_{cell_count_},
+                                                      pressures_{cell_count_},
+                                                      pressures_scratch_{cell_count_},
+                                                      face_velocities_{Dim * face_count_},
+                                                      saved_face_velocities_{Dim * face_count_},
+                                                      send_cells_{cell_count_},
+                                                      receive_cells_{cell_count_},
+                                                      send_values_{cell_count_},
+                                                      receive_values_{cell_count_} {
+      this->decompose(parameters.boundary(), std::vector<AABB<Real, Dim>>{});
+    }
+
+    /*! Decompose the grid over the distributor domains
+     * The ghost exchange lists are only rebuilt when this or a neighboring domain has changed
+     * @param distributor Distributor providing this and the neighboring domains
+     */
+    template<typename Distributor>
+    void decompose(const Distributor &distributor) {
+      std::vector<AABB<Real, Dim>> neighbor_domains;
+      for (int n = 0; n < distributor.neighbor_domain_count(); ++n)
+        neighbor_domains.push_back(distributor.neighbor_domain(n));
+      this->decompose(distributor.domain(), neighbor_domains);
+    }
+
+    /*! Transfer particle velocities to the grid faces
+     * Each face takes the tent weighted average velocity of the particles binned around it, the transferred
+     * velocities are saved for the FLIP update. Neighbors must have been found for the current position stars
+     * @param particles  Particles to transfer from
+     */
+    void particles_to_grid(const Particles<Real, Dim> &particles) {
+      const auto position_stars = particles.position_stars().data();
+      const auto velocities = particles.velocities().data();
+      const auto begin_indices = neighbors_.begin_indices().data();
+      const auto end_indices = neighbors_.end_indices().data();
+      const auto particle_ids = neighbors_.particle_ids().data();
+
+      for (std::size_t axis = 0; axis < Dim; ++axis) {
+        sim::algorithms::for_each_index(IndexSpan{0, subgrid_face_count_}, [=] DEVICE_CALLABLE(std::size_t f) {
+          const auto face = this->subgrid_face(f);
+          const std::size_t face_index = axis * face_count_ + this->face_index(face);
+
+          // Faces past the last cell of a non face axis are padding
+          if (!this->valid_face(face, axis)) {
+            face_velocities_[face_index] = static_cast<Real>(0.0);
+            saved_face_velocities_[face_index] = static_cast<Real>(0.0);
+            return;
+          }
+
+          Vec<Real, 3> face_position;
+          for (std::size_t d = 0; d < 3; ++d) {
+            const Real offset = (d == axis ? static_cast<Real>(1.0) : static_cast<Real>(0.5));
+            face_position[d] = (static_cast<Real>(face[d]) - offset) * spacing_;
+          }
+
+          // Cells within a grid spacing of the face
+          Vec<std::size_t, 3> low;
+          Vec<std::size_t, 3> high;
+          for (std::size_t d = 0; d < 3; ++d) {
+            const std::size_t reach = (d == axis ? 1 : (d < Dim ? 1 : 0));
+            const std::size_t upper = (d == axis ? face[d] : face[d] + reach);
+            low[d] = (face[d] >= reach ? face[d] - reach : 0);
+            high[d] = (upper < cell_dimensions_[d] ? upper : cell_dimensions_[d] - 1);
+          }
+
+          Real weight_sum = 0.0;
+          Real velocity_sum = 0.0;
+          for (std::size_t k = low[2]; k <= high[2]; ++k) {
+            for (std::size_t j = low[1]; j <= high[1]; ++j) {
+              for (std::size_t i = low[0]; i <= high[0]; ++i) {
+                const std::size_t bin = this->cell_index(i, j, k);
+                for (std::size_t b = begin_indices[bin]; b < end_indices[bin]; ++b) {
+                  const std::size_t q = particle_ids[b];
+                  Real weight = 1.0;
+                  for (std::size_t d = 0; d < Dim; ++d)
+                    weight *= tent((position_stars[q][d] - face_position[d]) / spacing_);
+                  weight_sum += weight;
+                  velocity_sum += weight * velocities[q][axis];
+                }
+              }
+            }
+          }
+
+          const Real velocity = (weight_sum > static_cast<Real>(0.0) ? velocity_sum / weight_sum
+                                                                     : static_cast<Real>(0.0));
+          face_velocities_[face_index] = velocity;
+          saved_face_velocities_[face_index] = velocity;
+        });
+      }
+    }
+
+    /*! Make the grid velocities divergence free on a single process
+     * Owned cells containing particles are fluid, the pad ring and cells no process owns are solid, and the
+     * remaining cells are air with zero pressure. Pressure is found with Jacobi iteration
+     */
+    void project() {
+      this->solve([](Real *) {});
+    }
+
+    /*! Make the grid velocities divergence free with the pressure solve distributed over the domains
+     * Ghost cell types are exchanged once and ghost pressures after every Jacobi iteration, using the
+     * distributor's persistent neighbor requests. decompose must have been called for the current domains
+     * @param distributor Distributor the grid was decomposed over
+     */
+    template<typename Distributor>
+    void project(Distributor &distributor) {
+      this->solve([&](Real *values) { this->sync_ghosts(distributor, values); });
+    }
+
+    /*! Transfer grid velocities back to particles and advect them
+     * Particle velocities are set to a flip_ratio blend of the FLIP and PIC velocities and position stars are
+     * advanced from the start of step positions
+     * @param particles Particles to transfer to
+     * @param list      Particles to update, typically the hybrid solver bulk, which lie in owned cells
+     */
+    void grid_to_particles(Particles<Real, Dim> &particles, IndexList list) {
+      const auto positions = particles.positions().data();
+      const auto position_stars = particles.position_stars().data();
+      const auto velocities = particles.velocities().data();
+      const auto colliders = &particles.colliders();
+      const Real flip_ratio = parameters_.flip_ratio();
+      const Real dt = parameters_.time_step();
+
+      sim::algorithms::for_each_index(list, [=] DEVICE_CALLABLE(std::size_t p) {
+        auto velocity = velocities[p];
+        for (std::size_t axis = 0; axis < Dim; ++axis) {
+          Real pic;
+          Real delta;
+          this->interpolate(position_stars[p], axis, pic, delta);
+          velocity[axis] = flip_ratio * (velocity[axis] + delta) +
+                           (static_cast<Real>(1.0) - flip_ratio) * pic;
+        }
+        velocities[p] = velocity;
+
+        auto position_star = positions[p] + velocity * dt;
+        apply_boundary_conditions(position_star, parameters_, *colliders);
+        position_stars[p] = position_star;
+      });
+    }
+
+    /*! Cell type getter
+     * @param i x cell coordinate
+     * @param j y cell coordinate
+     * @param k z cell coordinate, 0 in 2D
+     * @return Type of the cell as set by the last projection, solid outside of the subgrid
+     */
+    int cell_type(std::size_t i, std::size_t j, std::size_t k = 0) const {
+      return cell_types_[this->cell_index(i, j, k)];
+    }
+
+    /*! Cell pressure getter
+     * @param i x cell coordinate
+     * @param j y cell coordinate
+     * @param k z cell coordinate, 0 in 2D
+     * @return Pressure, scaled by dt / rest density, of the cell as found by the last projection
+     */
+    Real pressure(std::size_t i, std::size_t j, std::size_t k = 0) const {
+      return pressures_[this->cell_index(i, j, k)];
+    }
+
+    /*! Face velocity getter
+     * @param axis Velocity component
+     * @param i    x face coordinate
+     * @param j    y face coordinate
+     * @param k    z face coordinate, 0 in 2D
+     * @return Grid velocity component stored on the face
+     */
+    Real face_velocity(std::size_t axis, std::size_t i, std::size_t j, std::size_t k = 0) const {
+      return face_velocities_[axis * face_count_ + this->face_index(Vec<std::size_t, 3>{i, j, k})];
+    }
+
+    /*! Owned cells getter
+     * @param low  Lowest owned cell coordinate
+     * @param high One past the highest owned cell coordinate
+     */
+    void owned_cells(Vec<std::size_t, 3> &low, Vec<std::size_t, 3> &high) const {
+      low = owned_low_;
+      high = owned_high_;
+    }
+
+  private:
+    const Parameters<Real, Dim> &parameters_;
+    const Neighbors<Real, Dim> &neighbors_;
+    const Real spacing_;                         /**< Grid cell width, matches the neighbor bin spacing **/
+    const Vec<std::size_t, 3> cell_dimensions_;  /**< Cell counts, z is 1 in 2D **/
+    const Vec<std::size_t, 3> face_dimensions_;  /**< Face index extents, shared by all face axes **/
+    const std::size_t cell_count_;
+    const std::size_t face_count_;               /**< Faces per velocity component **/
+    Vec<std::size_t, 3> owned_low_;              /**< Lowest cell with a center in the domain **/
+    Vec<std::size_t, 3> owned_high_;             /**< One past the highest cell with a center in the domain **/
+    Vec<std::size_t, 3> subgrid_low_;            /**< Owned cells widened by the ghost layer **/
+    Vec<std::size_t, 3> subgrid_dimensions_;
+    std::size_t subgrid_cell_count_ = 0;
+    std::size_t subgrid_face_count_ = 0;         /**< Subgrid faces per velocity component **/
+    bool decomposed_ = false;
+    AABB<Real, Dim> domain_;                     /**< Domain the grid was last decomposed for **/
+    std::vector<AABB<Real, Dim>> neighbor_domains_;
+    std::vector<std::size_t> send_counts_;       /**< Owned cells sent to each neighbor **/
+    std::vector<std::size_t> receive_counts_;    /**< Ghost cells received from each neighbor **/
+    sim::Array<int> cell_types_;
+    sim::Array<Real> divergences_;
+    sim::Array<Real> pressures_;
+    sim::Array<Real> pressures_scratch_;         /**< Jacobi ping-pong buffer **/
+    sim::Array<Real> face_velocities_;           /**< Dim blocks of face_count_ velocities **/
+    sim::Array<Real> saved_face_velocities_;     /**< Face velocities before projection **/
+    sim::Array<std::size_t> send_cells_;         /**< Owned cells in neighbor ghost layers, grouped by neighbor **/
+    sim::Array<std::size_t> receive_cells_;      /**< Ghost cells, grouped by owning neighbor **/
+    sim::Array<Real> send_values_;
+    sim::Array<Real> receive_values_;
+
+    /*! Pad grid dimensions to three components
+     * @param dimensions Neighbor bin dimensions
+     * @param extra      Amount added to each in use component
+     */
+    static Vec<std::size_t, 3> padded(const Vec<std::size_t, Dim> &dimensions, std::size_t extra) {
+      Vec<std::size_t, 3> result{1, 1, 1};
+      for (std::size_t d = 0; d < Dim; ++d)
+        result[d] = dimensions[d] + extra;
+      return result;
+    }
+
+    /*! Find the cells with centers in a domain, excluding the pad ring
+     * Every process computes the same cells from the same domain bounds so ownership never overlaps
+     * @param domain Domain bounds
+     * @param low    Lowest cell coordinate
+     * @param high   One past the highest cell coordinate, equal to low if no cells are owned
+     */
+    void domain_cells(const AABB<Real, Dim> &domain, Vec<std::size_t, 3> &low, Vec<std::size_t, 3> &high) const {
+      low = Vec<std::size_t, 3>{0, 0, 0};
+      high = Vec<std::size_t, 3>{1, 1, 1};
+      bool empty = false;
+      for (std::size_t d = 0; d < Dim; ++d) {
+        const Real last = static_cast<Real>(cell_dimensions_[d] - 1);
+        Real lower = std::ceil(domain.min[d] / spacing_ + static_cast<Real>(0.5));
+        Real upper = std::ceil(domain.max[d] / spacing_ + static_cast<Real>(0.5));
+        lower = std::min(std::max(lower, static_cast<Real>(1.0)), last);
+        upper = std::min(std::max(upper, static_cast<Real>(1.0)), last);
+        low[d] = static_cast<std::size_t>(lower);
+        high[d] = static_cast<std::size_t>(upper);
+        empty = empty || high[d] <= low[d];
+      }
+      if (empty)
+        high = low;
+    }
+
+    /*! Test if a cell lies in a box
+     */
+    DEVICE_CALLABLE
+    static bool in_box(const Vec<std::size_t, 3> &cell, const Vec<std::size_t, 3> &low,
+                       const Vec<std::size_t, 3> &high) {
+      return cell[0] >= low[0] && cell[0] < high[0] &&
+             cell[1] >= low[1] && cell[1] < high[1] &&
+             cell[2] >= low[2] && cell[2] < high[2];
+    }
+
+    /*! Widen owned cells by the ghost layer
+     */
+    void ghost_box(const Vec<std::size_t, 3> &low, const Vec<std::size_t, 3> &high,
+                   Vec<std::size_t, 3> &ghost_low, Vec<std::size_t, 3> &ghost_high) const {
+      ghost_low = low;
+      ghost_high = high;
+      if (high[0] == low[0])
+        return;
+      for (std::size_t d = 0; d < Dim; ++d) {
+        ghost_low[d] = low[d] - 1;
+        ghost_high[d] = high[d] + 1;
+      }
+    }
+
+    /*! Decompose the grid over a domain and its neighbors
+     * @param domain           Domain of this process
+     * @param neighbor_domains Domains of the neighbors, empty for missing neighbors, in distributor order
+     */
+    void decompose(const AABB<Real, Dim> &domain, const std::vector<AABB<Real, Dim>> &neighbor_domains) {
+      bool current = (decomposed_ && neighbor_domains.size() == neighbor_domains_.size());
+      for (std::size_t d = 0; current && d < Dim; ++d)
+        current = domain.min[d] == domain_.min[d] && domain.max[d] == domain_.max[d];
+      for (std::size_t n = 0; current && n < neighbor_domains.size(); ++n) {
+        for (std::size_t d = 0; d < Dim; ++d)
+          current = current && neighbor_domains[n].min[d] == neighbor_domains_[n].min[d] &&
+                    neighbor_domains[n].max[d] == neighbor_domains_[n].max[d];
+      }
+      if (current)
+        return;
+
+      decomposed_ = true;
+      domain_ = domain;
+      neighbor_domains_ = neighbor_domains;
+
+      this->domain_cells(domain, owned_low_, owned_high_);
+      Vec<std::size_t, 3> subgrid_high;
+      this->ghost_box(owned_low_, owned_high_, subgrid_low_, subgrid_high);
+      subgrid_dimensions_ = subgrid_high - subgrid_low_;
+      subgrid_cell_count_ = product(subgrid_dimensions_);
+      subgrid_face_count_ = 1;
+      for (std::size_t d = 0; d < 3; ++d)
+        subgrid_face_count_ *= subgrid_dimensions_[d] + (d < Dim ? 1 : 0);
+
+      // Cells outside of the subgrid are never updated and read as solid
+      sim::algorithms::for_each_index(IndexSpan{0, cell_count_}, [=] DEVICE_CALLABLE(std::size_t c) {
+        cell_types_[c] = SOLID;
+        pressures_[c] = static_cast<Real>(0.0);
+      });
+
+      // Both sides list the exchanged cells in ascending cell index order so the values pair up
+      const std::size_t neighbor_count = neighbor_domains.size();
+      std::vector<Vec<std::size_t, 3>> neighbor_lows(neighbor_count);
+      std::vector<Vec<std::size_t, 3>> neighbor_highs(neighbor_count);
+      std::vector<std::vector<std::size_t>> receives(neighbor_count);
+      for (std::size_t n = 0; n < neighbor_count; ++n)
+        this->domain_cells(neighbor_domains[n], neighbor_lows[n], neighbor_highs[n]);
+
+      for (std::size_t c = 0; c < subgrid_cell_count_; ++c) {
+        const auto cell = this->subgrid_cell(c);
+        if (in_box(cell, owned_low_, owned_high_))
+          continue;
+        for (std::size_t n = 0; n < neighbor_count; ++n) {
+          if (in_box(cell, neighbor_lows[n], neighbor_highs[n]))
+            receives[n].push_back(this->cell_index(cell[0], cell[1], cell[2]));
+        }
+      }
+
+      send_cells_.erase_tail(send_cells_.size());
+      receive_cells_.erase_tail(receive_cells_.size());
+      send_counts_.assign(neighbor_count, 0);
+      receive_counts_.assign(neighbor_count, 0);
+      for (std::size_t n = 0; n < neighbor_count; ++n) {
+        Vec<std::size_t, 3> low;
+        Vec<std::size_t, 3> high;
+        this->ghost_box(neighbor_lows[n], neighbor_highs[n], low, high);
+        for (std::size_t k = low[2]; k < high[2]; ++k) {
+          for (std::size_t j = low[1]; j < high[1]; ++j) {
+            for (std::size_t i = low[0]; i < high[0]; ++i) {
+              if (!in_box(Vec<std::size_t, 3>{i, j, k}, owned_low_, owned_high_))
+                continue;
+              send_cells_.push_back(this->cell_index(i, j, k));
+              ++send_counts_[n];
+            }
+          }
+        }
+
+        for (const auto cell : receives[n])
+          receive_cells_.push_back(cell);
+        receive_counts_[n] = receives[n].size();
+      }
+    }
+
+    /*! Copy the owned values in neighbor ghost layers to the neighbors and receive this ghost layer
+     * @param distributor Distributor the grid was decomposed over
+     * @param values      Cell values to sync
+     */
+    template<typename Distributor>
+    void sync_ghosts(Distributor &distributor, Real *values) {
+      const auto send_cells = send_cells_.data();
+      const auto receive_cells = receive_cells_.data();
+      const auto send_values = send_values_.data();
+      const auto receive_values = receive_values_.data();
+
+      sim::algorithms::for_each_index(IndexSpan{0, send_cells_.size()}, [=] DEVICE_CALLABLE(std::size_t i) {
+        send_values[i] = values[send_cells[i]];
+      });
+
+      distributor.initiate_sync_neighbor_values(send_values, send_counts_.data(),
+                                                receive_values, receive_counts_.data());
+      distributor.finalize_sync_neighbor_values();
+
+      sim::algorithms::for_each_index(IndexSpan{0, receive_cells_.size()}, [=] DEVICE_CALLABLE(std::size_t i) {
+        values[receive_cells[i]] = receive_values[i];
+      });
+    }
+
+    /*! Classify the subgrid cells and subtract the pressure gradient from the face velocities
+     * @param sync_ghosts Callable copying owned cell values to the neighbor ghost layers
+     */
+    template<typename SyncGhosts>
+    void solve(SyncGhosts sync_ghosts) {
+      const auto begin_indices = neighbors_.begin_indices().data();
+      const auto end_indices = neighbors_.end_indices().data();
+      const IndexSpan cell_span{0, subgrid_cell_count_};
+      const IndexSpan face_span{0, subgrid_face_count_};
+
+      // Ghost cells take the type their owner gives them and are solid if no process owns them
+      sim::algorithms::for_each_index(cell_span, [=] DEVICE_CALLABLE(std::size_t s) {
+        const auto cell = this->subgrid_cell(s);
+        const std::size_t c = this->cell_index(cell[0], cell[1], cell[2]);
+
+        int type = SOLID;
+        if (this->owned(cell))
+          type = (end_indices[c] > begin_indices[c] ? FLUID : AIR);
+        cell_types_[c] = type;
+        pressures_scratch_[c] = static_cast<Real>(type);
+        pressures_[c] = static_cast<Real>(0.0);
+      });
+
+      sync_ghosts(pressures_scratch_.data());
+      const auto receive_cells = receive_cells_.data();
+      sim::algorithms::for_each_index(IndexSpan{0, receive_cells_.size()}, [=] DEVICE_CALLABLE(std::size_t i) {
+        cell_types_[receive_cells[i]] = static_cast<int>(pressures_scratch_[receive_cells[i]]);
+      });
+
+      // Solid faces don't allow flow
+      for (std::size_t axis = 0; axis < Dim; ++axis) {
+        sim::algorithms::for_each_index(face_span, [=] DEVICE_CALLABLE(std::size_t f) {
+          const auto face = this->subgrid_face(f);
+          if (this->valid_face(face, axis) && this->solid_face(face, axis))
+            face_velocities_[axis * face_count_ + this->face_index(face)] = static_cast<Real>(0.0);
+        });
+      }
+
+      sim::algorithms::for_each_index(cell_span, [=] DEVICE_CALLABLE(std::size_t s) {
+        const auto cell = this->subgrid_cell(s);
+        const std::size_t c = this->cell_index(cell[0], cell[1], cell[2]);
+        Real divergence = 0.0;
+        if (cell_types_[c] == FLUID && this->owned(cell)) {
+          for (std::size_t axis = 0; axis < Dim; ++axis) {
+            auto upper = cell;
+            upper[axis] += 1;
+            divergence += face_velocities_[axis * face_count_ + this->face_index(upper)] -
+                          face_velocities_[axis * face_count_ + this->face_index(cell)];
+          }
+        }
+        divergences_[c] = divergence / spacing_;
+      });
+
+      const Real spacing_squared = spacing_ * spacing_;
+      const std::size_t iterations = parameters_.flip_pressure_iterations();
+
+      // Pressure here is scaled by dt / rest density, ghost pressures are only written by the sync
+      for (std::size_t iteration = 0; iteration < iterations; ++iteration) {
+        sim::algorithms::for_each_index(cell_span, [=] DEVICE_CALLABLE(std::size_t s) {
+          const auto cell = this->subgrid_cell(s);
+          const std::size_t c = this->cell_index(cell[0], cell[1], cell[2]);
+          if (!this->owned(cell))
+            return;
+          if (cell_types_[c] != FLUID) {
+            pressures_scratch_[c] = static_cast<Real>(0.0);
+            return;
+          }
+
+          Real pressure_sum = 0.0;
+          int open_count = 0;
+          for (std::size_t axis = 0; axis < Dim; ++axis) {
+            for (int side = -1; side < 2; side += 2) {
+              auto neighbor = cell;
+              neighbor[axis] = static_cast<std::size_t>(static_cast<long>(neighbor[axis]) + side);
+              const std::size_t n = this->cell_index(neighbor[0], neighbor[1], neighbor[2]);
+              if (cell_types_[n] == SOLID)
+                continue;
+              pressure_sum += pressures_[n];
+              ++open_count;
+            }
+          }
+
+          pressures_scratch_[c] = (open_count > 0 ? (pressure_sum - spacing_squared * divergences_[c]) / open_count
+                                                  : static_cast<Real>(0.0));
+        });
+
+        sim::algorithms::for_each_index(cell_span, [=] DEVICE_CALLABLE(std::size_t s) {
+          const auto cell = this->subgrid_cell(s);
+          if (this->owned(cell)) {
+            const std::size_t c = this->cell_index(cell[0], cell[1], cell[2]);
+            pressures_[c] = pressures_scratch_[c];
+          }
+        });
+
+        sync_ghosts(pressures_.data());
+      }
+
+      // Subtract the pressure gradient from faces bordering fluid
+      for (std::size_t axis = 0; axis < Dim; ++axis) {
+        sim::algorithms::for_each_index(face_span, [=] DEVICE_CALLABLE(std::size_t f) {
+          const auto face = this->subgrid_face(f);
+          if (!this->valid_face(face, axis) || face[axis] == 0 || face[axis] == cell_dimensions_[axis])
+            return;
+
+          auto lower = face;
+          lower[axis] -= 1;
+          const std::size_t lower_cell = this->cell_index(lower[0], lower[1], lower[2]);
+          const std::size_t upper_cell = this->cell_index(face[0], face[1], face[2]);
+          if (cell_types_[lower_cell] == SOLID || cell_types_[upper_cell] == SOLID)
+            return;
+          if (cell_types_[lower_cell] != FLUID && cell_types_[upper_cell] != FLUID)
+            return;
+
+          face_velocities_[axis * face_count_ + this->face_index(face)] -=
+              (pressures_[upper_cell] - pressures_[lower_cell]) / spacing_;
+        });
+      }
+    }
+
+    /*! Linear tent weight
+     * @param x Distance in grid spacings
+     */
+    DEVICE_CALLABLE
+    static Real tent(Real x) {
+      const Real r = fabs(x);
+      return (r < static_cast<Real>(1.0) ? static_cast<Real>(1.0) - r : static_cast<Real>(0.0));
+    }
+
+    /*! Test if a cell is owned by this process
+     */
+    DEVICE_CALLABLE
+    bool owned(const Vec<std::size_t, 3> &cell) const {
+      return in_box(cell, owned_low_, owned_high_);
+    }
+
+    /*! Linear cell index, matches the neighbor bin ids
+     */
+    DEVICE_CALLABLE
+    std::size_t cell_index(std::size_t i, std::size_t j, std::size_t k) const {
+      return (k * cell_dimensions_[1] + j) * cell_dimensions_[0] + i;
+    }
+
+    /*! Grid cell coordinate of a subgrid cell index
+     */
+    DEVICE_CALLABLE
+    Vec<std::size_t, 3> subgrid_cell(std::size_t s) const {
+      return Vec<std::size_t, 3>{subgrid_low_[0] + s % subgrid_dimensions_[0],
+                                 subgrid_low_[1] + (s / subgrid_dimensions_[0]) % subgrid_dimensions_[1],
+                                 subgrid_low_[2] + s / (subgrid_dimensions_[0] * subgrid_dimensions_[1])};
+    }
+
+    DEVICE_CALLABLE
+    std::size_t face_index(const Vec<std::size_t, 3> &face) const {
+      return (face[2] * face_dimensions_[1] + face[1]) * face_dimensions_[0] + face[0];
+    }
+
+    /*! Grid face coordinate of a subgrid face index, subgrid faces extend one past the subgrid cells
+     */
+    DEVICE_CALLABLE
+    Vec<std::size_t, 3> subgrid_face(std::size_t f) const {
+      const std::size_t x = subgrid_dimensions_[0] + 1;
+      const std::size_t y = subgrid_dimensions_[1] + 1;
+      return Vec<std::size_t, 3>{subgrid_low_[0] + f % x,
+                                 subgrid_low_[1] + (f / x) % y,
+                                 subgrid_low_[2] + f / (x * y)};
+    }
+
+    /*! Test if a face coordinate exists for the given axis
+     * Only the face axis has one more face than cells
+     */
+    DEVICE_CALLABLE
+    bool valid_face(const Vec<std::size_t, 3> &face, std::size_t axis) const {
+      for (std::size_t d = 0; d < 3; ++d) {
+        if (d != axis && face[d] >= subgrid_low_[d] + subgrid_dimensions_[d])
+          return false;
+      }
+      return true;
+    }
+
+    /*! Test if a face borders a solid cell or the grid edge
+     */
+    DEVICE_CALLABLE
+    bool solid_face(const Vec<std::size_t, 3> &face, std::size_t axis) const {
+      if (face[axis] == 0 || face[axis] >= cell_dimensions_[axis])
+        return true;
+      auto lower = face;
+      lower[axis] -= 1;
+      return cell_types_[this->cell_index(lower[0], lower[1], lower[2])] == SOLID ||
+             cell_types_[this->cell_index(face[0], face[1], face[2])] == SOLID;
+    }
+
+    /*! Interpolate a face velocity component and its change during projection
+     * @param position Location to sample
+     * @param axis     Velocity component
+     * @param velocity Interpolated projected velocity
+     * @param delta    Interpolated change in velocity due to projection
+     */
+    DEVICE_CALLABLE
+    void interpolate(const Vec<Real, Dim> &position, std::size_t axis, Real &velocity, Real &delta) const {
+      Vec<std::size_t, 3> base{0, 0, 0};
+      Vec<Real, 3> fraction{0.0, 0.0, 0.0};
+      for (std::size_t d = 0; d < Dim; ++d) {
+        const Real offset = (d == axis ? static_cast<Real>(1.0) : static_cast<Real>(0.5));
+        const std::size_t max_base = (d == axis ? cell_dimensions_[d] - 1 : cell_dimensions_[d] - 2);
+        Real g = position[d] / spacing_ + offset;
+        g = (g < static_cast<Real>(0.0) ? static_cast<Real>(0.0) : g);
+        std::size_t b = static_cast<std::size_t>(floor(g));
+        b = (b > max_base ? max_base : b);
+        base[d] = b;
+        const Real frac = g - static_cast<Real>(b);
+        fraction[d] = (frac > static_cast<Real>(1.0) ? static_cast<Real>(1.0) : frac);
+      }
+
+      velocity = 0.0;
+      delta = 0.0;
+      const std::size_t corner_count = (Dim == 3 ? 8 : 4);
+      for (std::size_t corner = 0; corner < corner_count; ++corner) {
+        Vec<std::size_t, 3> face = base;
+        Real weight = 1.0;
+        for (std::size_t d = 0; d < Dim; ++d) {
+          const std::size_t bit = (corner >> d) & 1;
+          face[d] += bit;
+          weight *= (bit ? fraction[d] : static_cast<Real>(1.0) - fraction[d]);
+        }
+        const std::size_t index = axis * face_count_ + this->face_index(face);
+        velocity += weight * face_velocities_[index];
+        delta += weight * (face_velocities_[index] - saved_face_velocities_[index]);
+      }
+    }
+  };
+
+}
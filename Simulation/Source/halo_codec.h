@@ -0,0 +1,314 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "dimension.h"
+#include "vec.h"
+#include "aabb.h"
+#include "particles.h"
+#include "particle_attributes.h"
+
+namespace sim {
+  /*! Compact encoding of halo particles sent to a neighboring domain
+   * Positions are fixed point relative to the sending domain bounds, 16 bits per component if the bounds
+   * fit at the requested precision and 21 otherwise. Position stars are stored as a residual from the
+   * position and levels directly. Velocities are quantized at their own precision and stored as the difference
+   * from the previous particle's quantized velocity, or sent as raw Reals if that precision is 0.
+   * Residuals, velocity differences, and levels are written as zigzag variable length integers so small
+   * magnitudes take fewer bytes.
+   */
+  template<typename Real, Dimension Dim>
+  class HaloCodec {
+  public:
+    /*! Constructor
+     * @param precision Position quantization step
+     * @param velocity_precision Velocity quantization step, 0 to send velocities exactly
+     * @param bounds Bounds of the sending domain including its halo, positions outside are clamped
+     */
+    HaloCodec(Real precision, Real velocity_precision, const AABB<Real,Dim>& bounds) :
+        precision_{precision},
+        velocity_precision_{velocity_precision},
+        bounds_(bounds),
+        position_bits_{16} {
+      if(precision_ <= 0)
+        throw std::runtime_error("Halo position precision must be positive");
+      if(velocity_precision_ < 0)
+        throw std::runtime_error("Halo velocity precision can't be negative");
+
+      double steps = 0.0;
+      for(int d=0; d<Dim; ++d)
+        steps = std::max(steps, std::ceil(static_cast<double>(bounds_.max[d] - bounds_.min[d]) / precision_));
+      if(steps >= (1 << 16))
+        position_bits_ = 21;
+      if(steps >= (1 << 21))
+        throw std::runtime_error("Halo position precision is too fine for the domain, more than 21 bits are needed");
+    }
+
+    /*! Get the fixed point bits per position component
+     * @return 16 or 21
+     */
+    int position_bits() const {
+      return position_bits_;
+    }
+
+    /*! Get the largest number of bytes a particle can encode to
+     * @return Bytes needed per particle in the worst case
+     */
+    std::size_t max_particle_bytes() const {
+      const std::size_t velocity_bytes = velocity_precision_ > 0 ? max_varint_bytes(64) : sizeof(Real);
+      return position_bytes() + Dim*(max_varint_bytes(64) + velocity_bytes) + max_varint_bytes(32);
+    }
+
+    /*! Encode a list of particles
+     * @param particles Particles to encode
+     * @param list Indices of particles to encode
+     * @param buffer Destination of the encoded particles
+     * @param capacity Bytes available in buffer
+     * @return Number of bytes written
+     */
+    std::size_t encode(Particles<Real,Dim>& particles, IndexList list, char* buffer, std::size_t capacity) const {
+      check_attributes(particles);
+      if(capacity < max_varint_bytes(64))
+        throw std::runtime_error("Not enough space to encode halo particles");
+
+      const Vec<Real,Dim>* positions = particles.positions().data();
+      const Vec<Real,Dim>* position_stars = particles.position_stars().data();
+      const Vec<Real,Dim>* velocities = particles.velocities().data();
+      const int* levels = particles.levels().data();
+
+      unsigned char* out = reinterpret_cast<unsigned char*>(buffer);
+      unsigned char* const end = out + capacity;
+      out = write_varint(out, list.count);
+
+      std::int64_t previous_velocity[Dim] = {};
+      for(std::size_t i=0; i<list.count; ++i) {
+        if(static_cast<std::size_t>(end - out) < max_particle_bytes())
+          throw std::runtime_error("Not enough space to encode halo particles");
+        const std::size_t p = list.indices[i];
+
+        std::uint64_t packed = 0;
+        std::int64_t quantized[Dim];
+        for(int d=0; d<Dim; ++d) {
+          quantized[d] = std::min<std::int64_t>(std::max<std::int64_t>(this->quantize(positions[p][d], d), 0),
+                                                max_position());
+          packed |= static_cast<std::uint64_t>(quantized[d]) << (d*position_bits_);
+        }
+        for(std::size_t b=0; b<position_bytes(); ++b)
+          *out++ = static_cast<unsigned char>(packed >> (8*b));
+
+        for(int d=0; d<Dim; ++d)
+          out = write_varint(out, zigzag(this->quantize(position_stars[p][d], d) - quantized[d]));
+
+        for(int d=0; d<Dim; ++d) {
+          if(velocity_precision_ > 0) {
+            const std::int64_t velocity = this->quantize_velocity(velocities[p][d]);
+            out = write_varint(out, zigzag(velocity - previous_velocity[d]));
+            previous_velocity[d] = velocity;
+          } else {
+            std::memcpy(out, &velocities[p][d], sizeof(Real));
+            out += sizeof(Real);
+          }
+        }
+
+        out = write_varint(out, zigzag(levels[p]));
+      }
+
+      return static_cast<std::size_t>(out - reinterpret_cast<unsigned char*>(buffer));
+    }
+
+    /*! Decode particles, appending them directly to the particle arrays
+     * @param particles Particles to append to
+     * @param buffer Particles encoded with a codec of the same precision and bounds
+     * @return Number of particles appended
+     */
+    std::size_t decode(Particles<Real,Dim>& particles, const char* buffer) const {
+      check_attributes(particles);
+
+      const unsigned char* in = reinterpret_cast<const unsigned char*>(buffer);
+      std::uint64_t count = 0;
+      in = read_varint(in, count);
+      const IndexSpan added = particles.attributes().append_defaults(count);
+
+      Vec<Real,Dim>* positions = particles.positions().data();
+      Vec<Real,Dim>* position_stars = particles.position_stars().data();
+      Vec<Real,Dim>* velocities = particles.velocities().data();
+      int* levels = particles.levels().data();
+
+      std::int64_t previous_velocity[Dim] = {};
+      for(std::size_t p=added.begin; p<added.end; ++p) {
+        std::uint64_t packed = 0;
+        for(std::size_t b=0; b<position_bytes(); ++b)
+          packed |= static_cast<std::uint64_t>(*in++) << (8*b);
+
+        std::int64_t quantized[Dim];
+        for(int d=0; d<Dim; ++d) {
+          quantized[d] = static_cast<std::int64_t>((packed >> (d*position_bits_)) & max_position());
+          positions[p][d] = this->dequantize(quantized[d], d);
+        }
+
+        for(int d=0; d<Dim; ++d) {
+          std::uint64_t residual = 0;
+          in = read_varint(in, residual);
+          position_stars[p][d] = this->dequantize(quantized[d] + unzigzag(residual), d);
+        }
+
+        for(int d=0; d<Dim; ++d) {
+          if(velocity_precision_ > 0) {
+            std::uint64_t delta = 0;
+            in = read_varint(in, delta);
+            previous_velocity[d] += unzigzag(delta);
+            velocities[p][d] = static_cast<Real>(previous_velocity[d]) * velocity_precision_;
+          } else {
+            std::memcpy(&velocities[p][d], in, sizeof(Real));
+            in += sizeof(Real);
+          }
+        }
+
+        std::uint64_t level = 0;
+        in = read_varint(in, level);
+        levels[p] = static_cast<int>(unzigzag(level));
+      }
+
+      return count;
+    }
+
+  private:
+    Real precision_;          /**< Position quantization step */
+    Real velocity_precision_; /**< Velocity quantization step, 0 if velocities are sent exactly */
+    AABB<Real,Dim> bounds_;   /**< Bounds positions are quantized relative to */
+    int position_bits_;       /**< Fixed point bits per position component */
+
+    /*! Bytes of a packed fixed point position
+     * @return Bytes holding Dim components of position_bits_
+     */
+    std::size_t position_bytes() const {
+      return (Dim*position_bits_ + 7)/8;
+    }
+
+    /*! Largest fixed point position component
+     * @return 2^position_bits_ - 1
+     */
+    std::int64_t max_position() const {
+      return (std::int64_t(1) << position_bits_) - 1;
+    }
+
+    /*! Fixed point position component, not clamped to the bounds
+     * @param x Position component
+     * @param d Axis of the component
+     * @return Quantization steps from the bounds minimum
+     */
+    std::int64_t quantize(Real x, int d) const {
+      return std::llround((x - bounds_.min[d]) / precision_);
+    }
+
+    /*! Fixed point velocity component
+     * Clamped to +-2^52 steps so differences between particles can't overflow
+     * @param v Velocity component
+     * @return Quantization steps from 0
+     */
+    std::int64_t quantize_velocity(Real v) const {
+      const double max_steps = static_cast<double>(std::int64_t(1) << 52);
+      const double steps = std::min(std::max(static_cast<double>(v) / velocity_precision_, -max_steps), max_steps);
+      return std::llround(steps);
+    }
+
+    /*! Position component of a fixed point value
+     * @param q Quantization steps from the bounds minimum
+     * @param d Axis of the component
+     * @return Position component
+     */
+    Real dequantize(std::int64_t q, int d) const {
+      return bounds_.min[d] + static_cast<Real>(q) * precision_;
+    }
+
+    /*! Throw if the halo attributes aren't the ones the codec encodes
+     * @param particles Particles whose halo attributes are checked
+     */
+    static void check_attributes(Particles<Real,Dim>& particles) {
+      if(particles.attributes().stride(ATTRIBUTE_HALO) != 3*sizeof(Vec<Real,Dim>) + sizeof(int))
+        throw std::runtime_error("Halo codec doesn't encode every halo attribute");
+    }
+
+    /*! Bytes of the longest variable length integer of a bit width
+     * @param bits Bit width of the integer
+     * @return Bytes needed in the worst case
+     */
+    static constexpr std::size_t max_varint_bytes(std::size_t bits) {
+      return (bits + 6)/7;
+    }
+
+    /*! Map signed values to unsigned so small magnitudes encode to few bytes
+     * @param value Signed value
+     * @return 0, -1, 1, -2, ... mapped to 0, 1, 2, 3, ...
+     */
+    static std::uint64_t zigzag(std::int64_t value) {
+      return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+    }
+
+    /*! Inverse of zigzag
+     * @param value Value returned by zigzag
+     * @return Signed value
+     */
+    static std::int64_t unzigzag(std::uint64_t value) {
+      return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+    }
+
+    /*! Write a variable length integer, 7 bits per byte, low bits first, the high bit set if more bytes follow
+     * @param out Destination
+     * @param value Value to write
+     * @return Pointer past the written bytes
+     */
+    static unsigned char* write_varint(unsigned char* out, std::uint64_t value) {
+      while(value >= 0x80) {
+        *out++ = static_cast<unsigned char>(value | 0x80);
+        value >>= 7;
+      }
+      *out++ = static_cast<unsigned char>(value);
+      return out;
+    }
+
+    /*! Read a variable length integer written by write_varint
+     * @param in Source
+     * @param value Set to the value read
+     * @return Pointer past the read bytes
+     */
+    static const unsigned char* read_varint(const unsigned char* in, std::uint64_t& value) {
+      value = 0;
+      int shift = 0;
+      while(*in & 0x80) {
+        value |= static_cast<std::uint64_t>(*in++ & 0x7F) << shift;
+        shift += 7;
+      }
+      value |= static_cast<std::uint64_t>(*in++) << shift;
+      return in;
+    }
+  };
+}
@@ -27,6 +27,7 @@ THE SOFTWARE.
 #include "parameters.h"
 #include "particles.h"
 #include "distributor.h"
+#include "flip_grid.h"
 
 int main(int argc, char *argv[]) {
   try {
@@ -37,6 +38,9 @@ int main(int argc, char *argv[]) {
 
     distributor.sync_from_renderer(*parameters);
 
+    // Particle storage is allocated following the configured policy
+    sim::allocation_policy() = parameters->allocation_policy();
+
     // @todo enforce dynamic construction requirement
     // The use of new isn't enforced but is required as managed memory is used
     auto particles = new sim::Particles<float, three_dimensional>(*parameters);
@@ -44,6 +48,15 @@ int main(int argc, char *argv[]) {
     // After particles have been created construct initial fluid
     distributor.initialize_fluid(*particles, *parameters);
 
+    // Every rank carves the same arrays, so one memory map describes them all
+    if(distributor.compute_rank() == 0)
+      particles->print_memory_map(std::cout);
+
+    // The hybrid solver's grid shares the particle neighbor bins
+    sim::FlipGrid<float, three_dimensional> *flip_grid = nullptr;
+    if(parameters->pressure_solver() == sim::Parameters<float, three_dimensional>::HYBRID)
+      flip_grid = new sim::FlipGrid<float, three_dimensional>(*parameters, particles->neighbors());
+
     // Sync initial particle configuration
     distributor.sync_to_renderer(*particles);
 
@@ -65,56 +78,163 @@ int main(int argc, char *argv[]) {
       if(parameters->compute_active()) {
         distributor.process_parameters(*parameters, *particles);
 
-          // Only for sim_algorithms_on_the_fly
-//        sim::algorithms::process_parameters(*parameters);
+        distributor.balance_domains(*particles, *parameters);
 
-        particles->apply_external_forces(distributor.resident_span());
+        particles->update_colliders();
 
-        particles->predict_positions(distributor.resident_span());
-
-//        distributor.balance_domains();
-
-        distributor.domain_sync(*particles);
-
-        particles->find_neighbors(distributor.local_span(),
-                                 distributor.resident_span());
+          // Only for sim_algorithms_on_the_fly
+//        sim::algorithms::process_parameters(*parameters);
 
-        for(unsigned int sub=0; sub<parameters->solve_step_count(); sub++) {
+        if(parameters->pressure_solver() == sim::Parameters<float, three_dimensional>::DFSPH) {
+          // DFSPH corrects velocities at the start of step positions
+          particles->reset_position_stars(distributor.resident_span());
+
+          distributor.initiate_domain_sync(*particles);
+          distributor.begin_compute_timing();
+
+          // Interior particles have no halo neighbors, search them while the halo is in flight
+          particles->find_neighbors(distributor.resident_span(),
+                                   distributor.interior_span());
+          distributor.finalize_domain_sync(*particles);
+
+          // A deep halo is solved redundantly instead of syncing halo values every substep
+          const auto solve_span = distributor.solve_span();
+          const bool sync_halo = !distributor.deep_halo();
+          particles->find_neighbors(distributor.local_span(),
+                                   IndexSpan{distributor.edge_span().begin, solve_span.end});
+
+          particles->compute_densities(solve_span);
+          particles->compute_dfsph_factors(solve_span);
+
+          for(unsigned int sub=0; sub<parameters->divergence_solve_step_count(); sub++) {
+            particles->compute_dfsph_divergence_kappas(solve_span);
+            if(sync_halo) {
+              distributor.initiate_sync_halo_scalar(*particles, particles->lambdas());
+              distributor.finalize_sync_halo_scalar();
+            }
+            particles->apply_dfsph_kappas(solve_span);
+            if(sync_halo) {
+              distributor.initiate_sync_halo_vec(*particles, particles->velocities());
+              distributor.finalize_sync_halo_vec();
+            }
+          }
+
+          // Gravity doesn't depend on neighbors so halo velocities are updated in place of a sync
+          particles->apply_external_forces(distributor.local_span());
+
+          for(unsigned int sub=0; sub<parameters->solve_step_count(); sub++) {
+            particles->compute_dfsph_density_kappas(solve_span);
+            if(sync_halo) {
+              distributor.initiate_sync_halo_scalar(*particles, particles->lambdas());
+              distributor.finalize_sync_halo_scalar();
+            }
+            particles->apply_dfsph_kappas(solve_span);
+            if(sync_halo) {
+              distributor.initiate_sync_halo_vec(*particles, particles->velocities());
+              distributor.finalize_sync_halo_vec();
+            }
+          }
+
+          particles->predict_positions(distributor.resident_span());
+        } else if(parameters->pressure_solver() == sim::Parameters<float, three_dimensional>::HYBRID) {
+          particles->apply_external_forces(distributor.resident_span());
+
+          particles->predict_positions(distributor.resident_span());
+
+          distributor.initiate_domain_sync(*particles);
+          distributor.begin_compute_timing();
+
+          // Interior particles have no halo neighbors, search them while the halo is in flight
+          particles->find_neighbors(distributor.resident_span(),
+                                   distributor.interior_span());
+          distributor.finalize_domain_sync(*particles);
+          particles->find_neighbors(distributor.local_span(),
+                                   distributor.edge_span());
+
+          // Bulk particles are advected by the grid, the surface band and domain edges by PBF
+          particles->classify_band(distributor.resident_span(), distributor.interior_count());
+
+          flip_grid->decompose(distributor);
+          flip_grid->particles_to_grid(*particles);
+          flip_grid->project(distributor);
+          flip_grid->grid_to_particles(*particles, particles->bulk_list());
+
+          for(unsigned int sub=0; sub<parameters->solve_step_count(); sub++) {
+            particles->compute_densities(particles->band_list());
+            particles->compute_pressure_lambdas(particles->band_list());
+            particles->compute_pressure_dps(particles->band_list(), sub);
+            particles->update_position_stars(particles->band_list(), sub);
+          }
 
           particles->compute_densities(distributor.resident_span());
-
-          particles->compute_pressure_lambdas(distributor.resident_span());
-//          distributor.initiate_sync_halo_scalar(particles->lambdas());
-//          distributor.finalize_sync_halo_scalar();
-
-          particles->compute_pressure_dps(distributor.resident_span(), sub);
-
-          particles->update_position_stars(distributor.resident_span());
-//          distributor.initiate_sync_halo_vec(particles->position_stars());
-//          distributor.finalize_sync_halo_vec();
-
-          //        particles_.compute_surface_lambdas(distributor_.local_span());
-          //        particles_.compute_surface_dps(distributor_.local_span(), sub);
+        } else {
+          particles->apply_external_forces(distributor.resident_span());
+
+          particles->predict_positions(distributor.resident_span());
+
+          distributor.initiate_domain_sync(*particles);
+          distributor.begin_compute_timing();
+
+          // Interior particles have no halo neighbors, search them while the halo is in flight
+          particles->find_neighbors(distributor.resident_span(),
+                                   distributor.interior_span());
+          distributor.finalize_domain_sync(*particles);
+
+          // A deep halo is solved redundantly instead of syncing halo values every substep
+          const auto solve_span = distributor.solve_span();
+          const bool sync_halo = !distributor.deep_halo();
+          particles->find_neighbors(distributor.local_span(),
+                                   IndexSpan{distributor.edge_span().begin, solve_span.end});
+
+          for(unsigned int sub=0; sub<parameters->solve_step_count(); sub++) {
+
+            particles->compute_densities(solve_span);
+
+            if(parameters->pressure_solver() == sim::Parameters<float, three_dimensional>::XPBD) {
+              particles->compute_xpbd_lambdas(solve_span, sub);
+              if(sync_halo) {
+                distributor.initiate_sync_halo_scalar(*particles, particles->scratch_scalar());
+                distributor.finalize_sync_halo_scalar();
+              }
+              particles->compute_xpbd_dps(solve_span);
+            } else {
+              particles->compute_pressure_lambdas(solve_span);
+              if(sync_halo) {
+                distributor.initiate_sync_halo_scalar(*particles, particles->lambdas());
+                distributor.finalize_sync_halo_scalar();
+              }
+              particles->compute_pressure_dps(solve_span, sub);
+            }
+
+            particles->update_position_stars(solve_span, sub);
+            if(sync_halo) {
+              distributor.initiate_sync_halo_vec(*particles, particles->position_stars());
+              distributor.finalize_sync_halo_vec();
+            }
+
+            //        particles_.compute_surface_lambdas(distributor_.local_span());
+            //        particles_.compute_surface_dps(distributor_.local_span(), sub);
 
 //        particles->apply_surface_tension(distributor.local_span(), distributor.resident_span());
 
+          }
         }
 
         particles->update_velocities(distributor.local_span());
 
-//        distributor.initiate_sync_halo_scalar(particles->densities());
+//        distributor.initiate_sync_halo_scalar(*particles, particles->densities());
 //        distributor.finalize_sync_halo_scalar();
 
         particles->apply_surface_tension(distributor.local_span(), distributor.resident_span());
 
         particles->apply_viscosity(distributor.resident_span());
 
-//        distributor.initiate_sync_halo_vec(particles->velocities());
+//        distributor.initiate_sync_halo_vec(*particles, particles->velocities());
 //        distributor.finalize_sync_halo_vec();
 
         particles->compute_vorticity(distributor.resident_span());
 
-//        distributor.initiate_sync_halo_vec(particles->scratch());
+//        distributor.initiate_sync_halo_vec(*particles, particles->scratch());
 //        distributor.finalize_sync_halo_vec();
 
         particles->apply_vorticity(distributor.resident_span());
@@ -123,6 +243,9 @@ int main(int argc, char *argv[]) {
 
         particles->update_positions(distributor.resident_span());
 
+        // Compute time, excluding the waits of domain and halo value syncing, is the load used to balance domains
+        distributor.end_compute_timing();
+
         // Needs to be done once per rendered frame
         if(frame % frames_per_update == 0)
           distributor.sync_to_renderer(*particles);
@@ -130,9 +253,15 @@ int main(int argc, char *argv[]) {
         frame++;
 
         distributor.invalidate_halo(*particles);
+
+        distributor.adapt_resolution(*particles);
       }
 
     }
+    if(distributor.compute_rank() == 0)
+      sim::temporary_allocator().print_statistics(std::cout);
+
+    delete flip_grid;
     delete parameters;
     delete particles;
 
@@ -65,16 +65,42 @@ namespace sim {
      * @param parameters Populated simulation parameters
      */
     Neighbors(const Parameters<Real, Dim> &parameters) : parameters_{parameters},
-                                                         bin_spacing_{parameters_.neighbor_bin_spacing()},
-                                                         bin_dimensions_{static_cast<Vec<std::size_t, Dim>>(ceil(
-                                                             (parameters.boundary().extent())
-                                                             / bin_spacing_) + static_cast<Real>(2))},
+                                                         bin_spacing_{compute_bin_spacing(parameters)},
+                                                         bin_dimensions_{compute_bin_dimensions(parameters)},
                                                          begin_indices_{product(bin_dimensions_)},
                                                          end_indices_{product(bin_dimensions_)},
                                                          bin_ids_{parameters.max_particles_local()},
                                                          particle_ids_{parameters.max_particles_local()},
                                                          neighbor_lists_{parameters.max_particles_local()} {};
 
+    /*! Constructor with storage carved from an arena
+     * @param parameters Populated simulation parameters
+     * @param arena      Arena to carve from, a sizing arena measures the storage needed
+     */
+    Neighbors(const Parameters<Real, Dim> &parameters, Arena &arena) :
+        parameters_{parameters},
+        bin_spacing_{compute_bin_spacing(parameters)},
+        bin_dimensions_{compute_bin_dimensions(parameters)},
+        begin_indices_{product(bin_dimensions_), arena, "neighbor_begin_indices"},
+        end_indices_{product(bin_dimensions_), arena, "neighbor_end_indices"},
+        bin_ids_{parameters.max_particles_local(), arena, "neighbor_bin_ids"},
+        particle_ids_{parameters.max_particles_local(), arena, "neighbor_particle_ids"},
+        neighbor_lists_{parameters.max_particles_local(), arena, "neighbor_lists"} {};
+
+    /*! Neighbor grid bin spacing for the given parameters
+     * Bins are sized for the coarsest resolution level
+     */
+    static Real compute_bin_spacing(const Parameters<Real, Dim> &parameters) {
+      return parameters.neighbor_bin_spacing() * parameters.resolution_scale(parameters.max_resolution_level());
+    }
+
+    /*! Neighbor grid dimensions for the given parameters, including the 1 bin pad on each side
+     */
+    static Vec<std::size_t, Dim> compute_bin_dimensions(const Parameters<Real, Dim> &parameters) {
+      return static_cast<Vec<std::size_t, Dim>>(ceil(parameters.boundary().extent() / compute_bin_spacing(parameters))
+                                                + static_cast<Real>(2));
+    }
+
     /*! Neighbor bins subscript operator
      */
     DEVICE_CALLABLE
@@ -191,11 +217,16 @@ namespace sim {
     }*/
 
     /*! Fill the neighbor bins in the specified particle span
+     * With adaptive resolution the bins are sized for the largest particles and each pair
+     * is tested against the average of the two particles search radii
      * @param span           particle indices in which to fill neighbors for
      * @param position_stars positions to used to calculate neighbors
+     * @param levels         particle resolution levels, nullptr if all particles are level 0
      */
-    void fill_neighbors(IndexSpan span, const Vec<Real, Dim> *position_stars) {
-      const Real valid_radius_squared = bin_spacing_ * bin_spacing_;
+    void fill_neighbors(IndexSpan span, const Vec<Real, Dim> *position_stars, const int *levels = nullptr) {
+      const Real base_radius = parameters_.neighbor_bin_spacing();
+      const Real valid_radius_squared = base_radius * base_radius;
+      const bool adaptive = (levels != nullptr && parameters_.max_resolution_level() > 0);
 
       sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t particle_index) {
         const auto position_star = position_stars[particle_index];
@@ -220,7 +251,15 @@ namespace sim {
 
             const auto neighbor_position_star = position_stars[neighbor_particle_index];
             const Real distance_squared = magnitude_squared(position_star - neighbor_position_star);
-            if (distance_squared < valid_radius_squared && list.count < MAX_NEIGHBORS) {
+
+            Real pair_radius_squared = valid_radius_squared;
+            if (adaptive) {
+              const Real pair_scale = static_cast<Real>(0.5) * (parameters_.resolution_scale(levels[particle_index]) +
+                                                                parameters_.resolution_scale(levels[neighbor_particle_index]));
+              pair_radius_squared *= pair_scale * pair_scale;
+            }
+
+            if (distance_squared < pair_radius_squared && list.count < MAX_NEIGHBORS) {
               list.neighbor_indices[list.count] = neighbor_particle_index;
               ++list.count;
             }
@@ -237,14 +276,15 @@ namespace sim {
      * @param particles_to_bin_span  Span defining the particles to place in neighbor bins
      * @param particles_to_fill_span Span defining the particles in which need a neighbor list(usually excludes halo)
      * @param coords Particle coordinates to use with particle_to_bin_span and particle_to_fill_span
+     * @param levels Particle resolution levels, nullptr if all particles are level 0
      */
     void find(const IndexSpan &particles_to_bin_span, const IndexSpan &particles_to_fill_span,
-              const Vec<Real, Dim> *coords) {
+              const Vec<Real, Dim> *coords, const int *levels = nullptr) {
       const auto particles_to_bin_count = particles_to_bin_span.end - particles_to_bin_span.begin;
       this->calculate_bins(particles_to_bin_span, coords);
       this->sort_bins(particles_to_bin_count);
       this->find_bin_bounds(particles_to_bin_count);
-      this->fill_neighbors(particles_to_fill_span, coords);
+      this->fill_neighbors(particles_to_fill_span, coords, levels);
     }
 
     /*! Neighbor grid bin dimensions
@@ -254,6 +294,34 @@ namespace sim {
       return bin_dimensions_;
     }
 
+    /*! Neighbor grid bin spacing
+     * @return Width of each neighbor bin
+     */
+    Real bin_spacing() const {
+      return bin_spacing_;
+    }
+
+    /*! Bin begin indices getter
+     * @return Reference to the index into particle_ids of the first particle in each bin
+     */
+    const sim::Array<std::size_t> &begin_indices() const {
+      return begin_indices_;
+    }
+
+    /*! Bin end indices getter
+     * @return Reference to the index into particle_ids one past the last particle in each bin
+     */
+    const sim::Array<std::size_t> &end_indices() const {
+      return end_indices_;
+    }
+
+    /*! Binned particle ids getter
+     * @return Reference to the particle indices sorted by bin
+     */
+    const sim::Array<std::size_t> &particle_ids() const {
+      return particle_ids_;
+    }
+
     /*! Default destructor
      */
     ~Neighbors() = default;
@@ -0,0 +1,471 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "vec.h"
+#include "array.h"
+#include "arena.h"
+#include "device.h"
+#include "sim_algorithms.h"
+
+#define MAX_PARTICLE_ATTRIBUTES 16
+#define MAX_ATTRIBUTE_BYTES 32
+#define MAX_PARTITION_CLASSES 32
+#define PARTITION_CHUNK_SIZE 256
+
+namespace sim {
+
+  /*! Attribute flags, select which attributes a pack or unpack pass carries
+   */
+  enum AttributeFlags : int {
+    ATTRIBUTE_LOCAL   = 0, /**< Recomputed by the owning domain every step, never communicated */
+    ATTRIBUTE_MIGRATE = 1, /**< Moves with particles that leave the domain */
+    ATTRIBUTE_HALO    = 2, /**< Sent to neighboring domains for edge particles */
+    ATTRIBUTE_ALL     = -1 /**< Selects every attribute, including local ones, never set on an attribute */
+  };
+
+  /*! Type erased view of a registered per particle array
+   */
+  struct ParticleAttribute {
+    const char *name;                                /**< Name of the attribute */
+    void *array;                                     /**< Pointer to the sim::Array<T> */
+    char *data;                                      /**< Pointer to the array elements */
+    std::size_t element_size;                        /**< sizeof(T) */
+    int flags;                                       /**< AttributeFlags combination */
+    unsigned char default_value[MAX_ATTRIBUTE_BYTES]; /**< Value of newly appended elements */
+    std::size_t (*size)(const void *array);         /**< Gets the array size */
+    void (*resize)(void *array, std::size_t size);   /**< Sets the array size without initialization */
+  };
+
+  /*! Registry of per particle arrays
+   * Every registered array is resized, permuted, packed and unpacked together so adding a particle quantity
+   * only requires registering it. Each operation is a single pass over the particles which visits all
+   * attributes of a particle before moving to the next
+   */
+  class ParticleAttributes {
+  public:
+    ParticleAttributes() : count_{0}, capacity_{0}, staging_bytes_{0}, staging_{nullptr}, order_{nullptr} {}
+
+    ParticleAttributes(const ParticleAttributes &) = delete;
+
+    ParticleAttributes &operator=(const ParticleAttributes &) = delete;
+
+    ParticleAttributes(ParticleAttributes &&) noexcept = delete;
+
+    ParticleAttributes &operator=(ParticleAttributes &&)      = delete;
+
+    /*! Register an array
+     * All arrays must have the same capacity and size and be registered before reserve()
+     * @param array         Array to register, must outlive the registry
+     * @param default_value Value of elements added by append_defaults or unpacked without this attribute
+     * @param flags         AttributeFlags combination
+     * @param name          Name of the attribute
+     */
+    template<typename T>
+    void add(sim::Array<T> &array, const T &default_value, int flags, const char *name) {
+      static_assert(sizeof(T) <= MAX_ATTRIBUTE_BYTES, "attribute element too large");
+      if (count_ == MAX_PARTICLE_ATTRIBUTES)
+        throw std::runtime_error("Too many particle attributes");
+      if (staging_)
+        throw std::runtime_error("Particle attributes must be registered before reserve");
+      if (count_ > 0 && (array.capacity() != capacity_ || array.size() != this->size()))
+        throw std::runtime_error("Particle attribute " + std::string(name) + " size mismatch");
+
+      ParticleAttribute &attribute = attributes_[count_++];
+      attribute.name = name;
+      attribute.array = &array;
+      attribute.data = reinterpret_cast<char *>(array.data());
+      attribute.element_size = sizeof(T);
+      attribute.flags = flags;
+      std::memcpy(attribute.default_value, &default_value, sizeof(T));
+      attribute.size = &array_size<T>;
+      attribute.resize = &resize_array<T>;
+      capacity_ = array.capacity();
+    }
+
+    /*! Carve the staging buffer and permutation order from the arena
+     * @param arena Arena to carve from
+     */
+    void reserve(Arena &arena) {
+      // Staging also holds the class counts of partition_three_way and the classes and chunk counts of
+      // partition_by_class
+      const std::size_t staging_stride = std::max(this->stride(), sizeof(Vec<std::size_t, 3>));
+      const std::size_t partition_bytes = (capacity_ + MAX_PARTITION_CLASSES * chunk_count(capacity_)) *
+                                          sizeof(std::size_t);
+      staging_bytes_ = std::max(capacity_ * staging_stride, partition_bytes);
+      staging_ = arena.allocate<char>(staging_bytes_, "attribute_staging");
+      order_ = arena.allocate<std::size_t>(capacity_, "attribute_order");
+    }
+
+    /*! Registered attribute count getter
+     * @return Number of registered attributes
+     */
+    std::size_t count() const {
+      return count_;
+    }
+
+    /*! Registered attribute getter
+     * @param i Index of the attribute
+     * @return Reference to the attribute
+     */
+    const ParticleAttribute &operator[](std::size_t i) const {
+      return attributes_[i];
+    }
+
+    /*! Current particle count getter
+     * @return Size of the registered arrays
+     */
+    std::size_t size() const {
+      return count_ ? attributes_[0].size(attributes_[0].array) : 0;
+    }
+
+    /*! Bytes per particle of the attributes with any of the given flags
+     * @param flags AttributeFlags to select, ATTRIBUTE_ALL selects every attribute
+     * @return Number of bytes per packed particle
+     */
+    std::size_t stride(int flags = ATTRIBUTE_ALL) const {
+      std::size_t bytes = 0;
+      for (std::size_t a = 0; a < count_; ++a) {
+        if (selected(attributes_[a], flags))
+          bytes += attributes_[a].element_size;
+      }
+      return bytes;
+    }
+
+    /*! Staging buffer getter, used by permute and as the packed communication buffer
+     * The buffer holds capacity particles of stride() bytes
+     * @return Pointer to the staging buffer
+     */
+    char *staging() {
+      return staging_;
+    }
+
+    /*! Staging buffer size getter
+     * @return Number of bytes in the staging buffer
+     */
+    std::size_t staging_bytes() const {
+      return staging_bytes_;
+    }
+
+    /*! Permutation order getter
+     * Between permutations the order may be used as capacity indices of scratch, such as for index lists
+     * @return Pointer to the order
+     */
+    std::size_t *order() {
+      return order_;
+    }
+
+    /*! Reset the permutation order to the identity
+     * @param count Number of order entries to reset
+     * @return Pointer to the order, order[i] is the source index of destination i for permute
+     */
+    std::size_t *reset_order(std::size_t count) {
+      std::size_t *order = order_;
+      sim::algorithms::for_each_index(IndexSpan{0, count}, [=] DEVICE_CALLABLE(std::size_t i) {
+        order[i] = i;
+      });
+      return order_;
+    }
+
+    /*! Remove particles from the end of every array
+     * @param count Number of particles to remove
+     */
+    void erase_tail(std::size_t count) {
+      const std::size_t size = this->size();
+      if (count > size)
+        throw std::runtime_error("Particle attributes erased more elements than their size");
+      this->resize_all(size - count);
+    }
+
+    /*! Append particles with every attribute set to its default value
+     * @param count Number of particles to append
+     * @return Span of the appended particles
+     */
+    IndexSpan append_defaults(std::size_t count) {
+      return this->unpack(ATTRIBUTE_ALL, nullptr, count);
+    }
+
+    /*! Stable three way partition of particles
+     * Each particle is classified once, the class offsets come from a single prefix sum of one hot counts,
+     * and the permutation order is scattered such that permute(span) arranges the span as {0, 1, 2}
+     * @param span       Span of particles to partition
+     * @param classifier Function taking a particle index and returning its class: 0, 1, or 2
+     * @return Number of particles in each class
+     */
+    template<typename Classifier>
+    Vec<std::size_t, 3> partition_three_way(IndexSpan span, Classifier classifier) {
+      typedef Vec<std::size_t, 3> Counts;
+      const std::size_t count = span.end - span.begin;
+      if (count == 0)
+        return Counts{static_cast<std::size_t>(0)};
+
+      Counts *counts = reinterpret_cast<Counts *>(staging_);
+      std::size_t *order = order_;
+      const std::size_t begin = span.begin;
+
+      sim::algorithms::for_each_index(IndexSpan{0, count}, [=] DEVICE_CALLABLE(std::size_t i) {
+        Counts one_hot{static_cast<std::size_t>(0)};
+        one_hot[classifier(begin + i)] = 1;
+        counts[i] = one_hot;
+      });
+
+      const Counts last = counts[count - 1];
+      sim::algorithms::exclusive_scan(counts, counts + count, counts);
+      const Counts totals = counts[count - 1] + last;
+      const Counts offsets{0, totals[0], totals[0] + totals[1]};
+
+      // The class of i is the count which increments between i and i + 1
+      sim::algorithms::for_each_index(IndexSpan{0, count}, [=] DEVICE_CALLABLE(std::size_t i) {
+        const Counts current = counts[i];
+        const Counts next = (i + 1 < count ? counts[i + 1] : totals);
+        const int c = (next[0] != current[0] ? 0 : (next[1] != current[1] ? 1 : 2));
+        order[offsets[c] + current[c]] = begin + i;
+      });
+
+      return totals;
+    }
+
+    /*! Stable partition of particles into many classes
+     * The span is split into chunks of PARTITION_CHUNK_SIZE particles. Each particle is classified once while
+     * its chunk counts its classes, a single prefix sum of the class major chunk counts gives every chunk the
+     * offset of its first particle of each class, and the permutation order is scattered such that
+     * permute(span) arranges the span by increasing class. partition_three_way should be preferred for three
+     * or fewer classes
+     * @param span        Span of particles to partition
+     * @param class_count Number of classes, at most MAX_PARTITION_CLASSES
+     * @param classifier  Function taking a particle index and returning its class in [0, class_count)
+     * @return Pointer to class_count + 1 offsets, class c occupies [offsets[c], offsets[c+1]) of the span
+     */
+    template<typename Classifier>
+    const std::size_t *partition_by_class(IndexSpan span, std::size_t class_count, Classifier classifier) {
+      if (class_count > MAX_PARTITION_CLASSES)
+        throw std::runtime_error("Too many partition classes");
+
+      const std::size_t count = span.end - span.begin;
+      const std::size_t chunks = chunk_count(count);
+      std::size_t *classes = reinterpret_cast<std::size_t *>(staging_);
+      std::size_t *chunk_offsets = classes + count;
+      std::size_t *order = order_;
+      const std::size_t begin = span.begin;
+
+      sim::algorithms::for_each_index(IndexSpan{0, chunks}, [=] DEVICE_CALLABLE(std::size_t k) {
+        for (std::size_t c = 0; c < class_count; ++c)
+          chunk_offsets[c * chunks + k] = 0;
+        const std::size_t end = ((k + 1) * PARTITION_CHUNK_SIZE < count ? (k + 1) * PARTITION_CHUNK_SIZE : count);
+        for (std::size_t i = k * PARTITION_CHUNK_SIZE; i < end; ++i) {
+          const std::size_t c = classifier(begin + i);
+          classes[i] = c;
+          ++chunk_offsets[c * chunks + k];
+        }
+      });
+
+      sim::algorithms::exclusive_scan(chunk_offsets, chunk_offsets + class_count * chunks, chunk_offsets);
+      for (std::size_t c = 0; c < class_count; ++c)
+        class_offsets_[c] = (chunks ? chunk_offsets[c * chunks] : 0);
+      class_offsets_[class_count] = count;
+
+      // Chunks scatter in order, and so stably, to the offsets of their classes
+      sim::algorithms::for_each_index(IndexSpan{0, chunks}, [=] DEVICE_CALLABLE(std::size_t k) {
+        const std::size_t end = ((k + 1) * PARTITION_CHUNK_SIZE < count ? (k + 1) * PARTITION_CHUNK_SIZE : count);
+        for (std::size_t i = k * PARTITION_CHUNK_SIZE; i < end; ++i)
+          order[chunk_offsets[classes[i] * chunks + k]++] = begin + i;
+      });
+
+      return class_offsets_;
+    }
+
+    /*! Partition particles into an unbounded number of classes by sorting the class keys
+     * @param span          Span of particles to partition
+     * @param class_count   Number of classes
+     * @param classifier    Function taking a particle index and returning its class in [0, class_count)
+     * @param class_offsets Device accessible destination for class_count + 1 offsets
+     */
+    template<typename Classifier>
+    void partition_by_class(IndexSpan span, std::size_t class_count, Classifier classifier,
+                            std::size_t *class_offsets) {
+      const std::size_t count = span.end - span.begin;
+      std::size_t *keys = reinterpret_cast<std::size_t *>(staging_);
+      std::size_t *order = order_;
+      const std::size_t begin = span.begin;
+
+      sim::algorithms::for_each_index(IndexSpan{0, count}, [=] DEVICE_CALLABLE(std::size_t i) {
+        keys[i] = classifier(begin + i);
+        order[i] = begin + i;
+      });
+      sim::algorithms::sort_by_key(keys, keys + count, order);
+      sim::algorithms::lower_bound(keys, keys + count, IndexSpan{0, class_count + 1}, class_offsets);
+    }
+
+    /*! Permute particles such that span.begin + i receives particle order[i]
+     * The order must have been filled, typically by partitioning the result of reset_order
+     * @param span Span of particles to permute, the order indices are absolute particle indices
+     */
+    void permute(IndexSpan span) {
+      const std::size_t *order = order_;
+      const std::size_t begin = span.begin;
+      const std::size_t stride = this->stride();
+
+      // Gather into the staging buffer then copy back, both passes visit all attributes of a particle at once
+      sim::algorithms::for_each_index(IndexSpan{0, span.end - span.begin}, [=] DEVICE_CALLABLE(std::size_t i) {
+        char *packed = staging_ + i * stride;
+        const std::size_t p = order[i];
+        for (std::size_t a = 0; a < count_; ++a) {
+          const std::size_t size = attributes_[a].element_size;
+          std::memcpy(packed, attributes_[a].data + p * size, size);
+          packed += size;
+        }
+      });
+
+      sim::algorithms::for_each_index(IndexSpan{0, span.end - span.begin}, [=] DEVICE_CALLABLE(std::size_t i) {
+        const char *packed = staging_ + i * stride;
+        const std::size_t p = begin + i;
+        for (std::size_t a = 0; a < count_; ++a) {
+          const std::size_t size = attributes_[a].element_size;
+          std::memcpy(attributes_[a].data + p * size, packed, size);
+          packed += size;
+        }
+      });
+    }
+
+    /*! Pack the attributes with any of flags for a span of particles
+     * @param flags  AttributeFlags to pack, ATTRIBUTE_ALL packs every attribute
+     * @param span   Span of particles to pack
+     * @param buffer Destination holding at least span count * stride(flags) bytes
+     */
+    void pack(int flags, IndexSpan span, char *buffer) const {
+      const std::size_t stride = this->stride(flags);
+      const std::size_t begin = span.begin;
+      sim::algorithms::for_each_index(IndexSpan{0, span.end - span.begin}, [=] DEVICE_CALLABLE(std::size_t i) {
+        char *packed = buffer + i * stride;
+        const std::size_t p = begin + i;
+        for (std::size_t a = 0; a < count_; ++a) {
+          if (!selected(attributes_[a], flags))
+            continue;
+          const std::size_t size = attributes_[a].element_size;
+          std::memcpy(packed, attributes_[a].data + p * size, size);
+          packed += size;
+        }
+      });
+    }
+
+    /*! Pack the attributes with any of flags for a list of particles
+     * @param flags  AttributeFlags to pack, ATTRIBUTE_ALL packs every attribute
+     * @param list   Indices of particles to pack
+     * @param buffer Destination holding at least list count * stride(flags) bytes
+     */
+    void pack(int flags, IndexList list, char *buffer) const {
+      const std::size_t stride = this->stride(flags);
+      const std::size_t *indices = list.indices;
+      sim::algorithms::for_each_index(IndexSpan{0, list.count}, [=] DEVICE_CALLABLE(std::size_t i) {
+        char *packed = buffer + i * stride;
+        const std::size_t p = indices[i];
+        for (std::size_t a = 0; a < count_; ++a) {
+          if (!selected(attributes_[a], flags))
+            continue;
+          const std::size_t size = attributes_[a].element_size;
+          std::memcpy(packed, attributes_[a].data + p * size, size);
+          packed += size;
+        }
+      });
+    }
+
+    /*! Append particles from a packed buffer, attributes without any of flags are set to their default value
+     * @param flags  AttributeFlags the buffer was packed with
+     * @param buffer Source packed by pack() with the same flags, may be nullptr if count is 0 or flags select nothing
+     * @param count  Number of particles to append
+     * @return Span of the appended particles
+     */
+    IndexSpan unpack(int flags, const char *buffer, std::size_t count) {
+      const std::size_t begin = this->size();
+      if (count > capacity_ - begin)
+        throw std::runtime_error("Not enough capacity to add particles");
+      this->resize_all(begin + count);
+
+      const std::size_t stride = this->stride(flags);
+      sim::algorithms::for_each_index(IndexSpan{0, count}, [=] DEVICE_CALLABLE(std::size_t i) {
+        const char *packed = buffer ? buffer + i * stride : nullptr;
+        const std::size_t p = begin + i;
+        for (std::size_t a = 0; a < count_; ++a) {
+          const std::size_t size = attributes_[a].element_size;
+          if (packed && selected(attributes_[a], flags)) {
+            std::memcpy(attributes_[a].data + p * size, packed, size);
+            packed += size;
+          } else {
+            std::memcpy(attributes_[a].data + p * size, attributes_[a].default_value, size);
+          }
+        }
+      });
+
+      return IndexSpan{begin, begin + count};
+    }
+
+    /*! Check if an attribute is selected by flags
+     * @param attribute Attribute to check
+     * @param flags     AttributeFlags to select, ATTRIBUTE_ALL selects every attribute and ATTRIBUTE_LOCAL none
+     * @return True if the attribute has any of flags
+     */
+    DEVICE_CALLABLE
+    static bool selected(const ParticleAttribute &attribute, int flags) {
+      return flags == ATTRIBUTE_ALL || (attribute.flags & flags);
+    }
+
+  private:
+    /*! Number of partition_by_class chunks covering a count of particles
+     */
+    static std::size_t chunk_count(std::size_t count) {
+      return (count + PARTITION_CHUNK_SIZE - 1) / PARTITION_CHUNK_SIZE;
+    }
+
+    template<typename T>
+    static std::size_t array_size(const void *array) {
+      return static_cast<const sim::Array<T> *>(array)->size();
+    }
+
+    template<typename T>
+    static void resize_array(void *array, std::size_t size) {
+      static_cast<sim::Array<T> *>(array)->resize_uninitialized(size);
+    }
+
+    void resize_all(std::size_t size) {
+      for (std::size_t a = 0; a < count_; ++a)
+        attributes_[a].resize(attributes_[a].array, size);
+    }
+
+  public:
+    // @todo DEVICE_CALLABLE lambdas can't access private members
+    ParticleAttribute attributes_[MAX_PARTICLE_ATTRIBUTES]; /**< Registered attributes */
+    std::size_t count_;                                     /**< Number of registered attributes */
+    std::size_t capacity_;                                  /**< Capacity shared by the registered arrays */
+    std::size_t staging_bytes_;                             /**< Size of staging_ */
+    char *staging_;                                         /**< At least capacity_ * stride() bytes of scratch */
+    std::size_t *order_;                                    /**< capacity_ permutation indices */
+    std::size_t class_offsets_[MAX_PARTITION_CLASSES + 1];  /**< Class offsets from partition_by_class */
+  };
+}
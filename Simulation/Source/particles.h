@@ -30,10 +30,14 @@ THE SOFTWARE.
 #include "array.h"
 #include "parameters.h"
 #include "neighbors.h"
+#include "signed_distance_field.h"
+#include "colliders.h"
+#include "particle_attributes.h"
 #include "kernels.h"
 #include "device.h"
 #include "sim_algorithms.h"
 #include <limits>
+#include <algorithm>
 
 /*! Class to handle 2D and 3D PBD fluid particle physics
  */
@@ -41,25 +45,107 @@ namespace sim {
   template<typename Real, Dimension Dim>
   class Particles : public ManagedAllocation {
   public:
-    /*! Constructor: allocates maximum particle storage
+    /*! Constructor: reserves maximum particle storage in a single arena
      * @param Parameters Reference to global simulation parameters
      */
     Particles(const Parameters<Real, Dim> &parameters) :
         parameters_{parameters},
         max_local_count_{parameters.max_particles_local()},
-        neighbors_{parameters},
-        positions_{max_local_count_},
-        position_stars_{max_local_count_},
-        velocities_{max_local_count_},
-        densities_{max_local_count_},
-        lambdas_{max_local_count_},
-        scratch_{max_local_count_},
-        scratch_scalar_{max_local_count_} {};
+        arena_{storage_bytes(parameters)},
+        neighbors_{parameters, arena_},
+        boundary_sdf_{parameters},
+        colliders_{parameters, boundary_sdf_},
+        positions_{max_local_count_, arena_, "positions"},
+        position_stars_{max_local_count_, arena_, "position_stars"},
+        velocities_{max_local_count_, arena_, "velocities"},
+        densities_{max_local_count_, arena_, "densities"},
+        lambdas_{max_local_count_, arena_, "lambdas"},
+        scratch_{max_local_count_, arena_, "scratch"},
+        scratch_scalar_{max_local_count_, arena_, "scratch_scalar"},
+        position_star_history_{max_local_count_, arena_, "position_star_history"},
+        levels_{max_local_count_, arena_, "levels"},
+        depths_{max_local_count_, arena_, "depths"},
+        partners_{max_local_count_, arena_, "partners"},
+        surface_indices_{max_local_count_, arena_, "surface_indices"},
+        surface_count_{0},
+        band_indices_{max_local_count_, arena_, "band_indices"},
+        bulk_indices_{max_local_count_, arena_, "bulk_indices"},
+        band_count_{0},
+        bulk_count_{0} {
+      const Vec<Real, Dim> zero{0.0};
+      attributes_.add(positions_, zero, ATTRIBUTE_MIGRATE | ATTRIBUTE_HALO, "positions");
+      attributes_.add(position_stars_, zero, ATTRIBUTE_MIGRATE | ATTRIBUTE_HALO, "position_stars");
+      attributes_.add(velocities_, zero, ATTRIBUTE_MIGRATE | ATTRIBUTE_HALO, "velocities");
+      attributes_.add(levels_, 0, ATTRIBUTE_MIGRATE | ATTRIBUTE_HALO, "levels");
+      attributes_.add(densities_, (Real) 0.0, ATTRIBUTE_LOCAL, "densities");
+      attributes_.add(lambdas_, (Real) 0.0, ATTRIBUTE_LOCAL, "lambdas");
+      attributes_.add(scratch_, zero, ATTRIBUTE_LOCAL, "scratch");
+      attributes_.add(scratch_scalar_, (Real) 0.0, ATTRIBUTE_LOCAL, "scratch_scalar");
+      attributes_.add(position_star_history_, zero, ATTRIBUTE_LOCAL, "position_star_history");
+      attributes_.add(depths_, static_cast<std::size_t>(0), ATTRIBUTE_LOCAL, "depths");
+      attributes_.add(partners_, static_cast<std::size_t>(0), ATTRIBUTE_LOCAL, "partners");
+      attributes_.reserve(arena_);
+
+      // storage_bytes mirrors the carves above, a mismatch means the two have drifted apart
+      if (arena_.used_bytes() != arena_.reserved_bytes())
+        throw std::runtime_error("particle arena carves don't match Particles::storage_bytes");
+    };
 
     /*! Default destructor
      */
     ~Particles() = default;
 
+    /*! Arena bytes to reserve for the given parameters
+     * Measured by carving the constructor's arrays, in the same order, from a sizing arena so alignment padding
+     * and the attribute staging stride are exact
+     * @param parameters Populated simulation parameters
+     * @return Number of bytes to reserve
+     */
+    static std::size_t storage_bytes(const Parameters<Real, Dim> &parameters) {
+      const std::size_t count = parameters.max_particles_local();
+      Arena sizing;
+      Neighbors<Real, Dim> neighbors{parameters, sizing};
+      sim::Array<Vec<Real, Dim>> positions{count, sizing, "positions"};
+      sim::Array<Vec<Real, Dim>> position_stars{count, sizing, "position_stars"};
+      sim::Array<Vec<Real, Dim>> velocities{count, sizing, "velocities"};
+      sim::Array<Real> densities{count, sizing, "densities"};
+      sim::Array<Real> lambdas{count, sizing, "lambdas"};
+      sim::Array<Vec<Real, Dim>> scratch{count, sizing, "scratch"};
+      sim::Array<Real> scratch_scalar{count, sizing, "scratch_scalar"};
+      sim::Array<Vec<Real, Dim>> position_star_history{count, sizing, "position_star_history"};
+      sim::Array<int> levels{count, sizing, "levels"};
+      sim::Array<std::size_t> depths{count, sizing, "depths"};
+      sim::Array<std::size_t> partners{count, sizing, "partners"};
+      sim::Array<std::size_t> surface_indices{count, sizing, "surface_indices"};
+      sim::Array<std::size_t> band_indices{count, sizing, "band_indices"};
+      sim::Array<std::size_t> bulk_indices{count, sizing, "bulk_indices"};
+
+      // Only the element sizes of the registered attributes matter for the staging stride
+      const Vec<Real, Dim> zero{0.0};
+      ParticleAttributes attributes;
+      attributes.add(positions, zero, ATTRIBUTE_MIGRATE | ATTRIBUTE_HALO, "positions");
+      attributes.add(position_stars, zero, ATTRIBUTE_MIGRATE | ATTRIBUTE_HALO, "position_stars");
+      attributes.add(velocities, zero, ATTRIBUTE_MIGRATE | ATTRIBUTE_HALO, "velocities");
+      attributes.add(levels, 0, ATTRIBUTE_MIGRATE | ATTRIBUTE_HALO, "levels");
+      attributes.add(densities, (Real) 0.0, ATTRIBUTE_LOCAL, "densities");
+      attributes.add(lambdas, (Real) 0.0, ATTRIBUTE_LOCAL, "lambdas");
+      attributes.add(scratch, zero, ATTRIBUTE_LOCAL, "scratch");
+      attributes.add(scratch_scalar, (Real) 0.0, ATTRIBUTE_LOCAL, "scratch_scalar");
+      attributes.add(position_star_history, zero, ATTRIBUTE_LOCAL, "position_star_history");
+      attributes.add(depths, static_cast<std::size_t>(0), ATTRIBUTE_LOCAL, "depths");
+      attributes.add(partners, static_cast<std::size_t>(0), ATTRIBUTE_LOCAL, "partners");
+      attributes.reserve(sizing);
+
+      return sizing.used_bytes();
+    }
+
+    /*! Write the particle storage memory map
+     * @param stream Stream to write to
+     */
+    void print_memory_map(std::ostream &stream) const {
+      arena_.print_memory_map(stream);
+    }
+
     Particles() = delete;
 
     Particles(const Particles &) = delete;
@@ -110,11 +196,21 @@ namespace sim {
      */
     sim::Array<Real> &lambdas() { return lambdas_; }
 
+    /*! Resolution levels getter
+       @return Reference to resolution levels array
+     */
+    sim::Array<int> &levels() { return levels_; }
+
     /*! Scratch getter
        @return Reference to scratch array
      */
     sim::Array<Vec<Real, Dim>> &scratch() { return scratch_; }
 
+    /*! Scalar scratch getter
+       @return Reference to scalar scratch array
+     */
+    sim::Array<Real> &scratch_scalar() { return scratch_scalar_; }
+
     /*! Positions getter
        @return Reference to positions array
      */
@@ -135,6 +231,11 @@ namespace sim {
      */
     const sim::Array<Real> &densities() const { return densities_; }
 
+    /*! Resolution levels getter
+       @return Reference to resolution levels array
+     */
+    const sim::Array<int> &levels() const { return levels_; }
+
     /*! Scratch getter
        @return Reference to scratch array
      */
@@ -144,35 +245,20 @@ namespace sim {
      * @param count Number of particles to remove from end of array
      */
     void remove(std::size_t count) {
-      positions_.pop_back(count);
-      position_stars_.pop_back(count);
-      velocities_.pop_back(count);
-      densities_.pop_back(count);
-      lambdas_.pop_back(count);
-      scratch_.pop_back(count);
-      scratch_scalar_.pop_back(count);
+      attributes_.erase_tail(count);
     }
 
     /*! Add particle to end of array
      * @param positions      Reference to position to add
      * @param position_stars Reference to position_star to add
      * @param velocities     Reference to velocity to add
+     * @param level          Resolution level of the particle
      */
     void add(const Vec<Real, Dim> &position,
              const Vec<Real, Dim> &position_star,
-             const Vec<Real, Dim> &velocity) {
-
-      // @todo: Should assert all are same size
-      // @todo: Should assert there is enough space
-
-      positions_.push_back(position);
-      position_stars_.push_back(position_star);
-      velocities_.push_back(velocity);
-
-      densities_.push_back((Real) 0.0);
-      lambdas_.push_back((Real) 0.0);
-      scratch_.push_back(Vec<Real, Dim>{0.0});
-      scratch_scalar_.push_back((Real) 0.0);
+             const Vec<Real, Dim> &velocity,
+             const int level = 0) {
+      this->add(&position, &position_star, &velocity, 1, &level);
     }
 
     /*! Add array of particles to end of array
@@ -180,73 +266,60 @@ namespace sim {
      * @param position_stars Pointer to beginning of position_stars to add
      * @param velocities     Pointer to beginning of velocities to add
      * @param count          Number of particles to add
+     * @param levels         Pointer to beginning of resolution levels to add, nullptr for level 0
      */
     void add(const Vec<Real, Dim> *positions,
              const Vec<Real, Dim> *position_stars,
              const Vec<Real, Dim> *velocities,
-             std::size_t count) {
-
-      // @todo: Should assert there is enough space
-
-      positions_.push_back(positions, count);
-      position_stars_.push_back(position_stars, count);
-      velocities_.push_back(velocities, count);
-
-      densities_.push_back((Real) 0.0, count);
-      lambdas_.push_back((Real) 0.0, count);
-      scratch_.push_back(Vec<Real, Dim>{0.0}, count);
-      scratch_scalar_.push_back((Real) 0.0, count);
+             std::size_t count,
+             const int *levels = nullptr) {
+
+      // Source pointers may be host memory so are copied on the host
+      const std::size_t begin = attributes_.append_defaults(count).begin;
+      std::copy(positions, positions + count, positions_.data() + begin);
+      std::copy(position_stars, position_stars + count, position_stars_.data() + begin);
+      std::copy(velocities, velocities + count, velocities_.data() + begin);
+      std::copy(position_stars, position_stars + count, position_star_history_.data() + begin);
+      if (levels)
+        std::copy(levels, levels + count, levels_.data() + begin);
     }
 
-    /*! Construct fluid volume, filling 2D aabb
-     * @param aabb     Axis aligned bounding box area to fill with particles
+    /*! Construct fluid volume, filling aabb
+     * Particles are placed at the centers of a rest spacing lattice anchored at aabb.min. The arrays are
+     * sized once and the lattice is filled in parallel, particle order is x fastest
+     * @param aabb     Axis aligned bounding box to fill with particles
      * @param velocity Initial particle velocity
      * @return         Number of particles added
      */
-    std::size_t construct_fluid(const AABB<Real, 2> &aabb,
+    std::size_t construct_fluid(const AABB<Real, Dim> &aabb,
                                 const Vec<Real, Dim> velocity = Vec<Real, Dim>{(Real) 0.0}) {
       // |--|--|--|
       // -o--o--o-
-      Vec<std::size_t, Dim> particle_counts = bin_count_in_volume(aabb, parameters_.particle_rest_spacing());
-
-      for (std::size_t y = 0; y < particle_counts[1]; ++y) {
-        for (std::size_t x = 0; x < particle_counts[0]; ++x) {
-          Vec<std::size_t, 2> int_coord{x, y};
-          Vec<Real, Dim> coord = static_cast< Vec<Real, Dim> >(int_coord) *
-                                 parameters_.particle_rest_spacing() +
-                                 aabb.min;
-          coord += parameters_.particle_rest_spacing() / static_cast<Real>(2.0);
-          this->add(coord, coord, velocity);
-        }  // x
-      } // y
-
-      return product(particle_counts);
-    }
+      const Real spacing = parameters_.particle_rest_spacing();
+      const Vec<std::size_t, Dim> particle_counts = bin_count_in_volume(aabb, spacing);
+      const std::size_t count = product(particle_counts);
+      if (count == 0)
+        return 0;
+      if (count > positions_.available())
+        throw std::runtime_error("Not enough capacity to construct fluid");
+
+      const std::size_t begin = this->local_count();
+      this->add_copies(Vec<Real, Dim>{0.0}, Vec<Real, Dim>{0.0}, velocity, count);
+
+      const Vec<Real, Dim> origin = aabb.min + spacing / static_cast<Real>(2.0);
+      sim::algorithms::for_each_index(IndexSpan{begin, begin + count}, [=] DEVICE_CALLABLE(std::size_t p) {
+        std::size_t remainder = p - begin;
+        Vec<Real, Dim> coord;
+        for (std::size_t d = 0; d < Dim; ++d) {
+          coord[d] = origin[d] + static_cast<Real>(remainder % particle_counts[d]) * spacing;
+          remainder /= particle_counts[d];
+        }
+        positions_[p] = coord;
+        position_stars_[p] = coord;
+        position_star_history_[p] = coord;
+      });
 
-    /*! Construct fluid volume, filling 3D aabb
-     * @param aabb     Axis aligned bounding box volume to fill with particles
-     * @param velocity Initial particle velocity
-     * @return         Number of particles added
-     */
-    std::size_t construct_fluid(const AABB<Real, 3> &aabb,
-                                const Vec<Real, Dim> velocity = Vec<Real, Dim>{(Real) 0.0}) {
-      // |--|--|--|
-      // -o--o--o-
-      Vec<std::size_t, Dim> particle_counts = bin_count_in_volume(aabb, parameters_.particle_rest_spacing());
-
-      for (std::size_t z = 0; z < particle_counts[2]; ++z) {
-        for (std::size_t y = 0; y < particle_counts[1]; ++y) {
-          for (std::size_t x = 0; x < particle_counts[0]; ++x) {
-            Vec<std::size_t, 3> int_coord{x, y, z};
-            Vec<Real, Dim> coord = static_cast< Vec<Real, Dim> >(int_coord) *
-                                   parameters_.particle_rest_spacing() +
-                                   aabb.min;
-            coord += parameters_.particle_rest_spacing() / static_cast<Real>(2.0);
-            this->add(coord, coord, velocity);
-          }  // x
-        } // y
-      } // z
-      return product(particle_counts);
+      return count;
     }
 
     /*! Find particle neighbors
@@ -254,7 +327,7 @@ namespace sim {
      * @param to_fill_span Span defining the particles in which need a neighbor list(usually excludes halo)
      */
     void find_neighbors(IndexSpan to_bin_span, IndexSpan to_fill_span) {
-      neighbors_.find(to_bin_span, to_fill_span, position_stars_.data());
+      neighbors_.find(to_bin_span, to_fill_span, position_stars_.data(), levels_.data());
     }
 
     /*! Apply external forces to particles
@@ -281,22 +354,81 @@ namespace sim {
         auto position_star_p = position_p + (velocity * dt);
 
         apply_boundary_conditions(position_star_p,
-                                  parameters_);
+                                  parameters_,
+                                  colliders_);
         position_stars_[p] = position_star_p;
       });
     }
 
+    /*! Particle mass relative to the rest mass
+     * Each resolution level doubles the particle mass
+     * @param p Particle index
+     * @return mass of particle p divided by the rest mass
+     */
+    DEVICE_CALLABLE
+    Real relative_mass(const std::size_t p) const {
+      return ldexp(static_cast<Real>(1.0), levels_[p]);
+    }
+
+    /*! Kernel length scale for a particle pair
+     * A pair uses the average of the two particles smoothing radii, h_pq.
+     * @param p Particle index
+     * @param q Neighbor particle index
+     * @return h / h_pq, where h is the level 0 smoothing radius
+     */
+    DEVICE_CALLABLE
+    Real kernel_scale(const std::size_t p, const std::size_t q) const {
+      return static_cast<Real>(2.0) / (parameters_.resolution_scale(levels_[p]) +
+                                       parameters_.resolution_scale(levels_[q]));
+    }
+
+    /*! Evaluate a level 0 kernel for a particle pair
+     * W_hpq(r) = s^Dim * W_h(s * r) with s = h / h_pq
+     * @param W Kernel constructed with the level 0 smoothing radius
+     * @param p Particle index
+     * @param q Neighbor particle index
+     * @return kernel value for the pair
+     */
+    template<typename Kernel>
+    DEVICE_CALLABLE
+    Real pair_kernel(const Kernel &W, const std::size_t p, const std::size_t q) const {
+      const Real r_mag = magnitude(position_stars_[p] - position_stars_[q]);
+      if (levels_[p] == 0 && levels_[q] == 0)
+        return W(r_mag);
+
+      const Real s = this->kernel_scale(p, q);
+      return pow(s, static_cast<Real>(Dim)) * W(s * r_mag);
+    }
+
+    /*! Evaluate a level 0 kernel gradient for a particle pair
+     * Del_W_hpq(r) = s^(Dim+1) * Del_W_h(s * r) with s = h / h_pq
+     * @param Del_W Kernel gradient constructed with the level 0 smoothing radius
+     * @param p     Particle index
+     * @param q     Neighbor particle index
+     * @return kernel gradient for the pair
+     */
+    template<typename Kernel>
+    DEVICE_CALLABLE
+    Vec<Real, Dim> pair_gradient(const Kernel &Del_W, const std::size_t p, const std::size_t q) const {
+      if (levels_[p] == 0 && levels_[q] == 0)
+        return Del_W(position_stars_[p], position_stars_[q]);
+
+      const Real s = this->kernel_scale(p, q);
+      return pow(s, static_cast<Real>(Dim + 1)) * Del_W(s * position_stars_[p], s * position_stars_[q]);
+    }
+
     /*! Compute particle densities
-     * @param span Particles over which to compute densities for
+     * @param span Particles over which to compute densities for, IndexSpan or IndexList
      */
-    void compute_densities(IndexSpan span) {
+    template<typename Indices>
+    void compute_densities(Indices span) {
       const Poly6<Real, Dim> W{parameters_.smoothing_radius()};
       const Real W_0 = W(static_cast<Real>(0.0));
 
       const Real mass = parameters_.rest_mass();
       sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
         // Own contribution to density
-        Real density = mass * W_0;
+        Real density = (levels_[p] == 0 ? mass * W_0 : mass * relative_mass(p) * pair_kernel(W, p, p));
 
         for (const std::size_t q : neighbors_[p]) {
 
@@ -304,18 +436,17 @@ namespace sim {
           if (magnitude(position_stars_[p] - position_stars_[q]) < 0.00000001)
             position_stars_[p] -= velocities_[p] * parameters_.time_step() / (Real) 50.0;
 
-          const Real r_mag = magnitude(position_stars_[p] - position_stars_[q]);
-
-          density += mass * W(r_mag);
+          density += mass * relative_mass(q) * pair_kernel(W, p, q);
         }
         densities_[p] = density;
       });
     }
 
     /*! Compute pressure lambdas
-     * @param span Span over which to calculate lambas for
+     * @param span Span over which to calculate lambas for, IndexSpan or IndexList
      */
-    void compute_pressure_lambdas(IndexSpan span) {
+    template<typename Indices>
+    void compute_pressure_lambdas(Indices span) {
       const Del_Spikey<Real, Dim> Del_W{parameters_.smoothing_radius()};
 
       sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
@@ -329,7 +460,7 @@ namespace sim {
         for (const std::size_t q : neighbors_[p]) {
           const Real density_0 = parameters_.rest_density();
           // Can pull density_0 down below so it's not in inner loop
-          const Vec<Real, Dim> gradient = (Real) -1.0 / density_0 * Del_W(position_stars_[p], position_stars_[q]);
+          const Vec<Real, Dim> gradient = -relative_mass(q) / density_0 * pair_gradient(Del_W, p, q);
           sum_gradient -= gradient;
           // Add k = j contribution
           sum_C += magnitude_squared(gradient);
@@ -342,29 +473,221 @@ namespace sim {
     }
 
     /*! Compute pressure delta positions
-     * @param span    Particles in which to compute delta positions for
+     * @param span    Particles in which to compute delta positions for, IndexSpan or IndexList
      * @param substep Solver substep number
      */
-    void compute_pressure_dps(IndexSpan span, const int substep) {
+    template<typename Indices>
+    void compute_pressure_dps(Indices span, const int substep) {
       const Del_Spikey<Real, Dim> Del_W{parameters_.smoothing_radius()};
 
       sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
         Vec<Real, Dim> dp{0.0};
         for (const std::size_t q : neighbors_[p]) {
-          dp += (lambdas_[p] + lambdas_[q]) * Del_W(position_stars_[p], position_stars_[q]);
+          dp += relative_mass(q) * (lambdas_[p] + lambdas_[q]) * pair_gradient(Del_W, p, q);
         }
         scratch_[p] = (Real) 1.0 / parameters_.rest_density() * dp;
       });
     };
 
+    /*! Compute XPBD pressure lambdas
+     * Lambdas are accumulated across solver substeps and the compliance is scaled by the time step
+     * so the effective stiffness doesn't depend on the number of substeps. lambdas_ holds the
+     * accumulated value and scratch_scalar_ the change made during this substep
+     * @param span    Particles in which to compute lambdas for
+     * @param substep Solver substep number, accumulated lambdas are reset on substep 0
+     */
+    void compute_xpbd_lambdas(IndexSpan span, const int substep) {
+      const Del_Spikey<Real, Dim> Del_W{parameters_.smoothing_radius()};
+      const Real alpha_tilde = parameters_.compliance() / (parameters_.time_step() * parameters_.time_step());
+
+      sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
+        const Real density_0 = parameters_.rest_density();
+        const Real C_p = densities_[p] / density_0 - static_cast<Real>(1.0);
+
+        Real sum_C = 0.0;
+        Vec<Real, Dim> sum_gradient{0.0};
+        for (const std::size_t q : neighbors_[p]) {
+          const Vec<Real, Dim> gradient = -relative_mass(q) / density_0 * pair_gradient(Del_W, p, q);
+          sum_gradient -= gradient;
+          sum_C += magnitude_squared(gradient);
+        }
+        sum_C += magnitude_squared(sum_gradient);
+
+        const Real lambda = (substep == 0 ? static_cast<Real>(0.0) : lambdas_[p]);
+        // Guard against isolated particles with no constraint gradient and zero compliance
+        const Real denominator = sum_C + alpha_tilde + static_cast<Real>(1e-12);
+        const Real delta_lambda = (-C_p - alpha_tilde * lambda) / denominator;
+
+        // Density constraint is unilateral, the accumulated lambda may only push particles apart
+        const Real lambda_new = (lambda + delta_lambda > 0.0 ? static_cast<Real>(0.0) : lambda + delta_lambda);
+        scratch_scalar_[p] = lambda_new - lambda;
+        lambdas_[p] = lambda_new;
+      });
+    }
+
+    /*! Compute XPBD pressure delta positions from the lambda changes of this substep
+     * @param span Particles in which to compute delta positions for
+     */
+    void compute_xpbd_dps(IndexSpan span) {
+      const Del_Spikey<Real, Dim> Del_W{parameters_.smoothing_radius()};
+
+      sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
+        Vec<Real, Dim> dp{0.0};
+        for (const std::size_t q : neighbors_[p]) {
+          dp += relative_mass(q) * (scratch_scalar_[p] + scratch_scalar_[q]) * pair_gradient(Del_W, p, q);
+        }
+        scratch_[p] = (Real) 1.0 / parameters_.rest_density() * dp;
+      });
+    };
+
+    /*! Reset position stars to the current positions
+     * DFSPH solves for velocities at the start of step positions
+     * @param span Particles over which to reset the position stars
+     */
+    void reset_position_stars(IndexSpan span) {
+      sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
+        position_stars_[p] = positions_[p];
+      });
+    }
+
+    /*! Compute DFSPH stiffness factors and store in scratch scalar array
+     * Requires densities to have been computed
+     * @param span Particles over which to compute the factors
+     */
+    void compute_dfsph_factors(IndexSpan span) {
+      const Del_Spikey<Real, Dim> Del_W{parameters_.smoothing_radius()};
+      const Real mass = parameters_.rest_mass();
+
+      sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
+        Real sum_squared = 0.0;
+        Vec<Real, Dim> sum_gradient{0.0};
+        for (const std::size_t q : neighbors_[p]) {
+          const Vec<Real, Dim> gradient = mass * relative_mass(q) * pair_gradient(Del_W, p, q);
+          sum_gradient += gradient;
+          sum_squared += magnitude_squared(gradient);
+        }
+        const Real denominator = magnitude_squared(sum_gradient) + sum_squared;
+
+        // Particles without neighbors can't be corrected
+        scratch_scalar_[p] = (denominator > static_cast<Real>(1e-9) ? densities_[p] / denominator : static_cast<Real>(0.0));
+      });
+    }
+
+    /*! Compute DFSPH density stiffness from the density predicted by the current velocities
+     * lambdas_ holds kappa / density, halo lambdas must be synced or solved redundantly before they're applied
+     * @param span Particles over which to compute the stiffness
+     */
+    void compute_dfsph_density_kappas(IndexSpan span) {
+      const Del_Spikey<Real, Dim> Del_W{parameters_.smoothing_radius()};
+      const Real mass = parameters_.rest_mass();
+      const Real dt = parameters_.time_step();
+
+      sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
+        Real density_change = 0.0;
+        for (const std::size_t q : neighbors_[p]) {
+          density_change += mass * relative_mass(q) * dot(velocities_[p] - velocities_[q],
+                                                          pair_gradient(Del_W, p, q));
+        }
+        const Real density_star = densities_[p] + dt * density_change;
+
+        // Only correct compression
+        const Real error = density_star - parameters_.rest_density();
+        const Real kappa = (error > 0.0 ? error / (dt * dt) * scratch_scalar_[p] : static_cast<Real>(0.0));
+        lambdas_[p] = kappa / densities_[p];
+      });
+    }
+
+    /*! Compute DFSPH divergence stiffness from the current velocities
+     * lambdas_ holds kappa / density, halo lambdas must be synced or solved redundantly before they're applied
+     * @param span Particles over which to compute the stiffness
+     */
+    void compute_dfsph_divergence_kappas(IndexSpan span) {
+      const Del_Spikey<Real, Dim> Del_W{parameters_.smoothing_radius()};
+      const Real mass = parameters_.rest_mass();
+      const Real dt = parameters_.time_step();
+
+      sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
+        Real density_change = 0.0;
+        for (const std::size_t q : neighbors_[p]) {
+          density_change += mass * relative_mass(q) * dot(velocities_[p] - velocities_[q],
+                                                          pair_gradient(Del_W, p, q));
+        }
+
+        // Only correct compressing flow
+        const Real kappa = (density_change > 0.0 ? density_change / dt * scratch_scalar_[p] : static_cast<Real>(0.0));
+        lambdas_[p] = kappa / densities_[p];
+      });
+    }
+
+    /*! Apply DFSPH stiffness to particle velocities
+     * @param span Particles over which to correct velocities
+     */
+    void apply_dfsph_kappas(IndexSpan span) {
+      const Del_Spikey<Real, Dim> Del_W{parameters_.smoothing_radius()};
+      const Real mass = parameters_.rest_mass();
+      const Real dt = parameters_.time_step();
+
+      sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
+        Vec<Real, Dim> dv{0.0};
+        for (const std::size_t q : neighbors_[p]) {
+          dv -= (lambdas_[p] + lambdas_[q]) * mass * relative_mass(q) * pair_gradient(Del_W, p, q);
+        }
+        velocities_[p] += dt * dv;
+      });
+    }
+
+    /*! Chebyshev semi-iterative weight for a solver substep
+     * Substep 0 is a plain Jacobi step as no history is available yet
+     * @param substep Solver substep number
+     * @return Chebyshev weight, 1.0 if acceleration is disabled
+     */
+    Real chebyshev_omega(const int substep) const {
+      // rho >= 1 would diverge so clamp it just below
+      const Real rho = std::min(parameters_.chebyshev_rho(), static_cast<Real>(0.9999));
+      if(rho <= 0.0)
+        return 1.0;
+
+      Real omega = 1.0;
+      for(int k = 1; k <= substep; ++k) {
+        if(k == 1)
+          omega = 2.0 / (2.0 - rho * rho);
+        else
+          omega = 4.0 / (4.0 - rho * rho * omega);
+      }
+      return omega;
+    }
+
     /*! Update particle position stars
-     * @param span Particles over which to update position stars for
+     * Delta positions are weighted by the SOR omega and optionally Chebyshev accelerated
+     * @param span    Particles over which to update position stars for, IndexSpan or IndexList
+     * @param substep Solver substep number
      */
-    void update_position_stars(IndexSpan span) {
+    template<typename Indices>
+    void update_position_stars(Indices span, const int substep) {
+      const Real sor_omega = parameters_.sor_omega();
+      const Real omega = this->chebyshev_omega(substep);
+      const bool accelerate = parameters_.chebyshev_rho() > 0.0;
+      // Accelerated steps longer than this are considered diverging and are rejected
+      const Real max_step = static_cast<Real>(0.5) * parameters_.smoothing_radius();
+
       sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
+        const auto position_star_p = position_stars_[p];
+
         // scratch contains delta positions
-        auto position_star_p_new = position_stars_[p] + scratch_[p];
-        apply_boundary_conditions(position_star_p_new, parameters_);
+        auto position_star_p_new = position_star_p + sor_omega * scratch_[p];
+
+        if(accelerate) {
+          if(omega != static_cast<Real>(1.0)) {
+            const auto position_star_p_previous = position_star_history_[p];
+            const auto accelerated = omega * (position_star_p_new - position_star_p_previous)
+                                     + position_star_p_previous;
+            if(magnitude_squared(accelerated - position_star_p) < max_step * max_step)
+              position_star_p_new = accelerated;
+          }
+          position_star_history_[p] = position_star_p;
+        }
+
+        apply_boundary_conditions(position_star_p_new, parameters_, colliders_);
         position_stars_[p] = position_star_p_new;
       });
     };
@@ -393,16 +716,57 @@ namespace sim {
       });
     }
 
+    /*! Free surface test
+     * Particles missing a significant part of their neighborhood are on the free surface
+     * @param p Particle index, must have a valid neighbor list
+     * @return true if particle p is on the free surface
+     */
+    DEVICE_CALLABLE
+    bool is_surface(const std::size_t p) const {
+      return neighbors_[p].count < parameters_.surface_neighbor_threshold();
+    }
+
+    /*! Build a compacted list of free surface particles
+     * @param span Particles to classify, must have valid neighbor lists
+     * @return Number of surface particles found
+     */
+    std::size_t classify_surface(IndexSpan span) {
+      surface_count_ = sim::algorithms::copy_index_if(span, surface_indices_.data(),
+                                                      [=] DEVICE_CALLABLE(std::size_t p) {
+        return this->is_surface(p);
+      });
+      return surface_count_;
+    }
+
+    /*! Surface particle count getter
+     * @return Number of particles found by the last classify_surface call
+     */
+    std::size_t surface_count() const { return surface_count_; }
+
+    /*! Surface particle indices getter
+     * @return Reference to surface particle index array, the first surface_count() entries are valid
+     */
+    const sim::Array<std::size_t> &surface_indices() const { return surface_indices_; }
+
     /*! Apply surface tension
-     * @param color_field_span
-     * @param surface_tension_span
+     * The color field gradient, and so the curvature force, vanishes for particles with a full neighborhood
+     * and the cohesion force is nearly balanced so both are only computed for surface particles
+     * @param color_field_span     Particles in which the color field is cleared
+     * @param surface_tension_span Particles to classify and apply surface tension to
      */
     void apply_surface_tension(IndexSpan color_field_span, IndexSpan surface_tension_span) {
       const Del_Spikey<Real, Dim> Del_W{parameters_.smoothing_radius()};
       const C_Spline<Real, Dim> C{parameters_.smoothing_radius()};
 
-      // Compute gradient of color field
+      this->classify_surface(surface_tension_span);
+      const IndexList surface_list{surface_indices_.data(), surface_count_};
+
       sim::algorithms::for_each_index(color_field_span, [=] DEVICE_CALLABLE(std::size_t p) {
+        scratch_[p] = Vec<Real, Dim>{0.0};
+      });
+
+      // Compute gradient of color field
+      sim::algorithms::for_each_index(surface_list, [=] DEVICE_CALLABLE(std::size_t p) {
         Vec<Real, Dim> color{0.0};
         for (const std::size_t q : neighbors_[p]) {
           color += Del_W(position_stars_[p], position_stars_[q]) / densities_[q];
@@ -410,7 +774,7 @@ namespace sim {
         scratch_[p] = parameters_.smoothing_radius() * color;
       });
 
-      sim::algorithms::for_each_index(surface_tension_span, [=] DEVICE_CALLABLE(std::size_t p) {
+      sim::algorithms::for_each_index(surface_list, [=] DEVICE_CALLABLE(std::size_t p) {
         Vec<Real, Dim> surface_tension_force{0.0};
 
         for (const std::size_t q : neighbors_[p]) {
@@ -439,8 +803,7 @@ namespace sim {
       sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
         Vec<Real, Dim> dv{0.0};
         for (const std::size_t q : neighbors_[p]) {
-          const Real r_mag = magnitude(position_stars_[p] - position_stars_[q]);
-          dv += (velocities_[q] - velocities_[p]) * W(r_mag) / densities_[q];
+          dv += (velocities_[q] - velocities_[p]) * relative_mass(q) * pair_kernel(W, p, q) / densities_[q];
         }
         velocities_[p] += parameters_.visc_c() * dv;
       });
@@ -486,11 +849,259 @@ namespace sim {
 
     }
 
+    /*! Neighbor hops from the free surface required before a particle may be merged to level
+     * Each level requires two more hops so the kernel support of merged particles stays inside the fluid
+     * @param level Resolution level
+     * @return Minimum depth, in neighbor hops, of particles at level
+     */
+    DEVICE_CALLABLE
+    static std::size_t required_depth(const int level) {
+      return (level <= 0 ? 0 : static_cast<std::size_t>(2 * level + 2));
+    }
+
+    /*! Target resolution level of a particle at depth
+     * @param depth Neighbor hops to the free surface
+     * @return Coarsest level allowed at depth
+     */
+    DEVICE_CALLABLE
+    int target_level(const std::size_t depth) const {
+      int level = parameters_.max_resolution_level();
+      while (level > 0 && depth < required_depth(level))
+        --level;
+      return level;
+    }
+
+    /*! Compute the number of neighbor hops from each particle to the free surface
+     * Neighbors outside of span, such as halo particles, count towards the surface test but their depth isn't used
+     * @param span      Particles to compute depths for, must have valid neighbor lists
+     * @param max_depth Depths are computed up to, and clamped at, max_depth
+     */
+    void compute_surface_depths(IndexSpan span, const std::size_t max_depth) {
+      const std::size_t end = span.end;
+
+      sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
+        depths_[p] = (this->is_surface(p) ? 0 : max_depth);
+      });
+
+      // partners_ is used as the Jacobi ping-pong buffer
+      for (std::size_t i = 0; i < max_depth; ++i) {
+        sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
+          std::size_t depth = depths_[p];
+          for (const std::size_t q : neighbors_[p]) {
+            if (q < end && depths_[q] + 1 < depth)
+              depth = depths_[q] + 1;
+          }
+          partners_[p] = depth;
+        });
+        sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
+          depths_[p] = partners_[p];
+        });
+      }
+    }
+
+    /*! Split particles into a PBF band and grid solved bulk for the hybrid solver
+     * The band contains particles near the free surface and the domain edge particles, which are solved with
+     * PBF so the halo couples neighboring domains. Lambdas are cleared so bulk particles act as fixed
+     * neighbors during the band solve
+     * @param span       Resident particles to classify
+     * @param edge_begin Index of the first domain edge particle
+     */
+    void classify_band(IndexSpan span, const std::size_t edge_begin) {
+      const std::size_t band_depth = parameters_.flip_band_depth();
+      this->compute_surface_depths(span, band_depth);
+
+      band_count_ = sim::algorithms::copy_index_if(span, band_indices_.data(),
+                                                   [=] DEVICE_CALLABLE(std::size_t p) {
+        return depths_[p] < band_depth || p >= edge_begin;
+      });
+      bulk_count_ = sim::algorithms::copy_index_if(span, bulk_indices_.data(),
+                                                   [=] DEVICE_CALLABLE(std::size_t p) {
+        return depths_[p] >= band_depth && p < edge_begin;
+      });
+
+      sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
+        lambdas_[p] = static_cast<Real>(0.0);
+      });
+    }
+
+    /*! Band particle list getter
+     * @return List of particles solved with PBF by the hybrid solver
+     */
+    IndexList band_list() const { return IndexList{band_indices_.data(), band_count_}; }
+
+    /*! Bulk particle list getter
+     * @return List of particles advected by the grid in the hybrid solver
+     */
+    IndexList bulk_list() const { return IndexList{bulk_indices_.data(), bulk_count_}; }
+
+    /*! Neighbors getter
+     * @return Reference to particle neighbors
+     */
+    const Neighbors<Real, Dim> &neighbors() const { return neighbors_; }
+
+    /*! Static boundary getter
+     * @return Reference to the static boundary signed distance field
+     */
+    const SignedDistanceField<Real, Dim> &boundary_sdf() const { return boundary_sdf_; }
+
+    /*! Colliders getter
+     * @return Reference to the static boundary, mover, and interactive colliders
+     */
+    const Colliders<Real, Dim> &colliders() const { return colliders_; }
+
+    /*! Rebuild the collider set from the current parameters
+     * Must be called after the parameters are synced from the renderer
+     */
+    void update_colliders() {
+      colliders_.update();
+    }
+
+    /*! Adapt particle resolution to the distance from the free surface
+     * Mutually nearest pairs of equal level particles deep in the fluid are merged into a single particle
+     * of twice the mass, particles that have come too close to the surface are split back into two.
+     * The neighbor lists from the current step are used and there must be no halo particles, the
+     * resident particles are reordered
+     * @param span Resident particles, must begin at 0 and end at the local count
+     * @return Resident particle count after merging and splitting
+     */
+    std::size_t adapt_resolution(IndexSpan span) {
+      if (parameters_.max_resolution_level() <= 0 || span.end == span.begin)
+        return span.end;
+
+      const std::size_t end = span.end;
+      const std::size_t no_partner = std::numeric_limits<std::size_t>::max();
+      const std::size_t max_depth = required_depth(parameters_.max_resolution_level()) + 1;
+
+      this->compute_surface_depths(span, max_depth);
+
+      // Find nearest neighbor of the same level that also wants to be coarser
+      sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
+        const int level = levels_[p];
+        std::size_t partner = no_partner;
+
+        if (target_level(depths_[p]) > level) {
+          Real nearest_squared = std::numeric_limits<Real>::max();
+          for (const std::size_t q : neighbors_[p]) {
+            if (q >= end || levels_[q] != level || target_level(depths_[q]) <= level)
+              continue;
+            const Real r_squared = magnitude_squared(positions_[p] - positions_[q]);
+            if (r_squared < nearest_squared) {
+              nearest_squared = r_squared;
+              partner = q;
+            }
+          }
+        }
+        partners_[p] = partner;
+      });
+
+      // Merge mutual partners into the lower index, the higher index is flagged for removal with level -1
+      sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
+        const std::size_t q = partners_[p];
+        if (q == no_partner || q < p || partners_[q] != p)
+          return;
+
+        positions_[p] = static_cast<Real>(0.5) * (positions_[p] + positions_[q]);
+        position_stars_[p] = static_cast<Real>(0.5) * (position_stars_[p] + position_stars_[q]);
+        velocities_[p] = static_cast<Real>(0.5) * (velocities_[p] + velocities_[q]);
+        levels_[p] += 1;
+        levels_[q] = -1;
+      });
+
+      // Flag particles which are too close to the surface for their level, one hop of hysteresis
+      sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
+        const int level = levels_[p];
+        partners_[p] = (level > 0 && depths_[p] + 1 < required_depth(level) ? 1 : 0);
+      });
+
+      sim::algorithms::exclusive_scan(partners_.data(), partners_.data() + end, depths_.data());
+      const std::size_t split_count = depths_[end - 1] + partners_[end - 1];
+
+      // Split children are appended after the current resident particles
+      if (split_count > this->available())
+        throw std::runtime_error("Not enough capacity to split particles");
+      if (split_count > 0)
+        this->add_copies(Vec<Real, Dim>{0.0}, Vec<Real, Dim>{0.0}, Vec<Real, Dim>{0.0}, split_count);
+
+      const Real spacing = parameters_.particle_rest_spacing();
+      sim::algorithms::for_each_index(span, [=] DEVICE_CALLABLE(std::size_t p) {
+        if (!partners_[p])
+          return;
+
+        const std::size_t child = end + depths_[p];
+        const int level = levels_[p] - 1;
+
+        // Children are offset by half their spacing along the direction of travel
+        Vec<Real, Dim> direction{0.0};
+        direction.y = static_cast<Real>(1.0);
+        const Real speed = magnitude(velocities_[p]);
+        if (speed > std::numeric_limits<Real>::epsilon())
+          direction = velocities_[p] / speed;
+        const Vec<Real, Dim> offset = static_cast<Real>(0.5) * spacing * parameters_.resolution_scale(level) * direction;
+
+        auto position_child = positions_[p] + offset;
+        auto position_star_child = position_stars_[p] + offset;
+        auto position_parent = positions_[p] - offset;
+        auto position_star_parent = position_stars_[p] - offset;
+        apply_boundary_conditions(position_child, parameters_, colliders_);
+        apply_boundary_conditions(position_star_child, parameters_, colliders_);
+        apply_boundary_conditions(position_parent, parameters_, colliders_);
+        apply_boundary_conditions(position_star_parent, parameters_, colliders_);
+
+        positions_[child] = position_child;
+        position_stars_[child] = position_star_child;
+        velocities_[child] = velocities_[p];
+        levels_[child] = level;
+
+        positions_[p] = position_parent;
+        position_stars_[p] = position_star_parent;
+        levels_[p] = level;
+      });
+
+      // Compact merged away particles to the end and remove them
+      const std::size_t split_end = end + split_count;
+      std::size_t *order = attributes_.reset_order(split_end);
+      const std::size_t *removed_begin = sim::algorithms::partition(order, order + split_end,
+                                                                    [=] DEVICE_CALLABLE(std::size_t p) {
+        return levels_[p] >= 0;
+      });
+      attributes_.permute(IndexSpan{0, split_end});
+      this->remove(static_cast<std::size_t>(order + split_end - removed_begin));
+
+      return this->local_count();
+    }
+
+    /*! Add count level 0 particles of the same value to end of array
+     * @param position      Position to add
+     * @param position_star Position star to add
+     * @param velocity      Velocity to add
+     * @param count         Number of particles to add
+     */
+    void add_copies(const Vec<Real, Dim> &position,
+                    const Vec<Real, Dim> &position_star,
+                    const Vec<Real, Dim> &velocity,
+                    std::size_t count) {
+      const IndexSpan added = attributes_.append_defaults(count);
+      sim::algorithms::for_each_index(added, [=] DEVICE_CALLABLE(std::size_t p) {
+        positions_[p] = position;
+        position_stars_[p] = position_star;
+        velocities_[p] = velocity;
+        position_star_history_[p] = position_star;
+      });
+    }
+
+    /*! Particle attribute registry getter
+     * @return Reference to the registry of per particle arrays
+     */
+    ParticleAttributes &attributes() { return attributes_; }
+
     /*! @todo DEVICE_CALLABLE lambdas can't currently have private members */
     //private:
     const Parameters<Real, Dim> &parameters_;    /*<< Reference to simulation parameters */
     const std::size_t max_local_count_;          /*<< Maximum number of particles allowed per process */
+    Arena arena_;                                /*<< Storage for all particle and neighbor arrays */
     Neighbors<Real, Dim> neighbors_;             /*<< Particle neighbors */
+    SignedDistanceField<Real, Dim> boundary_sdf_; /*<< Static OBJ boundary */
+    Colliders<Real, Dim> colliders_;             /*<< Mover and interactive colliders */
     sim::Array<Vec<Real, Dim> > positions_;      /*<< Particle positions */
     sim::Array<Vec<Real, Dim> > position_stars_; /*<< Particle position stars */
     sim::Array<Vec<Real, Dim> > velocities_;     /*<< Particle velocities */
@@ -501,25 +1112,38 @@ namespace sim {
     // Don't overwrite data you depend on
     sim::Array<Vec<Real, Dim> > scratch_;        /*<< Scratch vec array */
     sim::Array<Real> scratch_scalar_;            /*<<  Scratch scalar array */
+
+    sim::Array<Vec<Real, Dim> > position_star_history_; /*<< Previous solver iteration position stars */
+
+    sim::Array<int> levels_;                     /*<< Particle resolution levels, mass is rest_mass * 2^level */
+    sim::Array<std::size_t> depths_;             /*<< Neighbor hops to the free surface, used by adapt_resolution */
+    sim::Array<std::size_t> partners_;           /*<< Merge partners and split flags, used by adapt_resolution */
+
+    sim::Array<std::size_t> surface_indices_;    /*<< Compacted indices of free surface particles */
+    std::size_t surface_count_;                  /*<< Number of valid surface_indices_ */
+
+    sim::Array<std::size_t> band_indices_;       /*<< Hybrid solver particles solved with PBF */
+    sim::Array<std::size_t> bulk_indices_;       /*<< Hybrid solver particles advected by the grid */
+    std::size_t band_count_;                     /*<< Number of valid band_indices_ */
+    std::size_t bulk_count_;                     /*<< Number of valid bulk_indices_ */
+
+    ParticleAttributes attributes_;              /*<< Registry of the per particle arrays above */
   };
 
   /*! Apply boundary conditions
    * @param position   Reference to positions to apply boundary conditions to
    * @param parameters Global simulation parameters
+   * @param colliders  Static boundary geometry, mover, and colliders to push positions out of
    */
   template<typename Real, Dimension Dim>
   DEVICE_CALLABLE
   void apply_boundary_conditions(Vec<Real, Dim> &position,
-                                 const Parameters<Real, Dim> &parameters) {
-    // Push outside of mover sphere
-    const float mover_radius = 0.2;
+                                 const Parameters<Real, Dim> &parameters,
+                                 const Colliders<Real, Dim> &colliders) {
     const auto boundary = parameters.boundary();
-    const Vec<Real, Dim> mover_center = parameters.mover_center();
-    Real dr_squared = magnitude_squared(position - mover_center);
-    if (dr_squared < mover_radius * mover_radius) {
-      Real dr = sqrt(dr_squared);
-      position += (mover_radius - dr) * (position - mover_center) / dr;
-    }
+
+    // Push outside of static geometry and nearby colliders
+    colliders.push_out(position);
 
     // Clamp inside boundary
     clamp_in_place(position, boundary.min, boundary.max);
@@ -0,0 +1,661 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "managed_allocation.h"
+#include "dimension.h"
+#include "array.h"
+#include "vec.h"
+#include "aabb.h"
+#include "parameters.h"
+#include "device.h"
+
+namespace sim {
+
+  /*! Static boundary represented as a sampled signed distance field
+   * Distances are negative inside of the geometry. The field is built from an OBJ mesh at startup, or loaded
+   * from a previously cached field file, and sampled with multilinear interpolation
+   */
+  template<typename Real, Dimension Dim>
+  class SignedDistanceField : public ManagedAllocation {
+  public:
+    /*! Constructor
+     * If no OBJ file is given the field is empty and never pushes particles. Otherwise the cache file is read
+     * if it was built from the same OBJ contents at the requested spacing, else the mesh is voxelized and the cache written
+     * @param parameters Populated simulation parameters
+     */
+    SignedDistanceField(const Parameters<Real, Dim> &parameters) : spacing_{parameters.boundary_sdf_spacing()},
+                                                                  dimensions_{static_cast<std::size_t>(0)},
+                                                                  origin_{static_cast<Real>(0.0)},
+                                                                  distances_{nullptr},
+                                                                  values_{nullptr} {
+      const std::string obj_file{parameters.boundary_obj_file()};
+      const std::string sdf_file{parameters.boundary_sdf_file()};
+      if (obj_file.empty())
+        return;
+
+      if (Dim != 3)
+        throw std::runtime_error("OBJ boundaries require three dimensions");
+
+      std::vector<Real> values;
+      std::uint64_t source[2];
+      const bool source_read = source_signature(obj_file, source);
+      if (sdf_file.empty() || !this->read_cache(sdf_file, source_read ? source : nullptr, values)) {
+        this->voxelize(obj_file, values);
+        if (!sdf_file.empty())
+          this->write_cache(sdf_file, source, values);
+      }
+
+      distances_ = new sim::Array<Real>(values.size());
+      values_ = distances_->data();
+      std::copy(values.begin(), values.end(), values_);
+    }
+
+    /*! Destructor
+     */
+    ~SignedDistanceField() {
+      delete distances_;
+    }
+
+    SignedDistanceField(const SignedDistanceField &) = delete;
+
+    SignedDistanceField &operator=(const SignedDistanceField &) = delete;
+
+    /*! Test if the field contains a boundary
+     * @return true if an OBJ boundary was loaded
+     */
+    DEVICE_CALLABLE
+    bool active() const {
+      return values_ != nullptr;
+    }
+
+    /*! Sampled region getter
+     * @return Bounds of the sampled grid, distances outside are treated as far from the boundary
+     */
+    AABB<Real, Dim> bounds() const {
+      AABB<Real, Dim> bounds;
+      bounds.min = origin_;
+      bounds.max = origin_;
+      for (std::size_t d = 0; d < Dim; ++d)
+        bounds.max[d] += spacing_ * static_cast<Real>(dimensions_[d] > 0 ? dimensions_[d] - 1 : 0);
+      return bounds;
+    }
+
+    /*! Sample the signed distance
+     * @param position Location to sample
+     * @return Signed distance to the boundary, the maximum Real outside of the sampled grid
+     */
+    DEVICE_CALLABLE
+    Real distance(const Vec<Real, Dim> &position) const {
+      const Real outside = std::numeric_limits<Real>::max();
+      if (!this->active())
+        return outside;
+
+      Vec<std::size_t, Dim> base;
+      Vec<Real, Dim> fraction;
+      for (std::size_t d = 0; d < Dim; ++d) {
+        const Real g = (position[d] - origin_[d]) / spacing_;
+        if (g < static_cast<Real>(0.0) || g >= static_cast<Real>(dimensions_[d] - 1))
+          return outside;
+        base[d] = static_cast<std::size_t>(g);
+        fraction[d] = g - static_cast<Real>(base[d]);
+      }
+
+      Real distance = 0.0;
+      for (std::size_t corner = 0; corner < (1u << Dim); ++corner) {
+        std::size_t index = 0;
+        std::size_t stride = 1;
+        Real weight = 1.0;
+        for (std::size_t d = 0; d < Dim; ++d) {
+          const std::size_t bit = (corner >> d) & 1;
+          index += (base[d] + bit) * stride;
+          stride *= dimensions_[d];
+          weight *= (bit ? fraction[d] : static_cast<Real>(1.0) - fraction[d]);
+        }
+        distance += weight * values_[index];
+      }
+      return distance;
+    }
+
+    /*! Signed distance gradient using central differences
+     * @param position Location to sample
+     * @return Unnormalized outward direction
+     */
+    DEVICE_CALLABLE
+    Vec<Real, Dim> gradient(const Vec<Real, Dim> &position) const {
+      const Real h = static_cast<Real>(0.5) * spacing_;
+      Vec<Real, Dim> gradient;
+      for (std::size_t d = 0; d < Dim; ++d) {
+        auto upper = position;
+        auto lower = position;
+        upper[d] += h;
+        lower[d] -= h;
+        gradient[d] = (this->distance(upper) - this->distance(lower)) / (static_cast<Real>(2.0) * h);
+      }
+      return gradient;
+    }
+
+    /*! Move a position inside the boundary to the boundary surface
+     * @param position Reference to position to push out
+     */
+    DEVICE_CALLABLE
+    void push_out(Vec<Real, Dim> &position) const {
+      const Real distance = this->distance(position);
+      if (distance >= static_cast<Real>(0.0))
+        return;
+
+      const auto direction = this->gradient(position);
+      const Real length_squared = magnitude_squared(direction);
+      if (length_squared > static_cast<Real>(0.0))
+        position -= distance * direction / sqrt(length_squared);
+    }
+
+  private:
+    Real spacing_;                     /**< Grid node spacing **/
+    Vec<std::size_t, Dim> dimensions_; /**< Grid node counts **/
+    Vec<Real, Dim> origin_;            /**< Position of the first grid node **/
+    sim::Array<Real> *distances_;      /**< Owned distance storage, x fastest **/
+    Real *values_;                     /**< Distance data, nullptr if there is no boundary **/
+
+    /*! Size and content hash of the OBJ a field is built from
+     * @param file_name OBJ file
+     * @param signature Set to the file size and its 64 bit FNV-1a hash
+     * @return false if the file can't be read
+     */
+    static bool source_signature(const std::string &file_name, std::uint64_t signature[2]) {
+      signature[0] = 0;
+      signature[1] = 14695981039346656037ull;
+      std::ifstream file{file_name, std::ios::binary};
+      if (!file)
+        return false;
+
+      char buffer[4096];
+      while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
+        const std::streamsize count = file.gcount();
+        for (std::streamsize i = 0; i < count; ++i) {
+          signature[1] ^= static_cast<unsigned char>(buffer[i]);
+          signature[1] *= 1099511628211ull;
+        }
+        signature[0] += static_cast<std::uint64_t>(count);
+      }
+      return true;
+    }
+
+    /*! Read the cached field
+     * @param file_name Cache file
+     * @param source    Signature of the OBJ the field must have been built from, nullptr if the OBJ can't be read
+     * @param values    Filled with the cached distances
+     * @return true if the cache exists and was built from source with the current spacing
+     */
+    bool read_cache(const std::string &file_name, const std::uint64_t *source, std::vector<Real> &values) {
+      std::ifstream file{file_name, std::ios::binary};
+      if (!file)
+        return false;
+
+      char magic[4];
+      std::uint64_t signature[2];
+      std::uint64_t dimensions[3];
+      double origin[3];
+      double spacing;
+      file.read(magic, sizeof(magic));
+      file.read(reinterpret_cast<char *>(signature), sizeof(signature));
+      file.read(reinterpret_cast<char *>(dimensions), sizeof(dimensions));
+      file.read(reinterpret_cast<char *>(origin), sizeof(origin));
+      file.read(reinterpret_cast<char *>(&spacing), sizeof(spacing));
+      if (!file || std::string(magic, 4) != "SDF2" || static_cast<Real>(spacing) != spacing_)
+        return false;
+
+      // A cache whose OBJ is no longer around is trusted, otherwise it must match the current contents
+      if (source && (signature[0] != source[0] || signature[1] != source[1]))
+        return false;
+
+      std::size_t count = 1;
+      for (std::size_t d = 0; d < Dim; ++d) {
+        dimensions_[d] = dimensions[d];
+        origin_[d] = static_cast<Real>(origin[d]);
+        count *= dimensions_[d];
+      }
+
+      std::vector<float> stored(count);
+      file.read(reinterpret_cast<char *>(stored.data()), count * sizeof(float));
+      if (!file)
+        return false;
+
+      values.assign(stored.begin(), stored.end());
+      return true;
+    }
+
+    /*! Write the field cache
+     * The file is written under a unique temporary name from mkstemp and renamed, so concurrent processes,
+     * including ranks on different nodes sharing a file system, never write to or read a partial cache
+     * @param file_name Cache file
+     * @param source    Signature of the OBJ the field was built from
+     * @param values    Distances to store
+     */
+    void write_cache(const std::string &file_name, const std::uint64_t source[2], const std::vector<Real> &values) const {
+      std::vector<char> temporary_template(file_name.begin(), file_name.end());
+      const std::string suffix = ".XXXXXX";
+      temporary_template.insert(temporary_template.end(), suffix.begin(), suffix.end());
+      temporary_template.push_back('\0');
+      const int descriptor = mkstemp(temporary_template.data());
+      if (descriptor == -1)
+        throw std::runtime_error("unable to write boundary SDF cache: " + file_name);
+      fchmod(descriptor, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+      close(descriptor);
+      const std::string temporary_name{temporary_template.data()};
+
+      {
+        std::ofstream file{temporary_name, std::ios::binary | std::ios::trunc};
+        if (!file) {
+          std::remove(temporary_name.c_str());
+          throw std::runtime_error("unable to write boundary SDF cache: " + file_name);
+        }
+
+        std::uint64_t dimensions[3] = {1, 1, 1};
+        double origin[3] = {0.0, 0.0, 0.0};
+        for (std::size_t d = 0; d < Dim; ++d) {
+          dimensions[d] = dimensions_[d];
+          origin[d] = origin_[d];
+        }
+        const double spacing = spacing_;
+        const std::vector<float> stored(values.begin(), values.end());
+
+        file.write("SDF2", 4);
+        file.write(reinterpret_cast<const char *>(source), 2 * sizeof(std::uint64_t));
+        file.write(reinterpret_cast<const char *>(dimensions), sizeof(dimensions));
+        file.write(reinterpret_cast<const char *>(origin), sizeof(origin));
+        file.write(reinterpret_cast<const char *>(&spacing), sizeof(spacing));
+        file.write(reinterpret_cast<const char *>(stored.data()), stored.size() * sizeof(float));
+        if (!file) {
+          file.close();
+          std::remove(temporary_name.c_str());
+          throw std::runtime_error("unable to write boundary SDF cache: " + file_name);
+        }
+      }
+      if (std::rename(temporary_name.c_str(), file_name.c_str()) != 0)
+        std::remove(temporary_name.c_str());
+    }
+
+    /*! Read OBJ vertices and faces, faces are fan triangulated
+     * @param file_name OBJ file
+     * @param vertices  Filled with the mesh vertices
+     * @param triangles Filled with three vertex indices per triangle
+     */
+    static void read_obj(const std::string &file_name,
+                         std::vector<Vec<double, 3>> &vertices,
+                         std::vector<std::size_t> &triangles) {
+      std::ifstream file{file_name};
+      if (!file)
+        throw std::runtime_error("unable to open boundary OBJ: " + file_name);
+
+      std::string line;
+      while (std::getline(file, line)) {
+        std::istringstream tokens{line};
+        std::string type;
+        tokens >> type;
+        if (type == "v") {
+          double x, y, z;
+          tokens >> x >> y >> z;
+          vertices.push_back(Vec<double, 3>{x, y, z});
+        } else if (type == "f") {
+          std::vector<std::size_t> face;
+          std::string vertex;
+          while (tokens >> vertex) {
+            // v, v/vt, v//vn, or v/vt/vn; negative indices are relative to the end
+            const long index = std::stol(vertex.substr(0, vertex.find('/')));
+            face.push_back(index > 0 ? index - 1 : vertices.size() + index);
+          }
+          for (std::size_t i = 2; i < face.size(); ++i) {
+            triangles.push_back(face[0]);
+            triangles.push_back(face[i - 1]);
+            triangles.push_back(face[i]);
+          }
+        }
+      }
+
+      for (const auto index : triangles) {
+        if (index >= vertices.size())
+          throw std::runtime_error("invalid face index in boundary OBJ: " + file_name);
+      }
+    }
+
+    /*! Distance from a point to a triangle
+     * @return Unsigned distance from p to triangle abc
+     */
+    static double triangle_distance(const Vec<double, 3> &p, const Vec<double, 3> &a,
+                                    const Vec<double, 3> &b, const Vec<double, 3> &c) {
+      // Closest point by Voronoi region, Ericson Real-Time Collision Detection 5.1.5
+      const auto ab = b - a;
+      const auto ac = c - a;
+      const auto ap = p - a;
+      const double d1 = dot(ab, ap);
+      const double d2 = dot(ac, ap);
+      if (d1 <= 0.0 && d2 <= 0.0)
+        return magnitude(ap);
+
+      const auto bp = p - b;
+      const double d3 = dot(ab, bp);
+      const double d4 = dot(ac, bp);
+      if (d3 >= 0.0 && d4 <= d3)
+        return magnitude(bp);
+
+      const double vc = d1 * d4 - d3 * d2;
+      if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+        return magnitude(p - (a + ab * (d1 / (d1 - d3))));
+
+      const auto cp = p - c;
+      const double d5 = dot(ab, cp);
+      const double d6 = dot(ac, cp);
+      if (d6 >= 0.0 && d5 <= d6)
+        return magnitude(cp);
+
+      const double vb = d5 * d2 - d1 * d6;
+      if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+        return magnitude(p - (a + ac * (d2 / (d2 - d6))));
+
+      const double va = d3 * d6 - d5 * d4;
+      if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0)
+        return magnitude(p - (b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))));
+
+      const double denominator = 1.0 / (va + vb + vc);
+      return magnitude(p - (a + ab * (vb * denominator) + ac * (vc * denominator)));
+    }
+
+    /*! Bounding volume hierarchy node over mesh triangles
+     * Interior nodes have count 0 and their children at first and first + 1, leaves hold count triangles from first
+     */
+    struct TriangleNode {
+      Vec<double, 3> lower;
+      Vec<double, 3> upper;
+      std::size_t first;
+      std::size_t count;
+    };
+
+    /*! Build a bounding volume hierarchy over the triangles by median splits along the longest axis
+     * @param vertices  Mesh vertices
+     * @param triangles Three vertex indices per triangle, reordered so each leaf is contiguous
+     * @return Hierarchy nodes, the root is node 0
+     */
+    static std::vector<TriangleNode> build_hierarchy(const std::vector<Vec<double, 3>> &vertices,
+                                                     std::vector<std::size_t> &triangles) {
+      const std::size_t triangle_count = triangles.size() / 3;
+      std::vector<std::size_t> order(triangle_count);
+      std::vector<Vec<double, 3>> centroids(triangle_count);
+      for (std::size_t t = 0; t < triangle_count; ++t) {
+        order[t] = t;
+        centroids[t] = (vertices[triangles[3 * t]] + vertices[triangles[3 * t + 1]] + vertices[triangles[3 * t + 2]]) / 3.0;
+      }
+
+      std::vector<TriangleNode> nodes;
+      nodes.reserve(2 * triangle_count);
+      nodes.push_back(TriangleNode{Vec<double, 3>{0.0}, Vec<double, 3>{0.0}, 0, triangle_count});
+
+      // Pending nodes to bound and split, indices into nodes
+      std::vector<std::size_t> pending{0};
+      while (!pending.empty()) {
+        const std::size_t index = pending.back();
+        pending.pop_back();
+        const std::size_t begin = nodes[index].first;
+        const std::size_t end = begin + nodes[index].count;
+
+        Vec<double, 3> lower{std::numeric_limits<double>::max()};
+        Vec<double, 3> upper{std::numeric_limits<double>::lowest()};
+        for (std::size_t o = begin; o < end; ++o) {
+          for (std::size_t v = 0; v < 3; ++v) {
+            const auto &vertex = vertices[triangles[3 * order[o] + v]];
+            for (std::size_t d = 0; d < 3; ++d) {
+              lower[d] = std::min(lower[d], vertex[d]);
+              upper[d] = std::max(upper[d], vertex[d]);
+            }
+          }
+        }
+        nodes[index].lower = lower;
+        nodes[index].upper = upper;
+
+        if (end - begin <= 4)
+          continue;
+
+        std::size_t axis = 0;
+        for (std::size_t d = 1; d < 3; ++d) {
+          if (upper[d] - lower[d] > upper[axis] - lower[axis])
+            axis = d;
+        }
+        const std::size_t middle = begin + (end - begin) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                         [&](std::size_t a, std::size_t b) { return centroids[a][axis] < centroids[b][axis]; });
+
+        const std::size_t child = nodes.size();
+        nodes.push_back(TriangleNode{lower, upper, begin, middle - begin});
+        nodes.push_back(TriangleNode{lower, upper, middle, end - middle});
+        nodes[index].first = child;
+        nodes[index].count = 0;
+        pending.push_back(child);
+        pending.push_back(child + 1);
+      }
+
+      std::vector<std::size_t> ordered(triangles.size());
+      for (std::size_t o = 0; o < triangle_count; ++o) {
+        for (std::size_t v = 0; v < 3; ++v)
+          ordered[3 * o + v] = triangles[3 * order[o] + v];
+      }
+      triangles.swap(ordered);
+
+      return nodes;
+    }
+
+    /*! Squared distance from a point to a node's bounding box
+     */
+    static double box_distance_squared(const Vec<double, 3> &p, const TriangleNode &node) {
+      double distance_squared = 0.0;
+      for (std::size_t d = 0; d < 3; ++d) {
+        const double outside = std::max(std::max(node.lower[d] - p[d], p[d] - node.upper[d]), 0.0);
+        distance_squared += outside * outside;
+      }
+      return distance_squared;
+    }
+
+    /*! Distance from a point to the nearest triangle
+     * @param p         Query point
+     * @param bound     Known upper bound on the distance, subtrees farther than it are skipped
+     * @param nodes     Hierarchy from build_hierarchy
+     * @param vertices  Mesh vertices
+     * @param triangles Triangles ordered by build_hierarchy
+     * @param stack     Scratch traversal stack
+     * @return Unsigned distance to the mesh
+     */
+    static double nearest_distance(const Vec<double, 3> &p, double bound,
+                                   const std::vector<TriangleNode> &nodes,
+                                   const std::vector<Vec<double, 3>> &vertices,
+                                   const std::vector<std::size_t> &triangles,
+                                   std::vector<std::size_t> &stack) {
+      double distance = bound;
+      stack.clear();
+      stack.push_back(0);
+      while (!stack.empty()) {
+        const auto &node = nodes[stack.back()];
+        stack.pop_back();
+        if (box_distance_squared(p, node) > distance * distance)
+          continue;
+
+        if (node.count > 0) {
+          for (std::size_t t = 3 * node.first; t < 3 * (node.first + node.count); t += 3) {
+            distance = std::min(distance, triangle_distance(p, vertices[triangles[t]],
+                                                            vertices[triangles[t + 1]],
+                                                            vertices[triangles[t + 2]]));
+          }
+        } else {
+          // Push the farther child first so the nearer one is visited first and tightens the bound
+          const bool near_first = box_distance_squared(p, nodes[node.first]) <= box_distance_squared(p, nodes[node.first + 1]);
+          stack.push_back(near_first ? node.first + 1 : node.first);
+          stack.push_back(near_first ? node.first : node.first + 1);
+        }
+      }
+      return distance;
+    }
+
+    /*! Build the field from an OBJ mesh
+     * Unsigned distances are the minimum over the triangles, found through a bounding volume hierarchy. Signs come
+     * from the parity of crossings of a ray cast along z through each grid column, tested only against the triangles
+     * whose xy bounds cover that column, so the mesh should be closed
+     * @param file_name OBJ file
+     * @param values    Filled with the signed distances
+     */
+    void voxelize(const std::string &file_name, std::vector<Real> &values) {
+      std::vector<Vec<double, 3>> vertices;
+      std::vector<std::size_t> triangles;
+      read_obj(file_name, vertices, triangles);
+      if (triangles.empty())
+        throw std::runtime_error("boundary OBJ contains no faces: " + file_name);
+
+      Vec<double, 3> lower{std::numeric_limits<double>::max()};
+      Vec<double, 3> upper{std::numeric_limits<double>::lowest()};
+      for (const auto &vertex : vertices) {
+        for (std::size_t d = 0; d < 3; ++d) {
+          lower[d] = std::min(lower[d], vertex[d]);
+          upper[d] = std::max(upper[d], vertex[d]);
+        }
+      }
+
+      // Pad so the push out gradient is defined at the mesh surface
+      const double spacing = spacing_;
+      std::size_t dimensions[3];
+      for (std::size_t d = 0; d < 3; ++d) {
+        lower[d] -= 2.0 * spacing;
+        upper[d] += 2.0 * spacing;
+        dimensions[d] = static_cast<std::size_t>(std::ceil((upper[d] - lower[d]) / spacing)) + 1;
+      }
+      for (std::size_t d = 0; d < Dim; ++d) {
+        dimensions_[d] = dimensions[d];
+        origin_[d] = static_cast<Real>(lower[d]);
+      }
+
+      values.resize(dimensions[0] * dimensions[1] * dimensions[2]);
+      std::vector<double> crossings;
+      std::vector<std::size_t> stack;
+      const auto nodes = build_hierarchy(vertices, triangles);
+
+      // Bucket triangles by the grid column rays their xy bounds may be crossed by
+      const double x_offset = 1.234567e-4 * spacing;
+      const double y_offset = 2.345678e-4 * spacing;
+      const auto first_column = [&](double coordinate, double origin, double offset) {
+        return static_cast<std::size_t>(std::max(std::ceil((coordinate - origin - offset) / spacing), 0.0));
+      };
+      const auto last_column = [&](double coordinate, double origin, double offset, std::size_t dimension) {
+        return std::min(static_cast<std::size_t>(std::max(std::floor((coordinate - origin - offset) / spacing), 0.0)),
+                        dimension - 1);
+      };
+      std::vector<std::size_t> column_offsets(dimensions[0] * dimensions[1] + 1, 0);
+      std::vector<std::size_t> column_triangles;
+      for (int pass = 0; pass < 2; ++pass) {
+        for (std::size_t t = 0; t < triangles.size(); t += 3) {
+          const auto &a = vertices[triangles[t]];
+          const auto &b = vertices[triangles[t + 1]];
+          const auto &c = vertices[triangles[t + 2]];
+          const std::size_t i_begin = first_column(std::min({a.x, b.x, c.x}), lower[0], x_offset);
+          const std::size_t i_end = last_column(std::max({a.x, b.x, c.x}), lower[0], x_offset, dimensions[0]);
+          const std::size_t j_begin = first_column(std::min({a.y, b.y, c.y}), lower[1], y_offset);
+          const std::size_t j_end = last_column(std::max({a.y, b.y, c.y}), lower[1], y_offset, dimensions[1]);
+          for (std::size_t j = j_begin; j <= j_end; ++j) {
+            for (std::size_t i = i_begin; i <= i_end; ++i) {
+              const std::size_t column = j * dimensions[0] + i;
+              if (pass == 0)
+                ++column_offsets[column + 1];
+              else
+                column_triangles[column_offsets[column]++] = t;
+            }
+          }
+        }
+        if (pass == 0) {
+          for (std::size_t column = 0; column < dimensions[0] * dimensions[1]; ++column)
+            column_offsets[column + 1] += column_offsets[column];
+          column_triangles.resize(column_offsets.back());
+        } else {
+          // Filling advanced each offset to the start of the next column, shift them back
+          for (std::size_t column = dimensions[0] * dimensions[1]; column > 0; --column)
+            column_offsets[column] = column_offsets[column - 1];
+          column_offsets[0] = 0;
+        }
+      }
+
+      for (std::size_t j = 0; j < dimensions[1]; ++j) {
+        for (std::size_t i = 0; i < dimensions[0]; ++i) {
+          const double x = lower[0] + i * spacing;
+          const double y = lower[1] + j * spacing;
+
+          // The ray is offset slightly so it doesn't pass exactly through mesh edges or vertices
+          const double x_ray = x + x_offset;
+          const double y_ray = y + y_offset;
+
+          // z values where the column ray crosses the surface
+          crossings.clear();
+          const std::size_t column = j * dimensions[0] + i;
+          for (std::size_t c_t = column_offsets[column]; c_t < column_offsets[column + 1]; ++c_t) {
+            const std::size_t t = column_triangles[c_t];
+            const auto &a = vertices[triangles[t]];
+            const auto &b = vertices[triangles[t + 1]];
+            const auto &c = vertices[triangles[t + 2]];
+            const double area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+            if (area == 0.0)
+              continue;
+            const double u = ((b.x - x_ray) * (c.y - y_ray) - (c.x - x_ray) * (b.y - y_ray)) / area;
+            const double v = ((c.x - x_ray) * (a.y - y_ray) - (a.x - x_ray) * (c.y - y_ray)) / area;
+            const double w = 1.0 - u - v;
+            if (u < 0.0 || v < 0.0 || w < 0.0)
+              continue;
+            crossings.push_back(u * a.z + v * b.z + w * c.z);
+          }
+          std::sort(crossings.begin(), crossings.end());
+
+          // The distance changes by at most the spacing between neighboring nodes of a column, which bounds the search
+          double distance = std::numeric_limits<double>::max();
+          for (std::size_t k = 0; k < dimensions[2]; ++k) {
+            const Vec<double, 3> p{x, y, lower[2] + k * spacing};
+            const double bound = distance == std::numeric_limits<double>::max() ? distance : distance + spacing;
+            distance = nearest_distance(p, bound, nodes, vertices, triangles, stack);
+
+            const auto below = std::lower_bound(crossings.begin(), crossings.end(), p.z) - crossings.begin();
+            const bool inside = (below % 2) == 1;
+            values[(k * dimensions[1] + j) * dimensions[0] + i] = static_cast<Real>(inside ? -distance : distance);
+          }
+        }
+      }
+    }
+  };
+
+}
@@ -26,13 +26,31 @@ THE SOFTWARE.
 #include "parameters.h"
 #include "particles.h"
 #include "distributor.h"
+#include "flip_grid.h"
 
 // Create 12 x 4( x 1) particle initial fluid
 // Smoothing radius is set to the particle rest spacing to simplify thing
 
+// Most scenarios hard code the domains, neighbors, and particle counts of 3 compute ranks dividing the
+// distributor_test.ini fluid, they're skipped at any other rank count
+template<typename Distributor>
+static bool compute_ranks(const Distributor& d, int count) {
+  if (d.comm_compute_.size() == count)
+    return true;
+  WARN("Skipped, the scenario requires " << count << " compute ranks");
+  return false;
+}
+
+template<typename Distributor>
+static bool three_compute_ranks(const Distributor& d) {
+  return compute_ranks(d, 3);
+}
+
 SCENARIO("A distributor can be constructed") {
   GIVEN("an initializeddistributorr<float,2> with 3 processes") {
     sim::Distributor<float, 2> d{false};
+    if (!three_compute_ranks(d))
+      return;
     sim::Parameters<float, 2> params{"distributor_test.ini"};
     WHEN("comm_compute_ is queried for basic information") {
       THEN("comm_compute knows about its neighbors") {
@@ -57,6 +75,8 @@ SCENARIO("A distributor can be constructed") {
 
   GIVEN("an initialized distributorr<float,3> with 3 processes") {
     sim::Distributor<float, 3> d{false};
+    if (!three_compute_ranks(d))
+      return;
     sim::Parameters<float, 3> params{"distributor_test.ini"};
     WHEN("comm_compute_ is queried for basic information") {
       THEN("comm_compute knows about its neighbors") {
@@ -83,22 +103,24 @@ SCENARIO("A distributor can be constructed") {
 SCENARIO("A distributor can initialize fluid") {
   GIVEN("an initialized distributor<float,2> with 3 processes") {
     sim::Distributor<float, 2> d{false};
+    if (!three_compute_ranks(d))
+      return;
     sim::Parameters<float, 2> params{"distributor_test.ini"};
     sim::Particles<float, 2> particles{params};
     WHEN("the distributor initializes the fluid") {
       d.initialize_fluid(particles, params);
       THEN("the domain bounds are correct") {
         if (d.comm_compute_.rank() == 0) {
-          REQUIRE(d.domain_.begin == Approx(0.0f));
-          REQUIRE(d.domain_.end == Approx(3.0f));
+          REQUIRE(d.domain_.min.x == Approx(0.0f));
+          REQUIRE(d.domain_.max.x == Approx(3.0f));
         }
         if (d.comm_compute_.rank() == 1) {
-          REQUIRE(d.domain_.begin == Approx(3.0f));
-          REQUIRE(d.domain_.end == Approx(6.0f));
+          REQUIRE(d.domain_.min.x == Approx(3.0f));
+          REQUIRE(d.domain_.max.x == Approx(6.0f));
         }
         if (d.comm_compute_.rank() == 2) {
-          REQUIRE(d.domain_.begin == Approx(6.0f));
-          REQUIRE(d.domain_.end == Approx(11.0f));
+          REQUIRE(d.domain_.min.x == Approx(6.0f));
+          REQUIRE(d.domain_.max.x == Approx(11.0f));
         }
       }
     }
@@ -106,22 +128,24 @@ SCENARIO("A distributor can initialize fluid") {
 
   GIVEN("an initialized distributor<float,3> with 3 processes") {
     sim::Distributor<float, 3> d{false};
+    if (!three_compute_ranks(d))
+      return;
     sim::Parameters<float, 3> params{"distributor_test.ini"};
     sim::Particles<float, 3> particles{params};
     WHEN("the distributor initializes the fluid") {
       d.initialize_fluid(particles, params);
       THEN("the domain bounds are correct") {
         if (d.comm_compute_.rank() == 0) {
-          REQUIRE(d.domain_.begin == Approx(0.0f));
-          REQUIRE(d.domain_.end == Approx(3.0f));
+          REQUIRE(d.domain_.min.x == Approx(0.0f));
+          REQUIRE(d.domain_.max.x == Approx(3.0f));
         }
         if (d.comm_compute_.rank() == 1) {
-          REQUIRE(d.domain_.begin == Approx(3.0f));
-          REQUIRE(d.domain_.end == Approx(6.0f));
+          REQUIRE(d.domain_.min.x == Approx(3.0f));
+          REQUIRE(d.domain_.max.x == Approx(6.0f));
         }
         if (d.comm_compute_.rank() == 2) {
-          REQUIRE(d.domain_.begin == Approx(6.0f));
-          REQUIRE(d.domain_.end == Approx(11.0f));
+          REQUIRE(d.domain_.min.x == Approx(6.0f));
+          REQUIRE(d.domain_.max.x == Approx(11.0f));
         }
       }
     }
@@ -129,6 +153,8 @@ SCENARIO("A distributor can initialize fluid") {
 
   GIVEN("an initialized distributor<float,2> with 3 processes") {
     sim::Distributor<float, 2> d{false};
+    if (!three_compute_ranks(d))
+      return;
     sim::Parameters<float, 2> params{"distributor_test.ini"};
     sim::Particles<float, 2> particles{params};
     WHEN("the distributor initializes the fluid") {
@@ -149,6 +175,8 @@ SCENARIO("A distributor can initialize fluid") {
 
   GIVEN("an initialized distributor<float,3> with 3 processes") {
     sim::Distributor<float, 3> d{false};
+    if (!three_compute_ranks(d))
+      return;
     sim::Parameters<float, 3> params{"distributor_test.ini"};
     sim::Particles<float, 3> particles{params};
     WHEN("the distributor initializes the fluid") {
@@ -171,6 +199,8 @@ SCENARIO("A distributor can initialize fluid") {
 SCENARIO("When halos are exchanged spans and counts are computed correct") {
   GIVEN("an initialized distributor<float,3> with 3 processes") {
     sim::Distributor<float, 3> d{false};
+    if (!three_compute_ranks(d))
+      return;
     sim::Parameters<float, 3> params{"distributor_test.ini"};
     sim::Particles<float, 3> particles{params};
     d.initialize_fluid(particles, params);
@@ -260,6 +290,8 @@ SCENARIO("When halos are exchanged spans and counts are computed correct") {
 
   GIVEN("an initialized distributor<float,2> with 3 processes") {
     sim::Distributor<float, 2> d{false};
+    if (!three_compute_ranks(d))
+      return;
     sim::Parameters<float, 2> params{"distributor_test.ini"};
     sim::Particles<float, 2> particles{params};
     d.initialize_fluid(particles, params);
@@ -348,9 +380,59 @@ SCENARIO("When halos are exchanged spans and counts are computed correct") {
   }
 }
 
+SCENARIO("Halos are exchanged with face and diagonal neighbors") {
+  GIVEN("an initialized distributor<float,3> with 4 processes in a 2 x 2 grid") {
+    sim::Distributor<float, 3> d{false};
+    if (!compute_ranks(d, 4))
+      return;
+    sim::Parameters<float, 3> params{"distributor_test.ini"};
+    sim::Particles<float, 3> particles{params};
+    d.initialize_fluid(particles, params);
+    REQUIRE(d.dims_.x == 2);
+    REQUIRE(d.dims_.y == 2);
+
+    WHEN("the domains are synced") {
+      d.invalidate_halo(particles);
+      d.domain_sync(particles);
+
+      // Domains split x at 4.5 and y at 2, the lower x domains hold 4 columns of particles and the upper 5
+      THEN("each neighbor sends the particles within an edge width of the shared faces") {
+        const int x_side = (d.coords_.x == 0 ? 1 : -1);
+        const int y_side = (d.coords_.y == 0 ? 1 : -1);
+        const int x_neighbor = d.neighbor_index(Vec<int,3>{x_side, 0, 0});
+        const int y_neighbor = d.neighbor_index(Vec<int,3>{0, y_side, 0});
+        const int diagonal_neighbor = d.neighbor_index(Vec<int,3>{x_side, y_side, 0});
+        const bool lower_x = (d.coords_.x == 0);
+
+        REQUIRE(d.halo_counts_[x_neighbor] == (lower_x ? 4u : 2u));
+        REQUIRE(d.halo_counts_[y_neighbor] == (lower_x ? 4u : 5u));
+        REQUIRE(d.halo_counts_[diagonal_neighbor] == (lower_x ? 2u : 1u));
+        for(int n=0; n<d.neighbor_domain_count(); ++n) {
+          if(n != x_neighbor && n != y_neighbor && n != diagonal_neighbor)
+            CHECK(d.halo_counts_[n] == 0);
+        }
+      }
+
+      AND_THEN("the diagonal halo holds the particle nearest the shared corner") {
+        const int diagonal_neighbor = d.neighbor_index(Vec<int,3>{d.coords_.x == 0 ? 1 : -1,
+                                                                   d.coords_.y == 0 ? 1 : -1, 0});
+        std::size_t begin = d.resident_count();
+        for(int n=0; n<diagonal_neighbor; ++n)
+          begin += d.halo_counts_[n];
+        for(std::size_t p=begin; p<begin + d.halo_counts_[diagonal_neighbor]; ++p) {
+          CHECK(std::fabs(particles.positions()[p].x - 4.5f) < 1.5f);
+          CHECK(particles.positions()[p].y == Approx(d.coords_.y == 0 ? 2.5f : 1.5f));
+        }
+      }
+    }
+  }
+}
+
 SCENARIO("When out of bound particles are exchanged spans and counts are computed correct") {
   GIVEN("an initialized distributor<float,3> with 3 processes") {
     sim::Distributor<float, 3> d{false};
+    if (!three_compute_ranks(d))
+      return;
     sim::Parameters<float, 3> params{"distributor_test.ini"};
     sim::Particles<float, 3> particles{params};
     d.initialize_fluid(particles, params);
@@ -455,6 +537,8 @@ SCENARIO("When out of bound particles are exchanged spans and counts are compute
 
   GIVEN("an initialized distributor<float,2> with 2 processes") {
     sim::Distributor<float, 2> d{false};
+    if (!three_compute_ranks(d))
+      return;
     sim::Parameters<float, 2> params{"distributor_test.ini"};
     sim::Particles<float, 2> particles{params};
     d.initialize_fluid(particles, params);
@@ -556,4 +640,456 @@ SCENARIO("When out of bound particles are exchanged spans and counts are compute
       }
     }
   }
-}
\ No newline at end of file
+}
+SCENARIO("Unbalanced domains are repartitioned") {
+  GIVEN("an initialized distributor<float,2> with 3 processes") {
+    sim::Distributor<float, 2> d{false};
+    if (!three_compute_ranks(d))
+      return;
+    sim::Parameters<float, 2> params{"distributor_test.ini"};
+    sim::Particles<float, 2> particles{params};
+    d.initialize_fluid(particles, params);
+    WHEN("the balanced domains are checked") {
+      THEN("the domains are not repartitioned") {
+        REQUIRE(d.load_imbalance() == Approx(0.0f));
+        REQUIRE_FALSE(d.balance_domains(particles, params));
+      }
+    }
+
+    WHEN("the middle domain is widened and particles migrated") {
+      d.splits_[0][1] = 1.5f;
+      d.splits_[0][2] = 7.5f;
+      d.update_domain();
+      d.migrate_particles(particles);
+
+      THEN("the middle domain owns the most particles") {
+        if (d.comm_compute_.rank() == 0)
+          REQUIRE(d.resident_count() == 4);
+        if (d.comm_compute_.rank() == 1)
+          REQUIRE(d.resident_count() == 24);
+        if (d.comm_compute_.rank() == 2)
+          REQUIRE(d.resident_count() == 8);
+      }
+
+      AND_WHEN("the domains are balanced") {
+        const bool repartitioned = d.balance_domains(particles, params);
+
+        THEN("the particles are evenly divided") {
+          REQUIRE(repartitioned);
+          REQUIRE(d.resident_count() == 12);
+          if (d.comm_compute_.rank() == 1) {
+            REQUIRE(d.domain_.min.x > 2.5f);
+            REQUIRE(d.domain_.min.x < 3.5f);
+            REQUIRE(d.domain_.max.x > 5.5f);
+            REQUIRE(d.domain_.max.x < 6.5f);
+          }
+        }
+      }
+
+      AND_WHEN("the domains are balanced with a halo wider than a third of the boundary") {
+        d.edge_width_ = 4.0f;
+        d.balance_domains(particles, params);
+
+        THEN("the planes are left in place rather than crossed") {
+          REQUIRE(d.splits_[0][1] == Approx(1.5f));
+          REQUIRE(d.splits_[0][2] == Approx(7.5f));
+          REQUIRE(d.global_resident_count() == 36);
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("Domains are balanced by measured compute cost") {
+  GIVEN("an initialized distributor<float,2> with 3 processes and an evenly divided fluid") {
+    sim::Distributor<float, 2> d{false};
+    if (!three_compute_ranks(d))
+      return;
+    sim::Parameters<float, 2> params{"distributor_test.ini"};
+    sim::Particles<float, 2> particles{params};
+    d.initialize_fluid(particles, params);
+
+    WHEN("the middle domain is measured to be three times as expensive") {
+      d.compute_cost_ = (d.comm_compute_.rank() == 1 ? 3.0 : 1.0);
+
+      THEN("the load is unbalanced although particle counts are equal") {
+        REQUIRE(d.resident_count() == 12);
+        REQUIRE(d.load_imbalance() == Approx(0.8f));
+      }
+
+      AND_WHEN("the domains are balanced") {
+        const bool repartitioned = d.balance_domains(particles, params);
+
+        THEN("the middle domain gives up particles") {
+          REQUIRE(repartitioned);
+          REQUIRE(d.global_resident_count() == 36);
+          if (d.comm_compute_.rank() == 1) {
+            REQUIRE(d.resident_count() < 12);
+            REQUIRE(d.domain_.max.x - d.domain_.min.x < 3.0f);
+          }
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("Halo values are synced with persistent requests") {
+  GIVEN("an initialized distributor<float,3> with 3 processes and exchanged halos") {
+    sim::Distributor<float, 3> d{false};
+    if (!three_compute_ranks(d))
+      return;
+    sim::Parameters<float, 3> params{"distributor_test.ini"};
+    sim::Particles<float, 3> particles{params};
+    d.initialize_fluid(particles, params);
+    d.invalidate_halo(particles);
+    d.domain_sync(particles);
+    const int rank = d.comm_compute_.rank();
+
+    WHEN("a scalar array is synced twice") {
+      for(int sync=0; sync<2; ++sync) {
+        for(std::size_t p=0; p<d.resident_count(); ++p)
+          particles.densities()[p] = static_cast<float>(10*sync + rank);
+        d.initiate_sync_halo_scalar(particles, particles.densities());
+        d.finalize_sync_halo_scalar();
+      }
+
+      THEN("the halo holds the neighbors latest values") {
+        std::size_t p = d.halo_span().begin;
+        for(int n=0; n<d.neighbor_domain_count(); ++n) {
+          for(std::size_t i=0; i<d.halo_counts_[n]; ++i, ++p)
+            REQUIRE(particles.densities()[p] == Approx(10.0f + d.neighbor_rank(n)));
+        }
+        REQUIRE(p == d.halo_span().end);
+      }
+
+      AND_THEN("the requests were built once") {
+        REQUIRE(d.halo_sync_count_ == 1);
+      }
+    }
+  }
+}
+
+SCENARIO("Halos of neighbors on the same node are read from shared memory") {
+  GIVEN("an initialized distributor<float,3> with 3 processes on one node") {
+    sim::Distributor<float, 3> d{false};
+    if (!three_compute_ranks(d))
+      return;
+    sim::Parameters<float, 3> params{"distributor_test.ini"};
+    sim::Particles<float, 3> particles{params};
+    d.initialize_fluid(particles, params);
+
+    int node_size = 0;
+    MPI_Comm_size(d.comm_node_, &node_size);
+    REQUIRE(node_size == d.comm_compute_.size());
+
+    WHEN("the domains are synced twice") {
+      d.invalidate_halo(particles);
+      d.domain_sync(particles);
+      const std::size_t first_halo_count = d.halo_count();
+      d.invalidate_halo(particles);
+      d.domain_sync(particles);
+
+      THEN("every neighbor is read from the node window") {
+        int neighbors = 0;
+        for(int n=0; n<d.neighbor_domain_count(); ++n)
+          neighbors += d.neighbor_rank(n) != MPI_PROC_NULL;
+        REQUIRE(d.shared_neighbor_count() == neighbors);
+      }
+
+      AND_THEN("the halo particles come from the neighboring domains") {
+        REQUIRE(d.halo_count() == first_halo_count);
+        for(std::size_t p=d.halo_span().begin; p<d.halo_span().end; ++p) {
+          const float x = particles.positions()[p][0];
+          REQUIRE((x < d.domain().min[0] || x > d.domain().max[0]));
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("Halos can be exchanged with one sided puts") {
+  GIVEN("an initialized distributor<float,3> with 3 processes and a two sided halo exchange") {
+    sim::Distributor<float, 3> d{false};
+    if (!three_compute_ranks(d))
+      return;
+    sim::Parameters<float, 3> params{"distributor_test.ini"};
+    sim::Particles<float, 3> particles{params};
+    d.initialize_fluid(particles, params);
+    d.invalidate_halo(particles);
+    d.domain_sync(particles);
+
+    std::vector<std::size_t> message_counts(d.halo_counts_, d.halo_counts_ + d.neighbor_domain_count());
+    std::vector<Vec<float,3>> message_halo;
+    for(std::size_t p=d.halo_span().begin; p<d.halo_span().end; ++p)
+      message_halo.push_back(particles.positions()[p]);
+
+    WHEN("the halo is exchanged twice with one sided puts") {
+      params.halo_exchange_ = sim::Parameters<float, 3>::RMA;
+      d.process_parameters(params, particles);
+      for(int exchange=0; exchange<2; ++exchange) {
+        d.invalidate_halo(particles);
+        d.domain_sync(particles);
+      }
+
+      THEN("the halo matches the two sided exchange") {
+        for(int n=0; n<d.neighbor_domain_count(); ++n)
+          REQUIRE(d.halo_counts_[n] == message_counts[n]);
+        REQUIRE(d.halo_count() == message_halo.size());
+        for(std::size_t i=0; i<message_halo.size(); ++i)
+          REQUIRE(particles.positions()[d.halo_span().begin + i][0] == Approx(message_halo[i][0]));
+      }
+    }
+  }
+}
+
+SCENARIO("Halos can be exchanged with encoded particles") {
+  GIVEN("an initialized distributor<float,3> with 3 processes and an uncompressed halo exchange") {
+    sim::Distributor<float, 3> d{false};
+    if (!three_compute_ranks(d))
+      return;
+    sim::Parameters<float, 3> params{"distributor_test.ini"};
+    sim::Particles<float, 3> particles{params};
+    d.initialize_fluid(particles, params);
+    d.invalidate_halo(particles);
+    d.domain_sync(particles);
+
+    std::vector<std::size_t> raw_counts(d.halo_counts_, d.halo_counts_ + d.neighbor_domain_count());
+    std::vector<Vec<float,3>> raw_halo;
+    for(std::size_t p=d.halo_span().begin; p<d.halo_span().end; ++p)
+      raw_halo.push_back(particles.positions()[p]);
+
+    const float precision = 1.0e-3f;
+    params.halo_position_precision_ = precision;
+
+    WHEN("the halo is exchanged with messages between ranks which don't share memory") {
+      for(int n=0; n<d.neighbor_domain_count(); ++n)
+        d.neighbor_windows_[n] = nullptr;
+      d.process_parameters(params, particles);
+      d.invalidate_halo(particles);
+      d.domain_sync(particles);
+
+      THEN("the halo matches the uncompressed exchange within the precision") {
+        for(int n=0; n<d.neighbor_domain_count(); ++n)
+          REQUIRE(d.halo_counts_[n] == raw_counts[n]);
+        REQUIRE(d.halo_count() == raw_halo.size());
+        for(std::size_t i=0; i<raw_halo.size(); ++i)
+          REQUIRE(std::abs(particles.positions()[d.halo_span().begin + i][0] - raw_halo[i][0]) <= precision);
+      }
+    }
+
+    WHEN("the halo is exchanged with one sided puts") {
+      params.halo_exchange_ = sim::Parameters<float, 3>::RMA;
+      d.process_parameters(params, particles);
+      d.invalidate_halo(particles);
+      d.domain_sync(particles);
+
+      THEN("the halo matches the uncompressed exchange within the precision") {
+        REQUIRE(d.halo_count() == raw_halo.size());
+        for(std::size_t i=0; i<raw_halo.size(); ++i)
+          REQUIRE(std::abs(particles.positions()[d.halo_span().begin + i][0] - raw_halo[i][0]) <= precision);
+      }
+    }
+  }
+}
+
+SCENARIO("Neighbors can be found while the halo is exchanged") {
+  GIVEN("an initialized distributor<float,3> with 3 processes") {
+    sim::Distributor<float, 3> d{false};
+    if (!three_compute_ranks(d))
+      return;
+    sim::Parameters<float, 3> params{"distributor_test.ini"};
+    sim::Particles<float, 3> particles{params};
+    d.initialize_fluid(particles, params);
+    d.invalidate_halo(particles);
+
+    WHEN("interior neighbors are found before the halo exchange is finalized") {
+      d.initiate_domain_sync(particles);
+      particles.find_neighbors(d.resident_span(), d.interior_span());
+      d.finalize_domain_sync(particles);
+      particles.find_neighbors(d.local_span(), d.edge_span());
+
+      std::vector<int> overlapped_counts;
+      for(std::size_t p=0; p<d.resident_count(); ++p)
+        overlapped_counts.push_back(particles.neighbors()[p].count);
+
+      THEN("the neighbors match a search after the halo exchange") {
+        particles.find_neighbors(d.local_span(), d.resident_span());
+        for(std::size_t p=0; p<d.resident_count(); ++p)
+          REQUIRE(particles.neighbors()[p].count == overlapped_counts[p]);
+      }
+    }
+  }
+}
+
+SCENARIO("A deep halo can be exchanged") {
+  GIVEN("an initialized distributor<float,2> with 3 processes") {
+    sim::Distributor<float, 2> d{false};
+    if (!three_compute_ranks(d))
+      return;
+    sim::Parameters<float, 2> params{"distributor_test.ini"};
+    sim::Particles<float, 2> particles{params};
+    d.initialize_fluid(particles, params);
+
+    WHEN("the halo depth is set deeper than the domains allow") {
+      d.set_halo_layers(4);
+
+      THEN("the depth is limited by the narrowest domain") {
+        REQUIRE(d.max_halo_layers() == 2);
+        REQUIRE(d.halo_layers() == 2);
+        REQUIRE(d.deep_halo());
+      }
+
+      AND_WHEN("the domains are synced") {
+        d.invalidate_halo(particles);
+        d.domain_sync(particles);
+
+        THEN("two edge widths of particles are exchanged and solved") {
+          if (d.comm_compute_.rank() == 0) {
+            REQUIRE(d.edge_count() == 12);
+            REQUIRE(d.halo_count() == 8);
+          }
+          if (d.comm_compute_.rank() == 1) {
+            REQUIRE(d.edge_count() == 12);
+            REQUIRE(d.halo_count() == 16);
+          }
+          if (d.comm_compute_.rank() == 2) {
+            REQUIRE(d.edge_count() == 8);
+            REQUIRE(d.halo_count() == 8);
+          }
+          REQUIRE(d.solve_span().end == d.local_span().end);
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("The halo depth is chosen by measured cost") {
+  GIVEN("an initialized distributor<float,3> with 3 processes and an automatic halo depth") {
+    sim::Distributor<float, 3> d{false};
+    if (!three_compute_ranks(d))
+      return;
+    sim::Parameters<float, 3> params{"distributor_test.ini"};
+    params.solve_step_count_ = 1;
+    sim::Particles<float, 3> particles{params};
+    d.initialize_fluid(particles, params);
+
+    // Narrow edges so the required depth fits in the domains
+    d.edge_width_ = 0.25f;
+    const int required = d.required_halo_layers(params);
+    REQUIRE(required == 12);
+    REQUIRE(d.max_halo_layers() == 12);
+
+    // Steps as the main loop takes them, the measured costs are replaced by the given ones
+    auto step = [&](double compute_cost, double exchange_cost, double sync_cost) {
+      d.invalidate_halo(particles);
+      d.process_parameters(params, particles);
+      d.domain_sync(particles);
+      d.compute_cost_ = compute_cost;
+      d.exchange_cost_ = exchange_cost;
+      d.sync_cost_ = sync_cost;
+    };
+
+    WHEN("halo value syncs are expensive") {
+      for(int i=0; i<3; ++i)
+        step(1.0e-3, 1.0e-5, 1.0);
+
+      THEN("the deep halo is used") {
+        REQUIRE(d.halo_layers() == required);
+        REQUIRE(d.halo_layer_count_ > 0.0);
+      }
+
+      AND_WHEN("compute becomes expensive") {
+        for(int i=0; i<3; ++i)
+          step(100.0, 1.0e-5, 1.0e-6);
+
+        THEN("the single layer halo is used again") {
+          REQUIRE(d.halo_layers() == 1);
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("The hybrid grid pressure solve is distributed over the domains") {
+  GIVEN("an initialized distributor<float,3> with falling fluid") {
+    sim::Distributor<float, 3> d{false};
+    sim::Parameters<float, 3> params{"distributor_test.ini"};
+    sim::Particles<float, 3> particles{params};
+    d.initialize_fluid(particles, params);
+    d.invalidate_halo(particles);
+    for(std::size_t p=0; p<d.resident_count(); ++p)
+      particles.velocities()[p] = Vec<float,3>{0.0f, -1.0f, 0.0f};
+    d.domain_sync(particles);
+    particles.find_neighbors(d.local_span(), d.local_span());
+
+    // Every rank solves the whole fluid on its own as the reference
+    sim::Particles<float, 3> whole{params};
+    whole.construct_fluid(params.initial_fluid());
+    const IndexSpan whole_span{0, whole.local_count()};
+    for(std::size_t p=0; p<whole.local_count(); ++p)
+      whole.velocities()[p] = Vec<float,3>{0.0f, -1.0f, 0.0f};
+    whole.find_neighbors(whole_span, whole_span);
+    sim::FlipGrid<float, 3> reference{params, whole.neighbors()};
+    reference.particles_to_grid(whole);
+    reference.project();
+
+    WHEN("the grid is decomposed and projected") {
+      sim::FlipGrid<float, 3> grid{params, particles.neighbors()};
+      grid.decompose(d);
+      grid.particles_to_grid(particles);
+      grid.project(d);
+
+      THEN("owned and ghost cells match the single process solve") {
+        Vec<std::size_t, 3> low;
+        Vec<std::size_t, 3> high;
+        grid.owned_cells(low, high);
+        REQUIRE(d.global_resident_count() == 36);
+
+        float max_pressure = 0.0f;
+        for(std::size_t k=low[2]-1; k<=high[2]; ++k) {
+          for(std::size_t j=low[1]-1; j<=high[1]; ++j) {
+            for(std::size_t i=low[0]-1; i<=high[0]; ++i) {
+              CHECK(grid.cell_type(i, j, k) == reference.cell_type(i, j, k));
+              CHECK(grid.pressure(i, j, k) == Approx(reference.pressure(i, j, k)));
+              max_pressure = std::max(max_pressure, std::fabs(reference.pressure(i, j, k)));
+            }
+          }
+        }
+        REQUIRE(max_pressure > 0.0f);
+      }
+    }
+  }
+}
+
+SCENARIO("Particles are conserved with any number of compute ranks") {
+  GIVEN("an initialized distributor<float,3> with an 8 x 4 x 1 fluid") {
+    sim::Distributor<float, 3> d{false};
+    sim::Parameters<float, 3> params{"distributor_test.ini"};
+    // Particles sit at half spacings, a fluid 8 wide keeps them off the initial planes of up to 31 domains along x
+    params.initial_fluid_.max.x = 8.0f;
+    sim::Particles<float, 3> particles{params};
+    d.initialize_fluid(particles, params);
+
+    WHEN("the fluid is initialized") {
+      THEN("every particle is owned by exactly one domain") {
+        REQUIRE(d.global_resident_count() == 32);
+      }
+    }
+
+    WHEN("every particle moves a quarter spacing along x and the domains are synced") {
+      for(std::size_t p=d.resident_span().begin; p<d.resident_span().end; ++p)
+        particles.position_stars()[p].x += 0.25f;
+      d.invalidate_halo(particles);
+      d.domain_sync(particles);
+
+      THEN("the particles are migrated to the domains containing them without being lost or duplicated") {
+        // CHECK rather than REQUIRE so a failure on one rank doesn't skip the collective below on it alone
+        for(std::size_t p=d.resident_span().begin; p<d.resident_span().end; ++p) {
+          CHECK(particles.position_stars()[p].x >= d.domain_.min.x);
+          CHECK(particles.position_stars()[p].x < d.domain_.max.x);
+        }
+        REQUIRE(d.global_resident_count() == 32);
+      }
+    }
+  }
+}
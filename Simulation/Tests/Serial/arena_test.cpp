@@ -0,0 +1,91 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "catch.hpp"
+#include <cstdint>
+#include <sstream>
+#include "arena.h"
+#include "array.h"
+
+SCENARIO("Arrays can be carved from an arena", "[Arena]") {
+  GIVEN("an arena reserving 1 MiB") {
+    sim::Arena arena(1024 * 1024);
+
+    WHEN("two arrays are carved from it") {
+      sim::Array<float> a(1000, arena, "a");
+      sim::Array<double> b(10, arena, "b");
+
+      THEN("the arrays should have the requested capacity and no size") {
+        REQUIRE( a.capacity() == 1000 );
+        REQUIRE( a.size() == 0 );
+        REQUIRE( b.capacity() == 10 );
+      }
+      AND_THEN("the storage should be aligned and not overlap") {
+        const auto alignment = sim::allocation_policy().alignment;
+        REQUIRE( reinterpret_cast<std::uintptr_t>(a.data()) % alignment == 0 );
+        REQUIRE( reinterpret_cast<std::uintptr_t>(b.data()) % alignment == 0 );
+        REQUIRE( reinterpret_cast<char *>(b.data()) >= reinterpret_cast<char *>(a.data() + 1000) );
+      }
+      AND_THEN("the used bytes should include both arrays") {
+        REQUIRE( arena.used_bytes() >= 1000 * sizeof(float) + 10 * sizeof(double) );
+      }
+      AND_THEN("the memory map should list both arrays") {
+        std::ostringstream map;
+        arena.print_memory_map(map);
+        REQUIRE( map.str().find("a ") != std::string::npos );
+        REQUIRE( map.str().find("b ") != std::string::npos );
+      }
+    }
+
+    WHEN("values are appended to a carved array") {
+      sim::Array<float> a(1000, arena, "a");
+      a.push_back(2.0f, 1000);
+      THEN("the values should be stored in the arena") {
+        REQUIRE( a.size() == 1000 );
+        REQUIRE( a[999] == 2.0f );
+        REQUIRE( arena.resident_bytes(0, 1000 * sizeof(float)) > 0 );
+      }
+    }
+
+    WHEN("the same arrays are carved from a sizing arena") {
+      sim::Arena sizing;
+      sim::Array<char> c(3, sizing, "c");
+      sim::Array<double> d(10, sizing, "d");
+      sim::Array<char> e(3, arena, "c");
+      sim::Array<double> f(10, arena, "d");
+
+      THEN("the sizing arena should measure the reserved arena's used bytes without storage") {
+        REQUIRE( sizing.used_bytes() == arena.used_bytes() );
+        REQUIRE( c.data() == nullptr );
+        REQUIRE( d.data() == nullptr );
+      }
+    }
+
+    WHEN("more storage than is reserved is requested") {
+      THEN("an exception should be thrown") {
+        REQUIRE_THROWS( sim::Array<double>(1024 * 1024, arena, "too_large") );
+      }
+    }
+  }
+}
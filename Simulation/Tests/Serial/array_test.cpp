@@ -23,6 +23,7 @@ THE SOFTWARE.
 */
 
 #include "catch.hpp"
+#include <cstdint>
 #include "array.h"
 
 SCENARIO("Arrays can be constructed", "[Array]") {
@@ -109,3 +110,78 @@ SCENARIO("Arrays can have values pushed/popped from them", "[Array]") {
   }
 
 }
+
+SCENARIO("Arrays can be appended to and erased in bulk", "[Array]") {
+  GIVEN("an Array, a, with capacity of 10 floats holding 4 elements") {
+    sim::Array<float> a(10);
+    a.push_back(1.0f, 4);
+    float p[4] = {2.0f, 3.0f, 4.0f, 5.0f};
+
+    WHEN("4 floats are appended") {
+      a.push_back(p, 4);
+      THEN("the size should be 8 and the values should follow the existing elements") {
+        REQUIRE( a.size() == 8 );
+        REQUIRE( a[3] == 1.0f );
+        REQUIRE( a[4] == 2.0f );
+        REQUIRE( a[7] == 5.0f );
+      }
+    }
+
+    WHEN("more elements than are available are appended") {
+      THEN("an exception should be thrown and the size unchanged") {
+        REQUIRE_THROWS( a.push_back(0.0f, 7) );
+        REQUIRE_THROWS( a.push_back(p, 7) );
+        REQUIRE( a.size() == 4 );
+      }
+    }
+
+    WHEN("the array is resized without initialization") {
+      float *end = a.resize_uninitialized(10);
+      THEN("the size should be 10 and the returned pointer one past the end") {
+        REQUIRE( a.size() == 10 );
+        REQUIRE( end == a.data() + 10 );
+      }
+    }
+
+    WHEN("the array is resized past its capacity") {
+      THEN("an exception should be thrown") {
+        REQUIRE_THROWS( a.resize_uninitialized(11) );
+      }
+    }
+
+    WHEN("3 elements are erased from the tail") {
+      a.erase_tail(3);
+      THEN("the size should be 1") {
+        REQUIRE( a.size() == 1 );
+      }
+    }
+
+    WHEN("more elements than the size are erased") {
+      THEN("an exception should be thrown") {
+        REQUIRE_THROWS( a.erase_tail(5) );
+        REQUIRE( a.size() == 4 );
+      }
+    }
+  }
+}
+
+SCENARIO("Array storage follows the allocation policy", "[Array]") {
+  GIVEN("an allocation policy with 256 byte alignment and first touch enabled") {
+    const sim::AllocationPolicy previous_policy = sim::allocation_policy();
+    sim::allocation_policy() = sim::AllocationPolicy{256, true, false};
+
+    WHEN("an Array of 1000 floats is constructed") {
+      sim::Array<float> a(1000);
+      THEN("the data should be 256 byte aligned") {
+        REQUIRE( reinterpret_cast<std::uintptr_t>(a.data()) % 256 == 0 );
+      }
+      AND_THEN("every element should be value initialized") {
+        for(int i=0; i<1000; i++) {
+          REQUIRE( a.data()[i] == 0.0f );
+        }
+      }
+    }
+
+    sim::allocation_policy() = previous_policy;
+  }
+}
@@ -0,0 +1,88 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include "catch.hpp"
+#include "caching_allocator.h"
+
+SCENARIO("Temporary storage is cached", "[CachingAllocator]") {
+  GIVEN("a caching allocator") {
+    sim::CachingAllocator allocator;
+
+    WHEN("a block is allocated, returned, and a smaller block requested") {
+      char *first = allocator.allocate(1024);
+      allocator.deallocate(first, 1024);
+      char *second = allocator.allocate(512);
+
+      THEN("the cached block should be reused") {
+        REQUIRE( second == first );
+        REQUIRE( allocator.request_count() == 2 );
+        REQUIRE( allocator.system_allocation_count() == 1 );
+      }
+      AND_THEN("the high water mark should be the largest block in use") {
+        REQUIRE( allocator.high_water_bytes() == 1024 );
+        REQUIRE( allocator.cached_bytes() == 1024 );
+      }
+      allocator.deallocate(second, 512);
+    }
+
+    WHEN("two blocks are in use at once") {
+      char *first = allocator.allocate(256);
+      char *second = allocator.allocate(256);
+
+      THEN("distinct blocks should be allocated") {
+        REQUIRE( first != second );
+        REQUIRE( allocator.high_water_bytes() == 512 );
+      }
+
+      allocator.deallocate(first, 256);
+      allocator.deallocate(second, 256);
+      AND_WHEN("the cache is released") {
+        allocator.release();
+        THEN("no bytes should be cached") {
+          REQUIRE( allocator.cached_bytes() == 0 );
+        }
+      }
+    }
+
+    WHEN("a returned block is too small for a later request") {
+      char *first = allocator.allocate(256);
+      allocator.deallocate(first, 256);
+      char *second = allocator.allocate(1024);
+
+      THEN("the smaller block should be freed instead of cached") {
+        REQUIRE( allocator.system_allocation_count() == 2 );
+        REQUIRE( allocator.cached_bytes() == 1024 );
+      }
+      allocator.deallocate(second, 1024);
+    }
+
+    WHEN("an unknown block is returned") {
+      char unknown;
+      THEN("an exception should be thrown") {
+        REQUIRE_THROWS( allocator.deallocate(&unknown, 1) );
+      }
+    }
+  }
+}
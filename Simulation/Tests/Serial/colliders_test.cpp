@@ -0,0 +1,99 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "catch.hpp"
+#include "parameters.h"
+#include "signed_distance_field.h"
+#include "colliders.h"
+
+SCENARIO("Colliders can be read and applied") {
+  GIVEN("Colliders constructed from colliders_test.ini") {
+    sim::Parameters<float, 3> params{"colliders_test.ini"};
+    sim::SignedDistanceField<float, 3> sdf{params};
+    sim::Colliders<float, 3> colliders{params, sdf};
+
+    WHEN("the collider count is queried") {
+      THEN("the mover and both parameter colliders should be present") {
+        REQUIRE( params.collider_count() == 2 );
+        REQUIRE( colliders.count() == 3 );
+      }
+    }
+
+    WHEN("a point far from every collider is queried") {
+      THEN("no colliders should be candidates") {
+        REQUIRE( colliders.candidate_count(Vec<float, 3>{3.0f, 5.5f, 3.0f}) == 0 );
+      }
+    }
+
+    WHEN("a point inside the mover is pushed out") {
+      Vec<float, 3> position{1.1f, 1.0f, 1.0f};
+      colliders.push_out(position);
+      THEN("it should lie on the mover surface") {
+        REQUIRE( position.x == Approx(1.0f + params.mover_radius()) );
+      }
+    }
+
+    WHEN("a point inside the capsule is pushed out") {
+      Vec<float, 3> position{3.0f, 3.1f, 1.5f};
+      colliders.push_out(position);
+      THEN("it should move radially from the capsule axis") {
+        REQUIRE( position.x == Approx(3.0f) );
+        REQUIRE( position.y == Approx(3.25f) );
+        REQUIRE( position.z == Approx(1.5f) );
+      }
+    }
+
+    WHEN("a point inside the box is pushed out") {
+      Vec<float, 3> position{5.1f, 4.9f, 5.0f};
+      colliders.push_out(position);
+      THEN("it should exit through the nearest face") {
+        REQUIRE( position.x == Approx(5.1f) );
+        REQUIRE( position.y == Approx(4.75f) );
+      }
+    }
+
+    WHEN("the mover is moved and the colliders are updated") {
+      params.mover_center_ = Vec<float, 3>{4.0f, 1.0f, 1.0f};
+      colliders.update();
+      Vec<float, 3> position{4.1f, 1.0f, 1.0f};
+      colliders.push_out(position);
+      THEN("points should be pushed from the new mover location") {
+        REQUIRE( position.x == Approx(4.0f + params.mover_radius()) );
+      }
+      THEN("the mover should only be a candidate near its new location") {
+        REQUIRE( colliders.candidate_count(Vec<float, 3>{1.0f, 1.0f, 1.0f}) == 0 );
+        REQUIRE( colliders.candidate_count(Vec<float, 3>{4.0f, 1.0f, 1.0f}) == 1 );
+      }
+    }
+
+    WHEN("the colliders are updated without any of them moving") {
+      colliders.update();
+      THEN("the broad phase candidates should be unchanged") {
+        REQUIRE( colliders.candidate_count(Vec<float, 3>{1.0f, 1.0f, 1.0f}) == 1 );
+        REQUIRE( colliders.candidate_count(Vec<float, 3>{3.0f, 3.0f, 1.5f}) == 1 );
+        REQUIRE( colliders.candidate_count(Vec<float, 3>{5.0f, 5.0f, 5.0f}) == 1 );
+      }
+    }
+  }
+}
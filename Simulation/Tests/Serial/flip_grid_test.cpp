@@ -0,0 +1,93 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "catch.hpp"
+#include "parameters.h"
+#include "particles.h"
+#include "flip_grid.h"
+
+SCENARIO("FLIP grid velocities can be transferred") {
+  GIVEN("Particles<float,3> particles moving uniformly in x constructed from particle_test.ini") {
+    sim::Parameters<float, 3> params{"particle_test.ini"};
+    sim::Particles<float, 3> particles{params};
+    particles.construct_fluid(params.initial_fluid());
+    IndexSpan span{0, particles.local_count()};
+    for(unsigned int i=0; i<particles.local_count(); i++) {
+      particles.velocities()[i] = Vec<float,3>{0.5f, 0.0f, 0.0f};
+    }
+    particles.find_neighbors(span, span);
+    particles.classify_band(span, span.end);
+
+    sim::FlipGrid<float, 3> grid{params, particles.neighbors()};
+    const float spacing = particles.neighbors().bin_spacing();
+    const std::size_t center = static_cast<std::size_t>(std::floor(3.0f / spacing)) + 1;
+
+    WHEN("the particle velocities are transferred to the grid") {
+      grid.particles_to_grid(particles);
+
+      THEN("faces in the fluid should have the particle velocity") {
+        REQUIRE( grid.face_velocity(0, center, center, center) == Approx(0.5f) );
+        REQUIRE( grid.face_velocity(1, center, center, center) == Approx(0.0f) );
+      }
+
+      THEN("faces away from the fluid should be zero") {
+        REQUIRE( grid.face_velocity(0, 1, 1, 1) == Approx(0.0f) );
+      }
+    }
+
+    WHEN("the grid is projected") {
+      grid.particles_to_grid(particles);
+      grid.project();
+
+      THEN("cells containing particles should be fluid") {
+        REQUIRE( grid.cell_type(center, center, center) == sim::FlipGrid<float, 3>::FLUID );
+      }
+
+      THEN("the grid pad should be solid") {
+        REQUIRE( grid.cell_type(0, center, center) == sim::FlipGrid<float, 3>::SOLID );
+      }
+
+      THEN("empty cells should be air") {
+        REQUIRE( grid.cell_type(1, 1, 1) == sim::FlipGrid<float, 3>::AIR );
+      }
+    }
+
+    WHEN("the velocities are transferred back without projection") {
+      grid.particles_to_grid(particles);
+      grid.grid_to_particles(particles, particles.bulk_list());
+
+      THEN("there should be bulk particles") {
+        REQUIRE( particles.bulk_list().count > 0 );
+      }
+
+      THEN("bulk particle velocities should be unchanged") {
+        const auto bulk = particles.bulk_list();
+        for(std::size_t i=0; i<bulk.count; i++) {
+          REQUIRE( particles.velocities()[bulk.indices[i]].x == Approx(0.5f) );
+          REQUIRE( particles.velocities()[bulk.indices[i]].y == Approx(0.0f).margin(1e-6) );
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,152 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include <cmath>
+#include <vector>
+#include "catch.hpp"
+#include "parameters.h"
+#include "particles.h"
+#include "halo_codec.h"
+
+SCENARIO("Halo particles can be encoded and decoded", "[HaloCodec]") {
+  GIVEN("Particles<float,3> with 4 particles constructed from particle_test.ini") {
+    sim::Parameters<float,3> params{"particle_test.ini"};
+    sim::Particles<float,3> particles{params};
+    particles.attributes().append_defaults(4);
+    for(std::size_t p=0; p<4; ++p) {
+      particles.positions()[p] = Vec<float,3>{2.0f + 0.3f*p, 3.1f, 3.9f - 0.2f*p};
+      particles.position_stars()[p] = particles.positions()[p] + Vec<float,3>{0.01f, -0.02f, 0.001f*p};
+      particles.velocities()[p] = Vec<float,3>{1.5f, -0.25f*p, 3.0e-5f};
+      particles.levels()[p] = (int)p - 1;
+    }
+
+    AABB<float,3> bounds;
+    bounds.min = Vec<float,3>{1.5f};
+    bounds.max = Vec<float,3>{4.5f};
+
+    WHEN("the particles are encoded at a precision which fits 16 bits with exact velocities") {
+      const float precision = 1.0e-4f;
+      sim::HaloCodec<float,3> codec{precision, 0.0f, bounds};
+      std::size_t indices[4] = {0, 1, 2, 3};
+      std::vector<char> buffer(4*codec.max_particle_bytes() + 16);
+      const std::size_t bytes = codec.encode(particles, IndexList{indices, 4}, buffer.data(), buffer.size());
+
+      THEN("they take fewer bytes than the packed halo attributes") {
+        REQUIRE(codec.position_bits() == 16);
+        REQUIRE(bytes < 4*particles.attributes().stride(sim::ATTRIBUTE_HALO));
+      }
+
+      AND_WHEN("they are decoded") {
+        const std::size_t count = codec.decode(particles, buffer.data());
+
+        THEN("positions are within the precision and velocities and levels are exact") {
+          REQUIRE(count == 4);
+          REQUIRE(particles.local_count() == 8);
+          for(std::size_t p=0; p<4; ++p) {
+            for(int d=0; d<3; ++d) {
+              REQUIRE(std::abs(particles.positions()[p+4][d] - particles.positions()[p][d]) <= precision);
+              REQUIRE(std::abs(particles.position_stars()[p+4][d] - particles.position_stars()[p][d]) <= precision);
+              REQUIRE(particles.velocities()[p+4][d] == particles.velocities()[p][d]);
+            }
+            REQUIRE(particles.levels()[p+4] == particles.levels()[p]);
+          }
+        }
+      }
+    }
+
+    WHEN("the velocity precision is negative") {
+      THEN("the codec can't be constructed") {
+        REQUIRE_THROWS(sim::HaloCodec<float,3>(1.0e-4f, -1.0e-3f, bounds));
+      }
+    }
+
+    WHEN("the precision needs more than 16 bits") {
+      sim::HaloCodec<float,3> codec{1.0e-5f, 0.0f, bounds};
+
+      THEN("positions are encoded with 21 bits") {
+        REQUIRE(codec.position_bits() == 21);
+      }
+    }
+
+    WHEN("the precision needs more than 21 bits") {
+      THEN("the codec can't be constructed") {
+        REQUIRE_THROWS(sim::HaloCodec<float,3>(1.0e-7f, 0.0f, bounds));
+      }
+    }
+  }
+}
+
+SCENARIO("Halo particle velocities can be quantized", "[HaloCodec]") {
+  GIVEN("Particles<float,3> with 64 particles of smoothly varying velocities") {
+    sim::Parameters<float,3> params{"particle_test.ini"};
+    sim::Particles<float,3> particles{params};
+    const std::size_t count = 64;
+    particles.attributes().append_defaults(count);
+    std::vector<std::size_t> indices(count);
+    for(std::size_t p=0; p<count; ++p) {
+      const float x = 1.6f + 0.045f*p;
+      particles.positions()[p] = Vec<float,3>{x, 3.0f + 0.1f*std::sin(x), 2.0f + 0.01f*p};
+      particles.position_stars()[p] = particles.positions()[p] + Vec<float,3>{0.002f, -0.001f, 0.0005f};
+      particles.velocities()[p] = Vec<float,3>{1.7f*std::sin(2.0f*x) + 0.013f*(p%3),
+                                               -0.8f + 0.3f*std::cos(3.0f*x),
+                                               -2.2f - 0.05f*x*x};
+      particles.levels()[p] = 0;
+      indices[p] = p;
+    }
+
+    AABB<float,3> bounds;
+    bounds.min = Vec<float,3>{1.5f};
+    bounds.max = Vec<float,3>{4.5f};
+
+    WHEN("they are encoded with and without velocity quantization") {
+      const float velocity_precision = 1.0e-3f;
+      sim::HaloCodec<float,3> quantized{1.0e-4f, velocity_precision, bounds};
+      sim::HaloCodec<float,3> exact{1.0e-4f, 0.0f, bounds};
+      std::vector<char> quantized_buffer(count*quantized.max_particle_bytes() + 16);
+      std::vector<char> exact_buffer(count*exact.max_particle_bytes() + 16);
+      const std::size_t quantized_bytes = quantized.encode(particles, IndexList{indices.data(), count},
+                                                           quantized_buffer.data(), quantized_buffer.size());
+      const std::size_t exact_bytes = exact.encode(particles, IndexList{indices.data(), count},
+                                                   exact_buffer.data(), exact_buffer.size());
+
+      THEN("the quantized velocity differences take fewer bytes than raw velocities") {
+        REQUIRE(quantized_bytes + count*3*2 <= exact_bytes);
+      }
+
+      AND_WHEN("the quantized particles are decoded") {
+        quantized.decode(particles, quantized_buffer.data());
+
+        THEN("velocities are within half the velocity precision") {
+          REQUIRE(particles.local_count() == 2*count);
+          for(std::size_t p=0; p<count; ++p) {
+            for(int d=0; d<3; ++d)
+              REQUIRE(std::abs(particles.velocities()[p+count][d] - particles.velocities()[p][d]) <=
+                      0.5f*velocity_precision + 1.0e-6f);
+          }
+        }
+      }
+    }
+  }
+}
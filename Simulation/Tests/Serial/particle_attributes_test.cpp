@@ -0,0 +1,161 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include "catch.hpp"
+#include "arena.h"
+#include "array.h"
+#include "vec.h"
+#include "particle_attributes.h"
+
+SCENARIO("Particle attributes are moved together", "[ParticleAttributes]") {
+  GIVEN("a registry of a migrated vec, a halo int, and a local float attribute") {
+    sim::Arena arena(1024 * 1024);
+    sim::Array<Vec<float,3>> positions(100, arena, "positions");
+    sim::Array<int> levels(100, arena, "levels");
+    sim::Array<float> densities(100, arena, "densities");
+
+    sim::ParticleAttributes attributes;
+    attributes.add(positions, Vec<float,3>{0.0f}, sim::ATTRIBUTE_MIGRATE | sim::ATTRIBUTE_HALO, "positions");
+    attributes.add(levels, 7, sim::ATTRIBUTE_HALO, "levels");
+    attributes.add(densities, 1.5f, sim::ATTRIBUTE_LOCAL, "densities");
+    attributes.reserve(arena);
+
+    THEN("the strides should select attributes by flag") {
+      REQUIRE( attributes.count() == 3 );
+      REQUIRE( attributes.stride() == sizeof(Vec<float,3>) + sizeof(int) + sizeof(float) );
+      REQUIRE( attributes.stride(sim::ATTRIBUTE_MIGRATE) == sizeof(Vec<float,3>) );
+      REQUIRE( attributes.stride(sim::ATTRIBUTE_HALO) == sizeof(Vec<float,3>) + sizeof(int) );
+      REQUIRE( attributes.stride(sim::ATTRIBUTE_ALL) == attributes.stride() );
+      REQUIRE( attributes.stride(sim::ATTRIBUTE_LOCAL) == 0 );
+    }
+
+    WHEN("particles are appended with default values") {
+      const auto added = attributes.append_defaults(4);
+      for(std::size_t p = 0; p < 4; ++p) {
+        positions[p] = Vec<float,3>{(float)p};
+        levels[p] = (int)p;
+        densities[p] = 10.0f * p;
+      }
+
+      THEN("every array should be resized together") {
+        REQUIRE( added.begin == 0 );
+        REQUIRE( added.end == 4 );
+        REQUIRE( attributes.size() == 4 );
+        REQUIRE( levels.size() == 4 );
+        REQUIRE( densities.size() == 4 );
+      }
+
+      AND_WHEN("the particles are permuted") {
+        std::size_t *order = attributes.reset_order(4);
+        order[0] = 3; order[1] = 2; order[2] = 1; order[3] = 0;
+        attributes.permute(IndexSpan{0, 4});
+        THEN("every attribute should be reordered") {
+          REQUIRE( positions[0].x == 3.0f );
+          REQUIRE( levels[0] == 3 );
+          REQUIRE( densities[0] == 30.0f );
+          REQUIRE( levels[3] == 0 );
+        }
+      }
+
+      AND_WHEN("the particles are partitioned three ways by level") {
+        const auto counts = attributes.partition_three_way(IndexSpan{0, 4}, [&] (std::size_t p) {
+          return levels[p] % 2 == 0 ? 2 : (levels[p] == 1 ? 0 : 1);
+        });
+        attributes.permute(IndexSpan{0, 4});
+        THEN("the classes should be counted and arranged stably") {
+          REQUIRE( counts[0] == 1 );
+          REQUIRE( counts[1] == 1 );
+          REQUIRE( counts[2] == 2 );
+          REQUIRE( levels[0] == 1 );
+          REQUIRE( levels[1] == 3 );
+          REQUIRE( levels[2] == 0 );
+          REQUIRE( levels[3] == 2 );
+          REQUIRE( positions[3].x == 2.0f );
+        }
+      }
+
+      AND_WHEN("halo attributes are packed and unpacked") {
+        attributes.pack(sim::ATTRIBUTE_HALO, IndexSpan{2, 4}, attributes.staging());
+        const auto unpacked = attributes.unpack(sim::ATTRIBUTE_HALO, attributes.staging(), 2);
+        THEN("packed attributes should be copied and the rest defaulted") {
+          REQUIRE( unpacked.begin == 4 );
+          REQUIRE( attributes.size() == 6 );
+          REQUIRE( positions[4].y == 2.0f );
+          REQUIRE( levels[5] == 3 );
+          REQUIRE( densities[4] == 1.5f );
+        }
+      }
+
+      AND_WHEN("particles are erased") {
+        attributes.erase_tail(3);
+        THEN("every array should shrink") {
+          REQUIRE( positions.size() == 1 );
+          REQUIRE( densities.size() == 1 );
+        }
+      }
+    }
+
+    WHEN("more particles than the capacity are appended") {
+      THEN("an exception should be thrown") {
+        REQUIRE_THROWS( attributes.append_defaults(101) );
+      }
+    }
+  }
+}
+
+SCENARIO("Particle attributes are partitioned into many classes", "[ParticleAttributes]") {
+  GIVEN("a registry of 1000 particles spanning several partition chunks") {
+    sim::Arena arena(1024 * 1024);
+    sim::Array<int> levels(1000, arena, "levels");
+
+    sim::ParticleAttributes attributes;
+    attributes.add(levels, 0, sim::ATTRIBUTE_MIGRATE, "levels");
+    attributes.reserve(arena);
+    attributes.append_defaults(1000);
+    for(std::size_t p = 0; p < 1000; ++p)
+      levels[p] = (int)p;
+
+    WHEN("the particles are partitioned into seven classes") {
+      const std::size_t *offsets = attributes.partition_by_class(IndexSpan{0, 1000}, 7, [&] (std::size_t p) {
+        return static_cast<std::size_t>(6 - levels[p] % 7);
+      });
+      attributes.permute(IndexSpan{0, 1000});
+
+      THEN("the classes should be counted and arranged stably") {
+        REQUIRE( offsets[0] == 0 );
+        REQUIRE( offsets[1] == 142 );
+        REQUIRE( offsets[6] == 1000 - 143 );
+        REQUIRE( offsets[7] == 1000 );
+        for(std::size_t c = 0; c < 7; ++c) {
+          for(std::size_t p = offsets[c]; p < offsets[c + 1]; ++p) {
+            REQUIRE( 6 - levels[p] % 7 == (int)c );
+            if(p > offsets[c])
+              REQUIRE( levels[p] > levels[p - 1] );
+          }
+        }
+      }
+    }
+  }
+}
@@ -115,6 +115,28 @@ SCENARIO("Particles can be added to the system") {
       AND_THEN("the available count should equal 100000 - 27000") {
         REQUIRE( particles.available() == 100000-27000 );
       }
+      AND_THEN("the particles should lie on the rest spacing lattice, x fastest") {
+        const float spacing = params.particle_rest_spacing();
+        const auto first = particles.positions()[0];
+        const auto second = particles.positions()[1];
+        const auto last = particles.positions()[particles.local_count() - 1];
+        REQUIRE( first.x == Approx(params.initial_fluid().min.x + 0.5f * spacing) );
+        REQUIRE( first.y == Approx(params.initial_fluid().min.y + 0.5f * spacing) );
+        REQUIRE( first.z == Approx(params.initial_fluid().min.z + 0.5f * spacing) );
+        REQUIRE( second.x == Approx(first.x + spacing) );
+        REQUIRE( second.y == Approx(first.y) );
+        REQUIRE( last.z == Approx(first.z + 29.0f * spacing) );
+        REQUIRE( particles.position_stars()[1].x == Approx(second.x) );
+      }
+    }
+
+    WHEN("the initial fluid is constructed twice") {
+      particles.construct_fluid(params.initial_fluid());
+      particles.construct_fluid(params.initial_fluid());
+      THEN("the second block should be appended") {
+        REQUIRE( particles.local_count() == 2*27000 );
+        REQUIRE( particles.positions()[27000].x == Approx(particles.positions()[0].x) );
+      }
     }
   }
 }
@@ -267,14 +289,254 @@ SCENARIO("densities can be computed") {
 }
 
 SCENARIO("pressure lambdas can be computed") {
+  GIVEN("Particles<float,3> particles constructed from particle_test.ini") {
+    sim::Parameters<float, 3> params{"particle_test.ini"};
+    sim::Particles<float, 3> particles{params};
+    particles.construct_fluid(params.initial_fluid());
+    IndexSpan span{0, particles.local_count()};
+    particles.find_neighbors(span, span);
+    particles.compute_densities(span);
+
+    WHEN("XPBD lambdas are computed with zero compliance") {
+      params.compliance_ = 0.0f;
+      particles.compute_xpbd_lambdas(span, 0);
+      const auto stiff_lambdas{particles.lambdas()};
+
+      THEN("the accumulated lambdas should only push particles apart") {
+        for(unsigned int i=0; i<particles.local_count(); i++) {
+          REQUIRE( stiff_lambdas[i] <= 0.0f );
+        }
+      }
+
+      AND_WHEN("XPBD lambdas are recomputed with a non zero compliance") {
+        params.compliance_ = 1.0e-6f;
+        particles.compute_xpbd_lambdas(span, 0);
+
+        THEN("the lambda magnitudes should not grow") {
+          for(unsigned int i=0; i<particles.local_count(); i++) {
+            REQUIRE( particles.lambdas()[i] <= 0.0f );
+            REQUIRE( std::abs(particles.lambdas()[i]) <= std::abs(stiff_lambdas[i]) );
+          }
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("XPBD converges independently of the solve step count") {
+  GIVEN("a compressed block of 512 particles and a compliance of 20") {
+    sim::Parameters<float, 3> params{"particle_test.ini"};
+    params.compliance_ = 20.0f;
+
+    // Mean positive density constraint after solve_step_count_ XPBD substeps
+    const auto constraint_residual = [&params]() {
+      sim::Particles<float, 3> particles{params};
+      AABB<float, 3> block;
+      block.min = Vec<float,3>{2.0f};
+      block.max = Vec<float,3>{2.0f + 8.0f*params.particle_rest_spacing()};
+      particles.construct_fluid(block);
+      IndexSpan span{0, particles.local_count()};
+
+      for(unsigned int i=0; i<particles.local_count(); i++) {
+        const Vec<float,3> compressed = block.center() + 0.95f*(particles.position_stars()[i] - block.center());
+        particles.position_stars()[i] = compressed;
+        particles.positions()[i] = compressed;
+      }
+      particles.find_neighbors(span, span);
+
+      for(unsigned int sub=0; sub<params.solve_step_count(); sub++) {
+        particles.compute_densities(span);
+        particles.compute_xpbd_lambdas(span, sub);
+        particles.compute_xpbd_dps(span);
+        particles.update_position_stars(span, sub);
+      }
+      particles.compute_densities(span);
+
+      double residual = 0.0;
+      for(unsigned int i=0; i<particles.local_count(); i++) {
+        residual += std::max(particles.densities()[i]/params.rest_density() - 1.0f, 0.0f);
+      }
+      return residual / particles.local_count();
+    };
+
+    WHEN("the constraints are solved with 20 and with 40 solve steps") {
+      params.solve_step_count_ = 20;
+      const double residual_20 = constraint_residual();
+      params.solve_step_count_ = 40;
+      const double residual_40 = constraint_residual();
+
+      THEN("the compliant residual should be the same for both step counts") {
+        REQUIRE( residual_20 > 1.0e-3 );
+        REQUIRE( residual_20 == Approx(residual_40).epsilon(0.01) );
+      }
+    }
+  }
 }
 
 
 SCENARIO("pressure deltas can be computed") {
 }
 
+SCENARIO("DFSPH velocities can be corrected") {
+  GIVEN("Particles<float,3> particles at rest constructed from particle_test.ini") {
+    sim::Parameters<float, 3> params{"particle_test.ini"};
+    sim::Particles<float, 3> particles{params};
+    particles.construct_fluid(params.initial_fluid());
+    IndexSpan span{0, particles.local_count()};
+    particles.reset_position_stars(span);
+    particles.find_neighbors(span, span);
+    particles.compute_densities(span);
+    particles.compute_dfsph_factors(span);
+
+    WHEN("a divergence solve step is applied") {
+      particles.compute_dfsph_divergence_kappas(span);
+      particles.apply_dfsph_kappas(span);
+
+      THEN("the divergence free velocities should remain zero") {
+        for(unsigned int i=0; i<particles.local_count(); i++) {
+          REQUIRE( particles.velocities()[i].x == Approx(0.0f) );
+          REQUIRE( particles.velocities()[i].y == Approx(0.0f) );
+          REQUIRE( particles.velocities()[i].z == Approx(0.0f) );
+        }
+      }
+    }
+
+    WHEN("a density solve step is applied") {
+      particles.compute_dfsph_density_kappas(span);
+      particles.apply_dfsph_kappas(span);
+
+      THEN("the stiffness should be non negative") {
+        for(unsigned int i=0; i<particles.local_count(); i++) {
+          REQUIRE( particles.lambdas()[i] >= 0.0f );
+        }
+      }
+    }
+  }
+}
+
 
 SCENARIO("position stars can be updated") {
+  GIVEN("Particles<float,3> particles constructed from particle_test.ini") {
+    sim::Parameters<float, 3> params{"particle_test.ini"};
+    sim::Particles<float, 3> particles{params};
+    particles.construct_fluid(params.initial_fluid());
+    IndexSpan span{0, particles.local_count()};
+
+    WHEN("the delta positions are set to (0.1, 0.2, 0.3) and position stars are updated") {
+      const auto previous_position_stars{particles.position_stars()};
+      for(unsigned int i=0; i<particles.local_count(); i++) {
+        particles.scratch()[i] = Vec<float,3>{0.1f, 0.2f, 0.3f};
+      }
+      particles.update_position_stars(span, 0);
+
+      THEN("the position stars should move by the delta positions") {
+        for(unsigned int i=0; i<particles.local_count(); i++) {
+          REQUIRE( particles.position_stars()[i].x == Approx(previous_position_stars[i].x + 0.1f) );
+          REQUIRE( particles.position_stars()[i].y == Approx(previous_position_stars[i].y + 0.2f) );
+          REQUIRE( particles.position_stars()[i].z == Approx(previous_position_stars[i].z + 0.3f) );
+        }
+      }
+    }
+
+    WHEN("Chebyshev acceleration is disabled") {
+      params.chebyshev_rho_ = 0.0f;
+      THEN("the Chebyshev weights should all be 1.0") {
+        REQUIRE( particles.chebyshev_omega(0) == Approx(1.0f) );
+        REQUIRE( particles.chebyshev_omega(1) == Approx(1.0f) );
+        REQUIRE( particles.chebyshev_omega(3) == Approx(1.0f) );
+      }
+    }
+
+    WHEN("Chebyshev acceleration is enabled with a spectral radius of 0.5") {
+      params.chebyshev_rho_ = 0.5f;
+      THEN("the Chebyshev weights should follow the semi-iterative recurrence") {
+        REQUIRE( particles.chebyshev_omega(0) == Approx(1.0f) );
+        REQUIRE( particles.chebyshev_omega(1) == Approx(2.0f / 1.75f) );
+        REQUIRE( particles.chebyshev_omega(2) == Approx(4.0f / (4.0f - 0.25f * 2.0f / 1.75f)) );
+      }
+    }
+
+    WHEN("two substeps are taken with an SOR weight of 1.5 and a spectral radius of 0.5") {
+      params.sor_omega_ = 1.5f;
+      params.chebyshev_rho_ = 0.5f;
+      const auto initial_position_stars{particles.position_stars()};
+      const Vec<float,3> delta{0.001f, 0.002f, 0.003f};
+      for(unsigned int i=0; i<particles.local_count(); i++) {
+        particles.scratch()[i] = delta;
+      }
+
+      particles.update_position_stars(span, 0);
+      const auto first_position_stars{particles.position_stars()};
+      particles.update_position_stars(span, 1);
+
+      THEN("the first substep should move by the weighted delta") {
+        for(unsigned int i=0; i<particles.local_count(); i++) {
+          REQUIRE( first_position_stars[i].x == Approx(initial_position_stars[i].x + 1.5f*delta.x) );
+          REQUIRE( first_position_stars[i].y == Approx(initial_position_stars[i].y + 1.5f*delta.y) );
+          REQUIRE( first_position_stars[i].z == Approx(initial_position_stars[i].z + 1.5f*delta.z) );
+        }
+      }
+
+      THEN("the second substep should be accelerated from the initial position stars") {
+        // x2 = omega*(x1 + 1.5*dp - x0) + x0 = x0 + omega*3.0*dp
+        const float omega = 2.0f / 1.75f;
+        for(unsigned int i=0; i<particles.local_count(); i++) {
+          REQUIRE( particles.position_stars()[i].x == Approx(initial_position_stars[i].x + omega*3.0f*delta.x) );
+          REQUIRE( particles.position_stars()[i].y == Approx(initial_position_stars[i].y + omega*3.0f*delta.y) );
+          REQUIRE( particles.position_stars()[i].z == Approx(initial_position_stars[i].z + omega*3.0f*delta.z) );
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("particle resolution can be adapted") {
+  GIVEN("Particles<float,3> particles with a maximum resolution level of 1") {
+    sim::Parameters<float, 3> params{"particle_test.ini"};
+    params.max_resolution_level_ = 1;
+    sim::Particles<float, 3> particles{params};
+    particles.construct_fluid(params.initial_fluid());
+    const std::size_t initial_count = particles.local_count();
+    IndexSpan span{0, initial_count};
+    particles.find_neighbors(span, span);
+
+    WHEN("the resolution is adapted") {
+      const std::size_t count = particles.adapt_resolution(span);
+
+      float total_mass = 0.0f;
+      for(std::size_t i=0; i<count; i++) {
+        total_mass += particles.relative_mass(i);
+      }
+
+      THEN("interior particles should be merged") {
+        REQUIRE( count < initial_count );
+        REQUIRE( count == particles.local_count() );
+      }
+      THEN("mass should be conserved") {
+        REQUIRE( total_mass == Approx(static_cast<float>(initial_count)) );
+      }
+      THEN("no particle should exceed the maximum level") {
+        for(std::size_t i=0; i<count; i++) {
+          REQUIRE( particles.levels()[i] >= 0 );
+          REQUIRE( particles.levels()[i] <= 1 );
+        }
+      }
+    }
+
+    WHEN("every particle is level 1 and the resolution is adapted") {
+      for(std::size_t i=0; i<initial_count; i++) {
+        particles.levels()[i] = 1;
+      }
+      const std::size_t count = particles.adapt_resolution(span);
+
+      THEN("surface particles should be split") {
+        REQUIRE( count > initial_count );
+        for(std::size_t i=initial_count; i<count; i++) {
+          REQUIRE( particles.levels()[i] == 0 );
+        }
+      }
+    }
+  }
 }
 
 SCENARIO("velocities can be updated") {
@@ -285,6 +547,33 @@ SCENARIO("positions can be updated") {
 }
 
 SCENARIO("surface tension can be applied") {
+  GIVEN("Particles<float,3> particles constructed from particle_test.ini") {
+    sim::Parameters<float, 3> params{"particle_test.ini"};
+    sim::Particles<float, 3> particles{params};
+    particles.construct_fluid(params.initial_fluid());
+    IndexSpan span{0, particles.local_count()};
+    particles.find_neighbors(span, span);
+
+    WHEN("the surface particles are classified") {
+      const std::size_t surface_count = particles.classify_surface(span);
+
+      THEN("only particles with a partial neighborhood should be in the surface list") {
+        REQUIRE( surface_count > 0 );
+        REQUIRE( surface_count < particles.local_count() );
+        for(std::size_t i=0; i<surface_count; i++) {
+          REQUIRE( particles.is_surface(particles.surface_indices()[i]) );
+        }
+      }
+
+      THEN("the fluid center should not be in the surface list") {
+        const Vec<float,3> center = params.initial_fluid().center();
+        for(std::size_t i=0; i<surface_count; i++) {
+          const auto p = particles.surface_indices()[i];
+          REQUIRE( magnitude(particles.positions()[p] - center) > 4.0f * params.particle_rest_spacing() );
+        }
+      }
+    }
+  }
 }
 
 SCENARIO("viscosity can be applied") {
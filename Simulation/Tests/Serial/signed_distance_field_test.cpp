@@ -0,0 +1,105 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "catch.hpp"
+#include <cstdio>
+#include <fstream>
+#include "parameters.h"
+#include "signed_distance_field.h"
+
+// Write a closed cube spanning [2.5, 3.5] as an OBJ of quads
+static void write_cube_obj(const char *file_name) {
+  std::ofstream obj{file_name};
+  obj << "v 2.5 2.5 2.5\nv 3.5 2.5 2.5\nv 3.5 3.5 2.5\nv 2.5 3.5 2.5\n"
+      << "v 2.5 2.5 3.5\nv 3.5 2.5 3.5\nv 3.5 3.5 3.5\nv 2.5 3.5 3.5\n"
+      << "f 1 4 3 2\nf 5 6 7 8\nf 1 2 6 5\nf 2 3 7 6\nf 3 4 8 7\nf 4 1 5 8\n";
+}
+
+SCENARIO("Signed distance fields can be built from OBJ meshes") {
+  GIVEN("A cube OBJ boundary described by sdf_test.ini") {
+    write_cube_obj("sdf_test_cube.obj");
+    std::remove("sdf_test_cube.sdf");
+    sim::Parameters<float, 3> params{"sdf_test.ini"};
+
+    WHEN("the field is built") {
+      sim::SignedDistanceField<float, 3> sdf{params};
+
+      THEN("the field should be active") {
+        REQUIRE( sdf.active() );
+      }
+
+      THEN("the distance should be negative inside of the cube") {
+        REQUIRE( sdf.distance(Vec<float, 3>{3.0f, 3.0f, 3.0f}) == Approx(-0.5f).margin(0.05f) );
+      }
+
+      THEN("the distance should be positive outside of the cube") {
+        REQUIRE( sdf.distance(Vec<float, 3>{3.0f, 3.0f, 3.6f}) == Approx(0.1f).margin(0.05f) );
+      }
+
+      THEN("points far from the cube should be outside") {
+        REQUIRE( sdf.distance(Vec<float, 3>{0.5f, 0.5f, 0.5f}) > 0.0f );
+      }
+
+      THEN("points inside should be pushed to the surface") {
+        Vec<float, 3> position{3.0f, 3.0f, 3.4f};
+        sdf.push_out(position);
+        REQUIRE( position.x == Approx(3.0f).margin(0.01f) );
+        REQUIRE( position.y == Approx(3.0f).margin(0.01f) );
+        REQUIRE( position.z == Approx(3.5f).margin(0.02f) );
+      }
+
+      THEN("points outside should not move") {
+        Vec<float, 3> position{3.0f, 3.0f, 4.0f};
+        sdf.push_out(position);
+        REQUIRE( position.z == Approx(4.0f) );
+      }
+    }
+
+    WHEN("the OBJ is edited after the cache was written") {
+      sim::SignedDistanceField<float, 3> built{params};
+      {
+        std::ofstream obj{"sdf_test_cube.obj"};
+        obj << "v 2.0 2.0 2.0\nv 4.0 2.0 2.0\nv 4.0 4.0 2.0\nv 2.0 4.0 2.0\n"
+            << "v 2.0 2.0 4.0\nv 4.0 2.0 4.0\nv 4.0 4.0 4.0\nv 2.0 4.0 4.0\n"
+            << "f 1 4 3 2\nf 5 6 7 8\nf 1 2 6 5\nf 2 3 7 6\nf 3 4 8 7\nf 4 1 5 8\n";
+      }
+      sim::SignedDistanceField<float, 3> rebuilt{params};
+
+      THEN("the field should be rebuilt from the edited mesh") {
+        REQUIRE( rebuilt.distance(Vec<float, 3>{3.0f, 3.0f, 3.0f}) == Approx(-1.0f).margin(0.05f) );
+      }
+    }
+
+    WHEN("the field is built a second time from the cache") {
+      sim::SignedDistanceField<float, 3> built{params};
+      std::remove("sdf_test_cube.obj");
+      sim::SignedDistanceField<float, 3> cached{params};
+
+      THEN("the cached distances should match the built distances") {
+        const Vec<float, 3> position{3.1f, 2.8f, 3.3f};
+        REQUIRE( cached.distance(position) == Approx(built.distance(position)) );
+      }
+    }
+  }
+}